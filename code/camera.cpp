@@ -74,6 +74,11 @@ glm::mat4 Camera::ViewMatrix() const
     return view_matrix;
 }
 
+glm::vec3 Camera::Position() const
+{
+    return position;
+}
+
 void Camera::Move(float forward_speed, float right_speed)
 {
     glm::vec3 forward(-view_matrix[0][2], -view_matrix[1][2], -view_matrix[2][2]);
@@ -38,6 +38,7 @@ public:
 
     glm::mat4 ProjectionMatrix() const;
     glm::mat4 ViewMatrix() const;
+    glm::vec3 Position() const;
 
     void Move(float forward_speed, float right_speed);
     void Look(float delta_yaw, float delta_pitch);
@@ -20,11 +20,17 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <string>
 
 #include "camera.h"
 #include "renderer.h"
+#include "tr_loader.h"
+#include "tr_memory.h"
+#include "tr_streamer.h"
+#include "tr_texpages.h"
+#include "tr_thread_pool.h"
 #include "tr_types.h"
 
 static bool SYS_ParseOptions(int argc, char* argv[]);
@@ -34,6 +40,8 @@ static bool SYS_Init();
 static bool SYS_Frame();
 static void SYS_Shutdown();
 
+static void SYS_StreamRooms(tr::level* level);
+
 static SDL_Window* window = nullptr;
 static SDL_GLContext glcontext = nullptr;
 
@@ -54,6 +62,20 @@ static struct {
     tr::version version = tr::version_invalid;
     bool debug_draw_all_meshes = false;
     bool debug_draw_all_sprites = false;
+    int num_threads = 0;
+    bool load_report = false;
+    bool memory_report = false;
+    bool geometry_report = false;
+    bool cache = false;
+    bool compact_texpages = false;
+    bool batch_static_meshes = false;
+    bool instance_meshes = false;
+    bool indirect_draws = true;
+    bool draw_report = false;
+    bool gpu_resident = false;
+    Renderer::TexPageFormat texpage_format = Renderer::TEXPAGE_FORMAT_INDEXED;
+    bool stream_rooms = false;
+    int stream_budget = 64; // in megabytes
 } cmdopts;
 
 int main(int argc, char* argv[])
@@ -66,13 +88,49 @@ int main(int argc, char* argv[])
     if (!SYS_Init())
         return 1;
 
-    renderer = new Renderer();
+    if (cmdopts.num_threads > 0)
+        tr::thread_pool::set_global_num_threads(cmdopts.num_threads);
+
+    renderer = new Renderer(cmdopts.texpage_format);
+    renderer->SetMeasureTriangleOrder(cmdopts.geometry_report);
+    renderer->SetBatchStaticMeshes(cmdopts.batch_static_meshes);
+    renderer->SetInstanceMeshes(cmdopts.instance_meshes);
+    renderer->SetIndirectDraws(cmdopts.indirect_draws);
 
     camera.SetPerspective(M_PI/3.0f, 1366.0f/768.0f, 10.0f, 1000000.0f);
     camera.SetTransform(glm::vec3(0.0f, 0.0f, 0.0f), 0.0f, 0.0f);
 
-    std::unique_ptr<tr::level> level = tr::level::load(cmdopts.level.c_str(), cmdopts.version);
+    tr::load_report load_report;
+    std::unique_ptr<tr::level> level;
+    bool texpages16 = (cmdopts.texpage_format == Renderer::TEXPAGE_FORMAT_RGB5_A1);
+    if (cmdopts.stream_rooms)
+        level = tr::level::load_streaming(cmdopts.level.c_str(), cmdopts.version, texpages16, &load_report);
+    else if (cmdopts.cache)
+        level = tr::level::load_cached(cmdopts.level.c_str(), cmdopts.version, texpages16, &load_report);
+    else
+        level = tr::level::load(cmdopts.level.c_str(), cmdopts.version, texpages16, &load_report);
+    if (cmdopts.load_report)
+        load_report.print(stdout);
+    if (cmdopts.compact_texpages) {
+        tr::compaction_report compaction_report;
+        tr::compact_texpages(level.get(), &compaction_report);
+        compaction_report.print(stdout);
+    }
     renderer->RegisterLevel(*level);
+    if (cmdopts.gpu_resident)
+        level->release_uploaded_data();
+    if (cmdopts.geometry_report)
+        renderer->PrintGeometryReport(stdout);
+    if (cmdopts.memory_report) {
+        tr::memory_report cpu_report, gpu_report;
+        level->memory_usage(&cpu_report);
+        renderer->MemoryUsage(&gpu_report);
+        cpu_report.print(stdout, "cpu memory");
+        gpu_report.print(stdout, "gpu memory");
+        printf("peak memory during load: %zu bytes (%.2f MB)\n", load_report.peak_bytes, load_report.peak_bytes / (1024.0 * 1024.0));
+    }
+    if (level->room_streamer)
+        level->room_streamer->set_budget(cmdopts.stream_budget * 1024L * 1024L);
 
     // TODO: don't add altrooms to the render list
     for (tr::room& room : level->rooms)
@@ -82,8 +140,9 @@ int main(int argc, char* argv[])
     for (tr::sprite_object& spriteobj : level->sprite_objects)
         frameinfo.sprite_objects.push_back(&spriteobj);
 
+    tr::handle<tr::model> lara = level->find_model(0);
     for (const tr::model_object& modelobj : level->model_objects) {
-        if (modelobj.model->id == 0) {
+        if (modelobj.model == lara) {
             // TODO: set camera orientation
             glm::vec3 position = glm::vec3(modelobj.transform[3]) + glm::vec3(0.0f, -1024.0f, 0.0f);
             camera.SetTransform(position, 0.0f, 0.0f);
@@ -93,30 +152,28 @@ int main(int argc, char* argv[])
     frameinfo.debug_draw_all_meshes = cmdopts.debug_draw_all_meshes;
     frameinfo.debug_draw_all_sprites = cmdopts.debug_draw_all_sprites;
 
+    SYS_StreamRooms(level.get());
+
     // TODO: implement framerate-independent main loop
     long last_frame_ticks = SDL_GetTicks();
     float texanim_time = 0;
+    float draw_report_time = 0;
     while (SYS_Frame()) {
+        SYS_StreamRooms(level.get());
+
         long cur_frame_ticks = SDL_GetTicks();
         float dt = (cur_frame_ticks - last_frame_ticks) / 1000.0f;
         last_frame_ticks = cur_frame_ticks;
 
-        // TODO: move this to tr::level?
         texanim_time += dt;
         if (texanim_time >= 0.1f) {
             texanim_time -= 0.1f;
-            for (tr::room& room : level->rooms) {
-                bool updated = false;
-                for (tr::mesh_poly& polygon : room.geometry.polys) {
-                    if (polygon.texinfo->texanimchain) {
-                        updated = true;
-                        polygon.texinfo = polygon.texinfo->texanimchain;
-                    }
-                }
-                // TODO: reupload only updated polygons
-                if (updated)
-                    renderer->NotifyRoomMeshUpdated(room.geometry);
-            }
+            renderer->AnimateTextures();
+        }
+        draw_report_time += dt;
+        if (cmdopts.draw_report && draw_report_time >= 1.0f) {
+            draw_report_time = 0;
+            renderer->PrintDrawReport(stdout);
         }
         for (tr::model_object* modelobj: frameinfo.model_objects)
             modelobj->tick(dt);
@@ -138,6 +195,44 @@ bool SYS_ParseOptions(int argc, char* argv[])
             cmdopts.debug_draw_all_meshes = true;
         } else if (arg == "-debug_draw_all_sprites") {
             cmdopts.debug_draw_all_sprites = true;
+        } else if (arg == "-batch_static_meshes") {
+            cmdopts.batch_static_meshes = true;
+        } else if (arg == "-cache") {
+            cmdopts.cache = true;
+        } else if (arg == "-compact_texpages") {
+            cmdopts.compact_texpages = true;
+        } else if (arg == "-draw_report") {
+            cmdopts.draw_report = true;
+        } else if (arg == "-geometry_report") {
+            cmdopts.geometry_report = true;
+        } else if (arg == "-gpu_resident") {
+            cmdopts.gpu_resident = true;
+        } else if (arg == "-texpage_format") {
+            std::string format = (i + 1 < argc) ? argv[++i] : "";
+            if (format == "indexed")
+                cmdopts.texpage_format = Renderer::TEXPAGE_FORMAT_INDEXED;
+            else if (format == "rgba8")
+                cmdopts.texpage_format = Renderer::TEXPAGE_FORMAT_RGBA8;
+            else if (format == "rgb5a1")
+                cmdopts.texpage_format = Renderer::TEXPAGE_FORMAT_RGB5_A1;
+            else
+                return false;
+        } else if (arg == "-instance_meshes") {
+            cmdopts.instance_meshes = true;
+        } else if (arg == "-no_indirect_draws") {
+            cmdopts.indirect_draws = false;
+        } else if (arg == "-load_report") {
+            cmdopts.load_report = true;
+        } else if (arg == "-memory_report") {
+            cmdopts.memory_report = true;
+        } else if (arg == "-stream_rooms") {
+            cmdopts.stream_rooms = true;
+        } else if (arg == "-stream_budget") {
+            if (i + 1 >= argc || (cmdopts.stream_budget = atoi(argv[++i])) <= 0)
+                return false;
+        } else if (arg == "-threads") {
+            if (i + 1 >= argc || (cmdopts.num_threads = atoi(argv[++i])) <= 0)
+                return false;
         } else if (arg == "-tr1") {
             if (cmdopts.version == tr::version_invalid) {
                 cmdopts.version = tr::version_tr1;
@@ -168,6 +263,9 @@ bool SYS_ParseOptions(int argc, char* argv[])
     if (cmdopts.version == tr::version_invalid)
         return false;
 
+    if (cmdopts.cache && cmdopts.stream_rooms)
+        fprintf(stderr, "[WARNING] SYS_ParseOptions(): -stream_rooms reads the level file, -cache is ignored\n");
+
     return true;
 }
 
@@ -175,8 +273,22 @@ void SYS_PrintUsageInfo()
 {
     fprintf(stderr, "usage: ./tr_level_viewer {-tr1|-tr2} [OPTION]... LEVEL\n\n");
     fprintf(stderr, "OPTIONS\n");
+    fprintf(stderr, "  -batch_static_meshes\n");
+    fprintf(stderr, "  -cache\n");
+    fprintf(stderr, "  -compact_texpages\n");
     fprintf(stderr, "  -debug_draw_all_meshes\n");
     fprintf(stderr, "  -debug_draw_all_sprites\n");
+    fprintf(stderr, "  -draw_report\n");
+    fprintf(stderr, "  -geometry_report\n");
+    fprintf(stderr, "  -gpu_resident\n");
+    fprintf(stderr, "  -instance_meshes\n");
+    fprintf(stderr, "  -load_report\n");
+    fprintf(stderr, "  -memory_report\n");
+    fprintf(stderr, "  -no_indirect_draws\n");
+    fprintf(stderr, "  -stream_rooms (ignores -cache)\n");
+    fprintf(stderr, "  -stream_budget MEGABYTES\n");
+    fprintf(stderr, "  -texpage_format {indexed|rgba8|rgb5a1}\n");
+    fprintf(stderr, "  -threads N\n");
     fprintf(stderr, "\n");
 }
 
@@ -270,3 +382,16 @@ void SYS_Shutdown()
     }
     SDL_Quit();
 }
+
+void SYS_StreamRooms(tr::level* level)
+{
+    if (!level->room_streamer)
+        return;
+
+    std::vector<long> loaded, evicted;
+    level->room_streamer->update(camera.Position(), &loaded, &evicted);
+    for (long room_idx : evicted)
+        renderer->NotifyRoomEvicted(level->rooms[room_idx]);
+    for (long room_idx : loaded)
+        renderer->NotifyRoomLoaded(level->rooms[room_idx]);
+}
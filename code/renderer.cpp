@@ -18,11 +18,30 @@
 
 #include "renderer.h"
 
+#include "tr_cache.h"
+#include "tr_decode.h"
+#include "tr_memory.h"
+#include "tr_meshopt.h"
+
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <assert.h>
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+static void ReturnFreeRange(std::vector<std::pair<GLint, GLsizei>>* free_ranges, GLint first, GLsizei count);
+
+static bool SupportsIndirectDraws();
+
+static const int TRANSFORM_BUFFER_SIZE = 128;
+// NOTE: room lighting buffers use std140 layout,
+// see shader source code for details
+static const int ROOM_LIGHTING_BUFFER_SIZE = 272;
 
 /*
  * Renderer
@@ -32,7 +51,12 @@
  * TODO: sort meshes by shader
  */
 
-Renderer::Renderer()
+Renderer::Renderer(Renderer::TexPageFormat texpage_format) :
+    level(nullptr), texpage_format(texpage_format), texpages_size(0),
+    instance_meshes(false), instance_buffer_size(0),
+    has_indirect_draws(false), indirect_draws(false),
+    draw_command_buffer_size(0), draw_data_buffer_size(0), draw_index_capacity(0),
+    measure_triangle_order(false), batch_static_meshes(false)
 {
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
@@ -45,18 +69,39 @@ Renderer::Renderer()
     // transform uniform buffer
     glGenBuffers(1, &transform_ubo);
     glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORMBLOCK_TRANSFORM, transform_ubo);
-    glBufferData(GL_UNIFORM_BUFFER, 128, nullptr, GL_DYNAMIC_DRAW);
+    glBufferData(GL_UNIFORM_BUFFER, TRANSFORM_BUFFER_SIZE, nullptr, GL_DYNAMIC_DRAW);
 
     // texpages
     glActiveTexture(GL_TEXTURE0);
     glGenTextures(1, &texpages);
     glBindTexture(GL_TEXTURE_2D_ARRAY, texpages);
 
+    glActiveTexture(GL_TEXTURE1);
+    glGenTextures(1, &palette);
+    glBindTexture(GL_TEXTURE_2D, palette);
+
+    // room origins
+    glActiveTexture(GL_TEXTURE2);
+    glGenBuffers(1, &room_origins_buffer);
+    glGenTextures(1, &room_origins);
+    glBindTexture(GL_TEXTURE_BUFFER, room_origins);
+
+    // instances
+    glActiveTexture(GL_TEXTURE3);
+    glGenBuffers(1, &instance_buffer);
+    glGenTextures(1, &instances);
+    glBindTexture(GL_TEXTURE_BUFFER, instances);
+    glActiveTexture(GL_TEXTURE0);
+
     // room
     glGenVertexArrays(1, &room_render_data.vao);
     glBindVertexArray(room_render_data.vao);
     glGenBuffers(1, &room_render_data.vbo);
     glBindBuffer(GL_ARRAY_BUFFER, room_render_data.vbo);
+    glGenBuffers(1, &room_render_data.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, room_render_data.ebo);
+    room_render_data.vbo_size = 0;
+    room_render_data.ebo_size = 0;
     room_render_data.num_objects = 0;
 
     // mesh
@@ -64,6 +109,10 @@ Renderer::Renderer()
     glBindVertexArray(mesh_render_data.vao);
     glGenBuffers(1, &mesh_render_data.vbo);
     glBindBuffer(GL_ARRAY_BUFFER, mesh_render_data.vbo);
+    glGenBuffers(1, &mesh_render_data.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_render_data.ebo);
+    mesh_render_data.vbo_size = 0;
+    mesh_render_data.ebo_size = 0;
     mesh_render_data.num_objects = 0;
 
     // sprite
@@ -71,7 +120,26 @@ Renderer::Renderer()
     glBindVertexArray(sprite_render_data.vao);
     glGenBuffers(1, &sprite_render_data.vbo);
     glBindBuffer(GL_ARRAY_BUFFER, sprite_render_data.vbo);
+    glGenBuffers(1, &sprite_render_data.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sprite_render_data.ebo);
+    sprite_render_data.vbo_size = 0;
+    sprite_render_data.ebo_size = 0;
     sprite_render_data.num_objects = 0;
+
+    // indirect draws
+    has_indirect_draws = SupportsIndirectDraws();
+    if (has_indirect_draws) {
+        mesh_internal_indirect_shader.reset(new MeshInternalIndirectShader());
+        mesh_external_indirect_shader.reset(new MeshExternalIndirectShader());
+        sprite_indirect_shader.reset(new SpriteIndirectShader());
+        glGenVertexArrays(1, &indirect_mesh_vao);
+        glGenVertexArrays(1, &indirect_sprite_vao);
+        glGenBuffers(1, &draw_command_buffer);
+        glGenBuffers(1, &draw_data_buffer);
+        glGenBuffers(1, &draw_index_buffer);
+        glGenBuffers(1, &room_lighting_buffer);
+    }
+    indirect_draws = has_indirect_draws;
 }
 
 Renderer::~Renderer()
@@ -81,25 +149,34 @@ Renderer::~Renderer()
 
 void Renderer::RegisterLevel(const tr::level& level)
 {
+    this->level = &level;
+
     InitRoomLightingUniformBuffers(level);
 
     InitTexPages(level);
 
+    InitRoomOrigins(level);
+
     // room render data
+    room_animated_polygons.assign(level.rooms.size(), std::vector<AnimatedPolygon>());
     std::vector<const tr::mesh*> rooms;
     for (const tr::room& room : level.rooms)
         rooms.push_back(&room.geometry);
-    AllocateMeshBuffers(&room_render_data, rooms);
-    for (const tr::mesh* mesh : rooms)
-        UploadMeshData(&room_render_data, mesh);
+    InitMeshBuffers(&room_render_data, rooms);
+    room_vertex_capacity = 0;
+    for (GLsizei num_vertices : room_render_data.num_vertices)
+        room_vertex_capacity += num_vertices;
+    room_index_capacity = 0;
+    for (GLsizei num_indices : room_render_data.num_indices)
+        room_index_capacity += num_indices;
+    room_free_vertices.clear();
+    room_free_indices.clear();
 
     // mesh render data
     std::vector<const tr::mesh*> meshes;
     for (const tr::mesh& mesh : level.meshes)
         meshes.push_back(&mesh);
-    AllocateMeshBuffers(&mesh_render_data, meshes);
-    for (const tr::mesh* mesh : meshes)
-        UploadMeshData(&mesh_render_data, mesh);
+    InitMeshBuffers(&mesh_render_data, meshes);
 
     // sprite render data
     std::vector<const tr::sprite*> sprites;
@@ -108,56 +185,142 @@ void Renderer::RegisterLevel(const tr::level& level)
     AllocateSpriteBuffers(&sprite_render_data, sprites);
     for (const tr::sprite* sprite : sprites)
         UploadSpriteData(&sprite_render_data, sprite);
+
+    if (has_indirect_draws)
+        InitIndirectDraws();
 }
 
 void Renderer::RenderFrame(const Renderer::FrameInfo& frameinfo)
 {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    draw_stats = DrawStats();
+
     glBindBuffer(GL_UNIFORM_BUFFER, transform_ubo);
     glBufferSubData(GL_UNIFORM_BUFFER, 0, 64, glm::value_ptr(frameinfo.projection_matrix));
     glBufferSubData(GL_UNIFORM_BUFFER, 64, 64, glm::value_ptr(frameinfo.view_matrix));
 
     DrawRooms(frameinfo);
 
-    DrawStaticMeshes(frameinfo);
-    DrawModelObjects(frameinfo);
+    if (indirect_draws) {
+        DrawIndirect(frameinfo);
+    } else {
+        DrawStaticMeshes(frameinfo);
+        DrawModelObjects(frameinfo);
+        if (instance_meshes)
+            DrawInstancedMeshes(frameinfo);
+    }
     if (frameinfo.debug_draw_all_meshes)
         DebugDrawAllMeshes();
 
-    DrawStaticSprites(frameinfo);
-    DrawSpriteObjects(frameinfo);
+    if (!indirect_draws) {
+        DrawStaticSprites(frameinfo);
+        DrawSpriteObjects(frameinfo);
+    }
     if (frameinfo.debug_draw_all_sprites)
         DebugDrawAllSprites();
 }
 
 void Renderer::NotifyRoomMeshUpdated(const tr::mesh& mesh)
 {
-    UploadMeshData(&room_render_data, &mesh);
+    UploadRoomData(&mesh);
+}
+
+void Renderer::NotifyRoomLoaded(const tr::room& room)
+{
+    assert(room_render_data.num_vertices.at(room.id) == 0);
+    assert(room_render_data.num_indices.at(room.id) == 0);
+
+    UploadRoomData(&room.geometry);
+
+    UploadRoomLighting(room);
+}
+
+void Renderer::NotifyRoomEvicted(const tr::room& room)
+{
+    if (room_render_data.num_vertices.at(room.id) > 0) {
+        ReturnFreeRange(&room_free_vertices, room_render_data.first_vertex[room.id], room_render_data.num_vertices[room.id]);
+        room_render_data.first_vertex[room.id] = 0;
+        room_render_data.num_vertices[room.id] = 0;
+    }
+    if (room_render_data.num_indices.at(room.id) > 0) {
+        ReturnFreeRange(&room_free_indices, room_render_data.first_index[room.id], room_render_data.num_indices[room.id]);
+        room_render_data.first_index[room.id] = 0;
+        room_render_data.num_indices[room.id] = 0;
+    }
+    room_render_data.parts.at(room.id).clear();
+    room_animated_polygons.at(room.id).clear();
+
+    UploadRoomLighting(room);
 }
 
 // room rendering
 
+void Renderer::MemoryUsage(tr::memory_report* report) const
+{
+    report->add("room_vbo", room_render_data.vbo_size);
+    report->add("room_ebo", room_render_data.ebo_size);
+    report->add("mesh_vbo", mesh_render_data.vbo_size);
+    report->add("mesh_ebo", mesh_render_data.ebo_size);
+    report->add("sprite_vbo", sprite_render_data.vbo_size);
+    report->add("sprite_ebo", sprite_render_data.ebo_size);
+    report->add("texpages", texpages_size);
+    report->add("palette", level ? 256 * 4 : 0);
+    report->add("room_origins", level ? level->rooms.size() * sizeof(glm::vec4) : 0);
+    report->add("instance_buffer", instance_buffer_size);
+    report->add("draw_commands", draw_command_buffer_size);
+    report->add("draw_data", draw_data_buffer_size);
+    report->add("draw_indices", draw_index_capacity * sizeof(GLuint));
+    report->add("room_lighting_buffer", has_indirect_draws ? room_lighting_ubos.size() * ROOM_LIGHTING_BUFFER_SIZE : 0);
+    report->add("room_lighting_ubos", room_lighting_ubos.size() * ROOM_LIGHTING_BUFFER_SIZE);
+    report->add("transform_ubo", TRANSFORM_BUFFER_SIZE);
+}
+
 void Renderer::DrawRooms(const Renderer::FrameInfo& frameinfo)
 {
     glUseProgram(room_shader.program);
     glBindVertexArray(room_render_data.vao);
 
-    std::vector<GLint> first_vertex(frameinfo.rooms.size());
-    std::vector<GLsizei> num_vertices(frameinfo.rooms.size());
-    for (size_t i = 0; i < frameinfo.rooms.size(); ++i) {
-        const tr::room* room = frameinfo.rooms[i];
-        first_vertex[i] = room_render_data.first_vertex.at(room->id);
-        num_vertices[i] = room_render_data.num_vertices.at(room->id);
+    // rooms without geometry (e.g. evicted ones) are left out, some drivers
+    // misplace the base vertices of the draws that follow an empty one
+    std::vector<GLint> first_vertex;
+    std::vector<const void*> first_index;
+    std::vector<GLsizei> num_indices;
+    for (const tr::room* room : frameinfo.rooms) {
+        for (const DrawPart& part : room_render_data.parts.at(room->id)) {
+            if (part.num_indices == 0)
+                continue;
+            first_vertex.push_back(room_render_data.first_vertex[room->id] + part.first_vertex);
+            first_index.push_back((const void*)((room_render_data.first_index[room->id] + part.first_index) * sizeof(GLushort)));
+            num_indices.push_back(part.num_indices);
+        }
     }
 
-    glMultiDrawArrays(GL_TRIANGLES, first_vertex.data(), num_vertices.data(), frameinfo.rooms.size());
+    if (!num_indices.empty())
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, num_indices.data(), GL_UNSIGNED_SHORT,
+                                      first_index.data(), num_indices.size(), first_vertex.data());
+}
+
+void Renderer::DrawElements(const Renderer::RenderData& render_data, GLuint object)
+{
+    for (const DrawPart& part : render_data.parts[object]) {
+        glDrawElementsBaseVertex(GL_TRIANGLES,
+            part.num_indices, GL_UNSIGNED_SHORT,
+            (void*)((render_data.first_index[object] + part.first_index) * sizeof(GLushort)),
+            render_data.first_vertex[object] + part.first_vertex
+        );
+    }
 }
 
 // mesh rendering
 
 void Renderer::DrawStaticMeshes(const Renderer::FrameInfo& frameinfo)
 {
+    // drawn with the rooms, see BuildMeshGeometry(),
+    // or with the model nodes, see DrawInstancedMeshes()
+    if (batch_static_meshes || instance_meshes)
+        return;
+
     glUseProgram(mesh_internal_shader.program);
     glBindVertexArray(mesh_render_data.vao);
 
@@ -166,15 +329,15 @@ void Renderer::DrawStaticMeshes(const Renderer::FrameInfo& frameinfo)
                          room_lighting_ubos.at(room->id));
 
         for (const tr::room_static_mesh& static_mesh : room->static_meshes) {
-            assert(static_mesh.mesh->lightmode == tr::mesh_lightmode_internal);
+            const tr::mesh& mesh = level->get(static_mesh.mesh);
+            assert(mesh.lightmode == tr::mesh_lightmode_internal);
 
             glUniformMatrix4fv(mesh_internal_shader.uniforms.model_matrix,
                                1, GL_FALSE, glm::value_ptr(static_mesh.transform));
             glUniform1f(mesh_internal_shader.uniforms.light_intensity,
                         static_mesh.light_intensity);
-            glDrawArrays(GL_TRIANGLES,
-                         mesh_render_data.first_vertex[static_mesh.mesh->id],
-                         mesh_render_data.num_vertices[static_mesh.mesh->id]);
+            DrawElements(mesh_render_data, mesh.id);
+            ++draw_stats.individual_draws;
         }
     }
 }
@@ -184,33 +347,330 @@ void Renderer::DrawModelObjects(const Renderer::FrameInfo& frameinfo)
     glBindVertexArray(mesh_render_data.vao);
 
     for (const tr::model_object* model_object : frameinfo.model_objects) {
-        glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORMBLOCK_ROOMLIGHTING, room_lighting_ubos.at(model_object->room->id));
-        const tr::model* model = model_object->model;
-        for (unsigned int i = 0; i < model->nodes.size(); ++i) {
-            const tr::mesh* mesh = model->nodes[i].mesh;
+        glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORMBLOCK_ROOMLIGHTING, room_lighting_ubos.at(level->get(model_object->room).id));
+        const tr::model& model = level->get(model_object->model);
+        for (unsigned int i = 0; i < model.nodes.size(); ++i) {
+            const tr::mesh* mesh = &level->get(model.nodes[i].mesh);
             if (mesh->lightmode == tr::mesh_lightmode_internal) {
+                // see DrawInstancedMeshes()
+                if (instance_meshes)
+                    continue;
                 glUseProgram(mesh_internal_shader.program);
                 glUniformMatrix4fv(mesh_internal_shader.uniforms.model_matrix,
                                 1, GL_FALSE, glm::value_ptr(model_object->transform * model_object->node_transforms[i]));
                 glUniform1f(mesh_internal_shader.uniforms.light_intensity,
                             model_object->light_intensity);
-                glDrawArrays(GL_TRIANGLES,
-                    mesh_render_data.first_vertex[mesh->id],
-                    mesh_render_data.num_vertices[mesh->id]
-                );
+                DrawElements(mesh_render_data, mesh->id);
+                ++draw_stats.individual_draws;
             } else {
                 glUseProgram(mesh_external_shader.program);
                 glUniformMatrix4fv(mesh_external_shader.uniforms.model_matrix,
                                 1, GL_FALSE, glm::value_ptr(model_object->transform * model_object->node_transforms[i]));
                 glUniform1f(mesh_external_shader.uniforms.light_intensity,
                             model_object->light_intensity);
-                glDrawArrays(GL_TRIANGLES,
-                    mesh_render_data.first_vertex[mesh->id],
-                    mesh_render_data.num_vertices[mesh->id]
-                );
+                DrawElements(mesh_render_data, mesh->id);
+                ++draw_stats.individual_draws;
+            }
+        }
+    }
+}
+
+// NOTE: the meshes have no room lighting, so externally
+// lit model nodes are still drawn by DrawModelObjects()
+void Renderer::DrawInstancedMeshes(const Renderer::FrameInfo& frameinfo)
+{
+    struct Placement
+    {
+        GLuint mesh;
+        glm::mat4 transform;
+        float light_intensity;
+    };
+
+    std::vector<Placement> placements;
+    if (!batch_static_meshes) {
+        for (const tr::room* room : frameinfo.rooms) {
+            for (const tr::room_static_mesh& static_mesh : room->static_meshes) {
+                const tr::mesh& mesh = level->get(static_mesh.mesh);
+                assert(mesh.lightmode == tr::mesh_lightmode_internal);
+                placements.push_back({ (GLuint)mesh.id, static_mesh.transform, static_mesh.light_intensity });
+            }
+        }
+    }
+    for (const tr::model_object* model_object : frameinfo.model_objects) {
+        const tr::model& model = level->get(model_object->model);
+        for (unsigned int i = 0; i < model.nodes.size(); ++i) {
+            const tr::mesh& mesh = level->get(model.nodes[i].mesh);
+            if (mesh.lightmode != tr::mesh_lightmode_internal)
+                continue;
+            placements.push_back({ (GLuint)mesh.id, model_object->transform * model_object->node_transforms[i],
+                                   model_object->light_intensity });
+        }
+    }
+    if (placements.empty())
+        return;
+
+    // the instances of a mesh are consecutive, see the instanced mesh shader
+    std::vector<GLint> first_instance(mesh_render_data.num_objects + 1, 0);
+    for (const Placement& placement : placements)
+        ++first_instance[placement.mesh + 1];
+    for (GLuint i = 0; i < mesh_render_data.num_objects; ++i)
+        first_instance[i + 1] += first_instance[i];
+
+    std::vector<GLint> next_instance(first_instance.begin(), first_instance.end() - 1);
+    std::vector<glm::vec4> instance_data(placements.size() * 4);
+    for (const Placement& placement : placements) {
+        glm::vec4* instance = &instance_data[next_instance[placement.mesh]++ * 4];
+        for (int row = 0; row < 3; ++row) {
+            const glm::mat4& m = placement.transform;
+            instance[row] = glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+        }
+        instance[3] = glm::vec4(placement.light_intensity, 0.0f, 0.0f, 0.0f);
+    }
+
+    size_t size = instance_data.size() * sizeof(glm::vec4);
+    glBindBuffer(GL_TEXTURE_BUFFER, instance_buffer);
+    if (size > instance_buffer_size) {
+        glBufferData(GL_TEXTURE_BUFFER, size, instance_data.data(), GL_STREAM_DRAW);
+        instance_buffer_size = size;
+
+        glActiveTexture(GL_TEXTURE3);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, instance_buffer);
+        glActiveTexture(GL_TEXTURE0);
+    } else {
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, instance_data.data());
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glUseProgram(mesh_instanced_shader.program);
+    glBindVertexArray(mesh_render_data.vao);
+
+    for (GLuint mesh = 0; mesh < mesh_render_data.num_objects; ++mesh) {
+        GLsizei num_instances = first_instance[mesh + 1] - first_instance[mesh];
+        if (num_instances == 0)
+            continue;
+
+        glUniform1i(mesh_instanced_shader.uniforms.first_instance, first_instance[mesh]);
+        for (const DrawPart& part : mesh_render_data.parts[mesh]) {
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES,
+                part.num_indices, GL_UNSIGNED_SHORT,
+                (void*)((mesh_render_data.first_index[mesh] + part.first_index) * sizeof(GLushort)),
+                num_instances, mesh_render_data.first_vertex[mesh] + part.first_vertex
+            );
+        }
+        ++draw_stats.instanced_draws;
+        draw_stats.instances += num_instances;
+    }
+}
+
+// indirect draws
+
+// GL 4.3 has glMultiDrawElementsIndirect() and shader storage buffers
+static bool SupportsIndirectDraws()
+{
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    return major > 4 || (major == 4 && minor >= 3);
+}
+
+// see glMultiDrawElementsIndirect()
+struct DrawCommand
+{
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+};
+
+// NOTE: std430 layout, see the indirect shaders
+struct DrawData
+{
+    glm::mat4 model_matrix;
+    GLfloat light_intensity;
+    GLint lighting_block;
+    GLfloat padding[2];
+};
+
+static_assert(sizeof(DrawData) == 80, "DrawData doesn't match the shaders");
+
+void Renderer::InitIndirectDraws()
+{
+    // the indirect vaos share the vertex and index buffers
+    SetMeshVertexAttribs(indirect_mesh_vao, mesh_render_data.vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh_render_data.ebo);
+    SetSpriteVertexAttribs(indirect_sprite_vao, sprite_render_data.vbo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sprite_render_data.ebo);
+
+    // a draw index per instance, the base instance
+    // of the command selects the draw index
+    GLuint vaos[] = { indirect_mesh_vao, indirect_sprite_vao };
+    for (GLuint vao : vaos) {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, draw_index_buffer);
+        glVertexAttribIPointer(ATTRIB_DRAWINDEX, 1, GL_UNSIGNED_INT, sizeof(GLuint), nullptr);
+        glEnableVertexAttribArray(ATTRIB_DRAWINDEX);
+        glVertexAttribDivisor(ATTRIB_DRAWINDEX, 1);
+    }
+}
+
+// grows the buffer if the data doesn't fit
+static void UploadStreamBuffer(GLenum target, GLuint buffer, size_t* buffer_size, const void* data, size_t size)
+{
+    glBindBuffer(target, buffer);
+    if (size > *buffer_size) {
+        glBufferData(target, size, data, GL_STREAM_DRAW);
+        *buffer_size = size;
+    } else {
+        glBufferSubData(target, 0, size, data);
+    }
+}
+
+// the commands of each shader are consecutive, each
+// shader is drawn with one glMultiDrawElementsIndirect()
+void Renderer::DrawIndirect(const Renderer::FrameInfo& frameinfo)
+{
+    std::vector<DrawCommand> commands;
+    std::vector<DrawData> draw_data;
+    // the instances of a command use consecutive draw data, from
+    // the one that is added next; the parts of an object share it
+    auto add_commands = [&](const RenderData& render_data, GLuint object, GLuint num_instances) {
+        for (const DrawPart& part : render_data.parts[object]) {
+            DrawCommand command;
+            command.count = part.num_indices;
+            command.instance_count = num_instances;
+            command.first_index = render_data.first_index[object] + part.first_index;
+            command.base_vertex = render_data.first_vertex[object] + part.first_vertex;
+            command.base_instance = draw_data.size();
+            commands.push_back(command);
+        }
+    };
+    auto make_data = [](const glm::mat4& model_matrix, float light_intensity, GLint lighting_block) {
+        DrawData data;
+        data.model_matrix = model_matrix;
+        data.light_intensity = light_intensity;
+        data.lighting_block = lighting_block;
+        return data;
+    };
+    auto add_draw = [&](const RenderData& render_data, GLuint object,
+                        const glm::mat4& model_matrix, float light_intensity, GLint lighting_block) {
+        add_commands(render_data, object, 1);
+        draw_data.push_back(make_data(model_matrix, light_intensity, lighting_block));
+    };
+
+    // internally lit meshes, the static meshes may be drawn with the rooms
+    std::vector<std::pair<GLuint, DrawData>> internal_draws;
+    if (!batch_static_meshes) {
+        for (const tr::room* room : frameinfo.rooms) {
+            for (const tr::room_static_mesh& static_mesh : room->static_meshes) {
+                const tr::mesh& mesh = level->get(static_mesh.mesh);
+                assert(mesh.lightmode == tr::mesh_lightmode_internal);
+                internal_draws.push_back(std::make_pair((GLuint)mesh.id,
+                    make_data(static_mesh.transform, static_mesh.light_intensity, room->id)));
             }
         }
     }
+    for (const tr::model_object* model_object : frameinfo.model_objects) {
+        const tr::model& model = level->get(model_object->model);
+        for (unsigned int i = 0; i < model.nodes.size(); ++i) {
+            const tr::mesh& mesh = level->get(model.nodes[i].mesh);
+            if (mesh.lightmode == tr::mesh_lightmode_internal) {
+                internal_draws.push_back(std::make_pair((GLuint)mesh.id,
+                    make_data(model_object->transform * model_object->node_transforms[i],
+                              model_object->light_intensity, level->get(model_object->room).id)));
+            }
+        }
+    }
+    if (instance_meshes) {
+        // one instanced command per mesh, see DrawInstancedMeshes()
+        std::stable_sort(internal_draws.begin(), internal_draws.end(),
+            [](const std::pair<GLuint, DrawData>& a, const std::pair<GLuint, DrawData>& b) { return a.first < b.first; });
+        for (size_t first = 0, last = 0; first < internal_draws.size(); first = last) {
+            GLuint mesh = internal_draws[first].first;
+            while (last < internal_draws.size() && internal_draws[last].first == mesh)
+                ++last;
+            add_commands(mesh_render_data, mesh, last - first);
+            for (size_t i = first; i < last; ++i)
+                draw_data.push_back(internal_draws[i].second);
+            ++draw_stats.instanced_draws;
+            draw_stats.instances += last - first;
+        }
+    } else {
+        for (const std::pair<GLuint, DrawData>& draw : internal_draws) {
+            add_commands(mesh_render_data, draw.first, 1);
+            draw_data.push_back(draw.second);
+        }
+    }
+    size_t num_internal = commands.size();
+
+    // externally lit meshes
+    for (const tr::model_object* model_object : frameinfo.model_objects) {
+        const tr::model& model = level->get(model_object->model);
+        for (unsigned int i = 0; i < model.nodes.size(); ++i) {
+            const tr::mesh& mesh = level->get(model.nodes[i].mesh);
+            if (mesh.lightmode != tr::mesh_lightmode_internal)
+                add_draw(mesh_render_data, mesh.id, model_object->transform * model_object->node_transforms[i],
+                         model_object->light_intensity, level->get(model_object->room).id);
+        }
+    }
+    size_t num_external = commands.size() - num_internal;
+
+    // sprites
+    for (const tr::room* room : frameinfo.rooms) {
+        for (const tr::room_static_sprite& static_sprite : room->static_sprites) {
+            add_draw(sprite_render_data, level->get(static_sprite.sprite).id,
+                     glm::translate(glm::mat4(), static_sprite.position), static_sprite.light_intensity, room->id);
+        }
+    }
+    for (const tr::sprite_object* sprite_object : frameinfo.sprite_objects) {
+        const tr::sprite_sequence& sequence = level->get(sprite_object->sequence);
+        const tr::sprite& sprite = level->get(sequence.sprites.at(sprite_object->frame));
+        add_draw(sprite_render_data, sprite.id,
+                 glm::translate(glm::mat4(), sprite_object->position), sprite_object->light_intensity, 0);
+    }
+    size_t num_sprites = commands.size() - num_internal - num_external;
+
+    if (commands.empty())
+        return;
+
+    if ((GLsizei)draw_data.size() > draw_index_capacity) {
+        draw_index_capacity = std::max<GLsizei>(draw_data.size(), draw_index_capacity * 2);
+        std::vector<GLuint> draw_indices(draw_index_capacity);
+        for (GLsizei i = 0; i < draw_index_capacity; ++i)
+            draw_indices[i] = i;
+        glBindBuffer(GL_ARRAY_BUFFER, draw_index_buffer);
+        glBufferData(GL_ARRAY_BUFFER, draw_indices.size() * sizeof(GLuint), draw_indices.data(), GL_STATIC_DRAW);
+    }
+    UploadStreamBuffer(GL_DRAW_INDIRECT_BUFFER, draw_command_buffer, &draw_command_buffer_size,
+                       commands.data(), commands.size() * sizeof(DrawCommand));
+    UploadStreamBuffer(GL_SHADER_STORAGE_BUFFER, draw_data_buffer, &draw_data_buffer_size,
+                       draw_data.data(), draw_data.size() * sizeof(DrawData));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGEBLOCK_DRAWDATA, draw_data_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STORAGEBLOCK_ROOMLIGHTING, room_lighting_buffer);
+
+    glBindVertexArray(indirect_mesh_vao);
+    if (num_internal > 0) {
+        glUseProgram(mesh_internal_indirect_shader->program);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT,
+                                    (void*)0, num_internal, 0);
+        ++draw_stats.indirect_multi_draws;
+    }
+    if (num_external > 0) {
+        glUseProgram(mesh_external_indirect_shader->program);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT,
+                                    (void*)(num_internal * sizeof(DrawCommand)), num_external, 0);
+        ++draw_stats.indirect_multi_draws;
+    }
+
+    glBindVertexArray(indirect_sprite_vao);
+    if (num_sprites > 0) {
+        glUseProgram(sprite_indirect_shader->program);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT,
+                                    (void*)((num_internal + num_external) * sizeof(DrawCommand)), num_sprites, 0);
+        ++draw_stats.indirect_multi_draws;
+    }
+
+    draw_stats.indirect_draws += commands.size();
 }
 
 void Renderer::DebugDrawAllMeshes()
@@ -224,7 +684,7 @@ void Renderer::DebugDrawAllMeshes()
                             1, GL_FALSE, glm::value_ptr(model_matrix));
         glUniform1f(mesh_constant_shader.uniforms.light_intensity,
                     1.0f);
-        glDrawArrays(GL_TRIANGLES, mesh_render_data.first_vertex[i], mesh_render_data.num_vertices[i]);
+        DrawElements(mesh_render_data, i);
     }
 }
 
@@ -242,9 +702,7 @@ void Renderer::DrawStaticSprites(const Renderer::FrameInfo& frameinfo)
                          1, glm::value_ptr(position));
             glUniform1f(sprite_shader.uniforms.sprite_light_intensity,
                         static_sprite.light_intensity);
-            glDrawArrays(GL_TRIANGLE_FAN,
-                         sprite_render_data.first_vertex[static_sprite.sprite->id],
-                         sprite_render_data.num_vertices[static_sprite.sprite->id]);
+            DrawElements(sprite_render_data, level->get(static_sprite.sprite).id);
         }
     }
 }
@@ -260,10 +718,9 @@ void Renderer::DrawSpriteObjects(const Renderer::FrameInfo& frameinfo)
                      1, glm::value_ptr(position));
         glUniform1f(sprite_shader.uniforms.sprite_light_intensity,
                     sprite_object->light_intensity);
-        glDrawArrays(GL_TRIANGLE_FAN,
-            sprite_render_data.first_vertex[sprite_object->sequence->sprites.at(sprite_object->frame)->id],
-            sprite_render_data.num_vertices[sprite_object->sequence->sprites.at(sprite_object->frame)->id]
-        );
+        const tr::sprite_sequence& sequence = level->get(sprite_object->sequence);
+        const tr::sprite& sprite = level->get(sequence.sprites.at(sprite_object->frame));
+        DrawElements(sprite_render_data, sprite.id);
     }
 }
 
@@ -278,9 +735,7 @@ void Renderer::DebugDrawAllSprites()
                      1, glm::value_ptr(position));
         glUniform1f(sprite_shader.uniforms.sprite_light_intensity,
                     1.0f);
-        glDrawArrays(GL_TRIANGLE_FAN,
-                        sprite_render_data.first_vertex[i],
-                        sprite_render_data.num_vertices[i]);
+        DrawElements(sprite_render_data, i);
     }
 }
 
@@ -288,11 +743,26 @@ void Renderer::DebugDrawAllSprites()
 
 void Renderer::InitRoomLightingUniformBuffers(const tr::level& level)
 {
-    // NOTE: room lighting buffers use std140 layout,
-    // see shader source code for details
+    if (!room_lighting_ubos.empty()) {
+        glDeleteBuffers(room_lighting_ubos.size(), room_lighting_ubos.data());
+        room_lighting_ubos.clear();
+    }
+    room_lighting_ubos.resize(level.rooms.size());
+    glGenBuffers(room_lighting_ubos.size(), room_lighting_ubos.data());
 
-    static const int ROOM_LIGHTING_BUFFER_SIZE = 272;
+    // the indirect draws read a copy of all of them
+    if (has_indirect_draws) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, room_lighting_buffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, level.rooms.size() * ROOM_LIGHTING_BUFFER_SIZE, nullptr, GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
 
+    for (const tr::room& room : level.rooms)
+        UploadRoomLighting(room);
+}
+
+void Renderer::UploadRoomLighting(const tr::room& room)
+{
     static const int AMBIENT_LIGHT_INTENSITY_OFFSET = 0;
     static const int NUM_LIGHTS_OFFSET = 4;
     static const int LIGHTS_OFFSET = 16;
@@ -302,46 +772,43 @@ void Renderer::InitRoomLightingUniformBuffers(const tr::level& level)
     static const int LIGHT_INTENSITY_OFFSET = 16;
     static const int LIGHT_FALLOFF_OFFSET = 20;
 
-    if (!room_lighting_ubos.empty()) {
-        glDeleteBuffers(room_lighting_ubos.size(), room_lighting_ubos.data());
-        room_lighting_ubos.clear();
-    }
-    room_lighting_ubos.resize(level.rooms.size());
-    glGenBuffers(room_lighting_ubos.size(), room_lighting_ubos.data());
+    assert(room.lights.size() <= 8);
 
-    for (size_t i = 0; i < level.rooms.size(); ++i) {
-        const tr::room& room = level.rooms[i];
-        assert(room.lights.size() <= 8);
+    glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORMBLOCK_ROOMLIGHTING, room_lighting_ubos.at(room.id));
+    glBufferData(GL_UNIFORM_BUFFER, ROOM_LIGHTING_BUFFER_SIZE, nullptr, GL_STATIC_DRAW);
 
-        glBindBufferBase(GL_UNIFORM_BUFFER, UNIFORMBLOCK_ROOMLIGHTING, room_lighting_ubos[i]);
-        glBufferData(GL_UNIFORM_BUFFER, ROOM_LIGHTING_BUFFER_SIZE, nullptr, GL_STATIC_DRAW);
+    char* base_ptr = (char*)glMapBuffer(GL_UNIFORM_BUFFER, GL_WRITE_ONLY);
 
-        char* base_ptr = (char*)glMapBuffer(GL_UNIFORM_BUFFER, GL_WRITE_ONLY);
+    GLfloat* ambient_light_intensity_ptr = (GLfloat*)(base_ptr + AMBIENT_LIGHT_INTENSITY_OFFSET);
+    *ambient_light_intensity_ptr = room.ambient_light_intensity;
 
-        GLfloat* ambient_light_intensity_ptr = (GLfloat*)(base_ptr + AMBIENT_LIGHT_INTENSITY_OFFSET);
-        *ambient_light_intensity_ptr = room.ambient_light_intensity;
+    GLint* num_lights_ptr = (GLint*)(base_ptr + NUM_LIGHTS_OFFSET);
+    *num_lights_ptr = room.lights.size();
 
-        GLint* num_lights_ptr = (GLint*)(base_ptr + NUM_LIGHTS_OFFSET);
-        *num_lights_ptr = room.lights.size();
+    for (size_t j = 0; j < room.lights.size(); ++j) {
+        const tr::room_light& light = room.lights[j];
 
-        for (size_t j = 0; j < room.lights.size(); ++j) {
-            const tr::room_light& light = room.lights[j];
+        char* light_base_ptr = base_ptr + LIGHTS_OFFSET + j * LIGHT_SIZE;
 
-            char* light_base_ptr = base_ptr + LIGHTS_OFFSET + j * LIGHT_SIZE;
+        GLfloat* light_position_ptr = (GLfloat*)(light_base_ptr + LIGHT_POSITION_OFFSET);
+        light_position_ptr[0] = light.position.x;
+        light_position_ptr[1] = light.position.y;
+        light_position_ptr[2] = light.position.z;
 
-            GLfloat* light_position_ptr = (GLfloat*)(light_base_ptr + LIGHT_POSITION_OFFSET);
-            light_position_ptr[0] = light.position.x;
-            light_position_ptr[1] = light.position.y;
-            light_position_ptr[2] = light.position.z;
+        GLfloat* light_intensity_ptr = (GLfloat*)(light_base_ptr + LIGHT_INTENSITY_OFFSET);
+        *light_intensity_ptr = light.intensity;
 
-            GLfloat* light_intensity_ptr = (GLfloat*)(light_base_ptr + LIGHT_INTENSITY_OFFSET);
-            *light_intensity_ptr = light.intensity;
+        GLfloat* light_falloff_ptr = (GLfloat*)(light_base_ptr + LIGHT_FALLOFF_OFFSET);
+        *light_falloff_ptr = light.falloff;
+    }
 
-            GLfloat* light_falloff_ptr = (GLfloat*)(light_base_ptr + LIGHT_FALLOFF_OFFSET);
-            *light_falloff_ptr = light.falloff;
-        }
+    glUnmapBuffer(GL_UNIFORM_BUFFER);
 
-        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    // NOTE: the std430 layout of the copy is the same
+    if (has_indirect_draws) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, room_lighting_buffer);
+        glCopyBufferSubData(GL_UNIFORM_BUFFER, GL_COPY_WRITE_BUFFER,
+                            0, room.id * ROOM_LIGHTING_BUFFER_SIZE, ROOM_LIGHTING_BUFFER_SIZE);
     }
 
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
@@ -351,102 +818,611 @@ void Renderer::InitRoomLightingUniformBuffers(const tr::level& level)
 
 void Renderer::InitTexPages(const tr::level& level)
 {
+    if (texpage_format == TEXPAGE_FORMAT_RGB5_A1 && level.texpages16.empty()) {
+        fprintf(stderr, "[WARNING] Renderer::InitTexPages(): level has no 16-bit texpages\n");
+        texpage_format = TEXPAGE_FORMAT_INDEXED;
+    }
+
+    std::vector<GLuint> programs = {
+        room_shader.program,
+        mesh_constant_shader.program, mesh_internal_shader.program, mesh_external_shader.program,
+        mesh_instanced_shader.program, sprite_shader.program
+    };
+    if (has_indirect_draws) {
+        programs.push_back(mesh_internal_indirect_shader->program);
+        programs.push_back(mesh_external_indirect_shader->program);
+        programs.push_back(sprite_indirect_shader->program);
+    }
+    for (GLuint program : programs) {
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "IndexedTexPages"), texpage_format == TEXPAGE_FORMAT_INDEXED);
+    }
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, palette);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 256, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, level.palette.colors);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D_ARRAY, texpages);
 
-    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA,
-        256, 256, level.texpages.size(), 0,
-        GL_RGBA, GL_UNSIGNED_BYTE, nullptr
-    );
+    if (texpage_format == TEXPAGE_FORMAT_RGB5_A1) {
+        // argb1555 is GL_UNSIGNED_SHORT_1_5_5_5_REV in bgra order,
+        // so the pages are uploaded as they are
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB5_A1,
+            256, 256, level.texpages16.size(), 0,
+            GL_BGRA, GL_UNSIGNED_SHORT_1_5_5_5_REV, nullptr
+        );
+
+        texpages_size = level.texpages16.size() * 256 * 256 * 2;
+        for (size_t i = 0; i < level.texpages16.size(); ++i)
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0,
+                0, 0, i, 256, 256, 1,
+                GL_BGRA, GL_UNSIGNED_SHORT_1_5_5_5_REV, level.texpages16[i].pixels
+            );
+    } else if (texpage_format == TEXPAGE_FORMAT_RGBA8) {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8,
+            256, 256, level.texpages.size(), 0,
+            GL_RGBA, GL_UNSIGNED_BYTE, nullptr
+        );
 
-    for (size_t i = 0; i < level.texpages.size(); ++i)
-        glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0,
-            0, 0, i, 256, 256, 1,
-            GL_RGBA, GL_UNSIGNED_BYTE, level.texpages[i].pixels
+        texpages_size = level.texpages.size() * 256 * 256 * 4;
+        std::vector<uchar> expanded(256 * 256 * 4);
+        for (size_t i = 0; i < level.texpages.size(); ++i) {
+            tr::expand_palette(level.texpages[i].pixels[0], 256 * 256, level.palette.colors, (uchar (*)[4])expanded.data());
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0,
+                0, 0, i, 256, 256, 1,
+                GL_RGBA, GL_UNSIGNED_BYTE, expanded.data()
+            );
+        }
+    } else {
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8,
+            256, 256, level.texpages.size(), 0,
+            GL_RED, GL_UNSIGNED_BYTE, nullptr
         );
 
+        texpages_size = level.texpages.size() * 256 * 256;
+        for (size_t i = 0; i < level.texpages.size(); ++i)
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0,
+                0, 0, i, 256, 256, 1,
+                GL_RED, GL_UNSIGNED_BYTE, level.texpages[i].pixels
+            );
+    }
+
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 }
 
+// room origins
+
+// room geometry is uploaded relative to it, so that it fits into 16 bits
+static glm::vec3 RoomOrigin(const tr::room& room)
+{
+    return glm::floor((room.aabb[0] + room.aabb[1]) * 0.5f);
+}
+
+void Renderer::InitRoomOrigins(const tr::level& level)
+{
+    std::vector<glm::vec4> origins;
+    for (const tr::room& room : level.rooms)
+        origins.push_back(glm::vec4(RoomOrigin(room), 0.0f));
+
+    glBindBuffer(GL_TEXTURE_BUFFER, room_origins_buffer);
+    glBufferData(GL_TEXTURE_BUFFER, origins.size() * sizeof(glm::vec4), origins.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_BUFFER, room_origins);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, room_origins_buffer);
+    glActiveTexture(GL_TEXTURE0);
+}
+
 // mesh data
 
+// NOTE: quantized to the precision of the level data,
+// see the mesh shaders for how it's unpacked
 struct MeshVertex
 {
-    float position[3];
-    float texcoord[2];
-    float lightattrib[3];
-    uint16_t texpage;
-    uint16_t texalphamode;
+    // relative to the room origin for room geometry
+    int16_t position[3];
+    // texpage, alpha mode in the top two bits
+    uint16_t texattrib;
+    // in 1/65536ths, so the texel centers are exact
+    uint16_t texcoord[2];
+    // snorm8 normal for externally lit meshes, otherwise
+    // unorm16 intensity followed by the room index; rooms store
+    // half of it, baked static meshes can be brighter than 1
+    uchar lightattrib[4];
 };
 
-void Renderer::AllocateMeshBuffers(Renderer::RenderData* render_data, const std::vector<const tr::mesh*>& meshes)
+static_assert(sizeof(MeshVertex) == 16, "MeshVertex isn't packed");
+
+static const int TEXATTRIB_ALPHAMODE_SHIFT = 14;
+
+// returns false if the value was clamped
+static bool QuantizePosition(float value, int16_t* result)
+{
+    float rounded = glm::round(value);
+    float clamped = glm::clamp(rounded, -32768.0f, 32767.0f);
+    *result = (int16_t)clamped;
+    return clamped == rounded;
+}
+
+static uint16_t QuantizeTexCoord(float value)
+{
+    return (uint16_t)glm::clamp(glm::round(value * 65536.0f), 0.0f, 65535.0f);
+}
+
+static void PackNormal(const glm::vec3& normal, uchar result[4])
+{
+    // some normals are zero, they stay zero
+    float length = glm::length(normal);
+    glm::vec3 scaled = (length > 0.0f) ? glm::round(normal / length * 127.0f) : glm::vec3(0.0f);
+    int8_t packed[4] = { (int8_t)scaled.x, (int8_t)scaled.y, (int8_t)scaled.z, 0 };
+    memcpy(result, packed, 4);
+}
+
+static void PackIntensity(float intensity, uint16_t room, uchar result[4])
+{
+    uint16_t packed[2] = { (uint16_t)glm::round(glm::clamp(intensity, 0.0f, 1.0f) * 65535.0f), room };
+    memcpy(result, packed, 4);
+}
+
+static void SetCornerTexture(MeshVertex* vertex, const tr::texinfo& texinfo, int corner)
+{
+    assert(texinfo.texpage < (1 << TEXATTRIB_ALPHAMODE_SHIFT));
+    vertex->texattrib = texinfo.texpage | (texinfo.texalphamode << TEXATTRIB_ALPHAMODE_SHIFT);
+    vertex->texcoord[0] = QuantizeTexCoord(texinfo.texcoord[corner][0]);
+    vertex->texcoord[1] = QuantizeTexCoord(texinfo.texcoord[corner][1]);
+}
+
+// vertices are shared by the polygons whose corners match in all of their
+// attributes; corners of animated polygons are only shared with polygons of
+// the same texinfo, so that AnimateTextures() doesn't change the others
+struct VertexKey
+{
+    MeshVertex vertex;
+    uint32_t animated_texinfo;
+};
+
+static_assert(sizeof(VertexKey) == 20, "VertexKey isn't packed");
+
+static bool operator==(const VertexKey& a, const VertexKey& b)
+{
+    return memcmp(&a, &b, sizeof(VertexKey)) == 0;
+}
+
+struct VertexKeyHash
+{
+    size_t operator()(const VertexKey& key) const { return tr::hash64(&key, sizeof(key)); }
+};
+
+struct Renderer::MeshGeometry
+{
+    std::vector<MeshVertex> vertices;
+    // polygons are drawn as triangles, quads as (0, 1, 2) and (0, 2, 3)
+    std::vector<GLushort> indices;
+    std::vector<DrawPart> parts;
+    std::vector<AnimatedPolygon> animated_polygons;
+
+    // vertices are only shared within a part
+    std::unordered_map<VertexKey, GLuint, VertexKeyHash> vertex_indices;
+};
+
+void Renderer::BuildMeshGeometry(const tr::mesh& mesh, bool is_room, Renderer::MeshGeometry* geometry, Renderer::GeometryStats* stats) const
+{
+    geometry->vertices.clear();
+    geometry->indices.clear();
+    geometry->parts.assign(1, DrawPart());
+    geometry->animated_polygons.clear();
+    geometry->vertex_indices.clear();
+
+    if (is_room) {
+        const tr::room& room = level->rooms.at(mesh.id);
+        glm::vec3 origin = RoomOrigin(room);
+        AppendMeshGeometry(mesh, glm::mat4(), origin, 0.5f, room.id, true, geometry);
+        if (batch_static_meshes) {
+            for (const tr::room_static_mesh& static_mesh : room.static_meshes) {
+                const tr::mesh& static_geometry = level->get(static_mesh.mesh);
+                assert(static_geometry.lightmode == tr::mesh_lightmode_internal);
+                AppendMeshGeometry(static_geometry, static_mesh.transform, origin,
+                                   static_mesh.light_intensity, room.id, false, geometry);
+            }
+        }
+    } else {
+        AppendMeshGeometry(mesh, glm::mat4(), glm::vec3(0.0f), 1.0f, 0, false, geometry);
+    }
+
+    OptimizeMeshGeometry(geometry, stats);
+}
+
+// the mesh is transformed and made relative to the origin, the intensities
+// of internally lit vertices are scaled, see MeshVertex
+void Renderer::AppendMeshGeometry(const tr::mesh& mesh, const glm::mat4& transform, glm::vec3 origin,
+                                  float intensity_scale, uint16_t room, bool animate, Renderer::MeshGeometry* geometry) const
+{
+    // the per-vertex part is quantized once, the polygon corners copy it
+    std::vector<MeshVertex> verts(mesh.num_verts());
+    bool clamped = false;
+    for (size_t v = 0; v < mesh.num_verts(); ++v) {
+        glm::vec3 position = glm::vec3(transform * glm::vec4(mesh.positions[v], 1.0f)) - origin;
+        for (int j = 0; j < 3; ++j)
+            clamped |= !QuantizePosition(position[j], &verts[v].position[j]);
+        if (mesh.lightmode == tr::mesh_lightmode_external)
+            PackNormal(mesh.lightattribs[v], verts[v].lightattrib);
+        else
+            PackIntensity(mesh.lightattribs[v].x * intensity_scale, room, verts[v].lightattrib);
+    }
+    if (clamped)
+        fprintf(stderr, "[WARNING] Renderer::AppendMeshGeometry(): mesh %lu doesn't fit into 16 bits\n", mesh.id);
+
+    for (size_t p = 0; p < mesh.num_polys(); ++p) {
+        const ushort* poly_verts = mesh.poly_verts[p].verts;
+        const tr::texinfo& texinfo = level->get(mesh.poly_texinfos[p]);
+        bool is_animated = animate && texinfo.texanimchain.valid();
+        int num_corners = (poly_verts[3] == (ushort)-1) ? 3 : 4;
+
+        // start a new part before the indices overflow
+        if (geometry->parts.back().num_vertices + num_corners > 0x10000) {
+            DrawPart part;
+            part.first_vertex = geometry->vertices.size();
+            part.num_vertices = 0;
+            part.first_index = geometry->indices.size();
+            part.num_indices = 0;
+            geometry->parts.push_back(part);
+            geometry->vertex_indices.clear();
+        }
+        DrawPart& part = geometry->parts.back();
+
+        GLuint corners[4];
+        for (int c = 0; c < num_corners; ++c) {
+            VertexKey key;
+            key.vertex = verts.at(poly_verts[c]);
+            SetCornerTexture(&key.vertex, texinfo, c);
+            key.animated_texinfo = is_animated ? mesh.poly_texinfos[p].index : tr::handle<tr::texinfo>::NONE;
+
+            auto it = geometry->vertex_indices.find(key);
+            if (it == geometry->vertex_indices.end()) {
+                it = geometry->vertex_indices.insert(std::make_pair(key, (GLuint)geometry->vertices.size())).first;
+                geometry->vertices.push_back(key.vertex);
+                ++part.num_vertices;
+            }
+            corners[c] = it->second;
+        }
+
+        for (int i = 2; i < num_corners; ++i) {
+            geometry->indices.push_back(corners[0] - part.first_vertex);
+            geometry->indices.push_back(corners[i-1] - part.first_vertex);
+            geometry->indices.push_back(corners[i] - part.first_vertex);
+            part.num_indices += 3;
+        }
+
+        if (is_animated) {
+            AnimatedPolygon polygon;
+            polygon.texinfo = mesh.poly_texinfos[p];
+            std::copy(corners, corners + 4, polygon.vertices);
+            polygon.num_corners = num_corners;
+            geometry->animated_polygons.push_back(polygon);
+        }
+    }
+}
+
+// static geometry is drawn in the order of tr_meshopt.h, each
+// part is optimized on its own and keeps its vertices
+void Renderer::OptimizeMeshGeometry(Renderer::MeshGeometry* geometry, Renderer::GeometryStats* stats)
+{
+    std::vector<GLuint> remap(geometry->vertices.size());
+    std::vector<MeshVertex> vertices(geometry->vertices.size());
+
+    for (const DrawPart& part : geometry->parts) {
+        GLushort* indices = geometry->indices.data() + part.first_index;
+        size_t num_indices = part.num_indices;
+        size_t num_vertices = part.num_vertices;
+
+        std::vector<glm::vec3> positions(num_vertices);
+        for (size_t v = 0; v < num_vertices; ++v) {
+            const int16_t* position = geometry->vertices[part.first_vertex + v].position;
+            positions[v] = glm::vec3(position[0], position[1], position[2]);
+        }
+
+        long shaded, covered;
+        if (stats) {
+            stats->num_triangles += num_indices / 3;
+            stats->cache_misses_before += tr::count_cache_misses(indices, num_indices, num_vertices);
+            tr::measure_overdraw(indices, num_indices, positions.data(), &shaded, &covered);
+            stats->shaded_before += shaded;
+            stats->covered += covered;
+        }
+
+        std::vector<size_t> clusters;
+        tr::optimize_vertex_cache(indices, num_indices, num_vertices, &clusters);
+        tr::optimize_overdraw(indices, num_indices, positions.data(), clusters);
+
+        std::vector<GLushort> part_remap;
+        tr::optimize_vertex_fetch(indices, num_indices, num_vertices, &part_remap);
+        std::vector<glm::vec3> remapped_positions(num_vertices);
+        for (size_t v = 0; v < num_vertices; ++v) {
+            remap[part.first_vertex + v] = part.first_vertex + part_remap[v];
+            vertices[part.first_vertex + part_remap[v]] = geometry->vertices[part.first_vertex + v];
+            remapped_positions[part_remap[v]] = positions[v];
+        }
+
+        if (stats) {
+            stats->cache_misses_after += tr::count_cache_misses(indices, num_indices, num_vertices);
+            tr::measure_overdraw(indices, num_indices, remapped_positions.data(), &shaded, &covered);
+            stats->shaded_after += shaded;
+        }
+    }
+
+    geometry->vertices.swap(vertices);
+    for (AnimatedPolygon& polygon : geometry->animated_polygons) {
+        for (int c = 0; c < polygon.num_corners; ++c)
+            polygon.vertices[c] = remap[polygon.vertices[c]];
+    }
+}
+
+void Renderer::InitMeshBuffers(Renderer::RenderData* render_data, const std::vector<const tr::mesh*>& meshes)
 {
     render_data->first_vertex.clear();
     render_data->num_vertices.clear();
+    render_data->first_index.clear();
+    render_data->num_indices.clear();
+    render_data->parts.clear();
     render_data->num_objects = meshes.size();
 
-    long total_num_vertices = 0;
+    bool is_room = (render_data == &room_render_data);
+    GeometryStats* stats = is_room ? &room_geometry_stats : &mesh_geometry_stats;
+    *stats = GeometryStats();
+    if (!measure_triangle_order)
+        stats = nullptr;
+    std::vector<MeshVertex> vertices;
+    std::vector<GLushort> indices;
+    MeshGeometry geometry;
     for (const tr::mesh* mesh : meshes) {
-        long num_vertices = 0;
-        for (const tr::mesh_poly& poly: mesh->polys)
-            num_vertices += (poly.verts[3] == (ushort)-1) ? 3 : 6;
-        render_data->first_vertex.push_back(total_num_vertices);
-        render_data->num_vertices.push_back(num_vertices);
-        total_num_vertices += num_vertices;
+        BuildMeshGeometry(*mesh, is_room, &geometry, stats);
+        render_data->first_vertex.push_back(vertices.size());
+        render_data->num_vertices.push_back(geometry.vertices.size());
+        render_data->first_index.push_back(indices.size());
+        render_data->num_indices.push_back(geometry.indices.size());
+        render_data->parts.push_back(geometry.parts);
+        vertices.insert(vertices.end(), geometry.vertices.begin(), geometry.vertices.end());
+        indices.insert(indices.end(), geometry.indices.begin(), geometry.indices.end());
+        if (is_room)
+            room_animated_polygons.at(mesh->id).swap(geometry.animated_polygons);
     }
 
     glBindVertexArray(render_data->vao);
     glBindBuffer(GL_ARRAY_BUFFER, render_data->vbo);
-    glBufferData(GL_ARRAY_BUFFER, total_num_vertices * sizeof(MeshVertex), nullptr, GL_STATIC_DRAW);
+    render_data->vbo_size = vertices.size() * sizeof(MeshVertex);
+    glBufferData(GL_ARRAY_BUFFER, render_data->vbo_size, vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render_data->ebo);
+    render_data->ebo_size = indices.size() * sizeof(GLushort);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, render_data->ebo_size, indices.data(), GL_STATIC_DRAW);
+
+    SetMeshVertexAttribs(render_data->vao, render_data->vbo);
+}
+
+void Renderer::SetMeshVertexAttribs(GLuint vao, GLuint vbo)
+{
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
 
-    glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, position));
+    // NOTE: the intensity and the normal share their bytes,
+    // each shader only reads the one it needs
+
+    glVertexAttribPointer(ATTRIB_POSITION, 3, GL_SHORT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, position));
     glEnableVertexAttribArray(ATTRIB_POSITION);
-    glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, texcoord));
+    glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, texcoord));
     glEnableVertexAttribArray(ATTRIB_TEXCOORD);
-    glVertexAttribPointer(ATTRIB_COLOR, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, lightattrib));
-    glEnableVertexAttribArray(ATTRIB_COLOR);
-    glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, lightattrib));
+    glVertexAttribPointer(ATTRIB_INTENSITY, 1, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, lightattrib));
+    glEnableVertexAttribArray(ATTRIB_INTENSITY);
+    glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_BYTE, GL_TRUE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, lightattrib));
     glEnableVertexAttribArray(ATTRIB_NORMAL);
-    glVertexAttribIPointer(ATTRIB_TEXATTRIB, 2, GL_SHORT, sizeof(MeshVertex), (void*)offsetof(MeshVertex, texpage));
+    glVertexAttribIPointer(ATTRIB_ROOM, 1, GL_UNSIGNED_SHORT, sizeof(MeshVertex), (void*)(offsetof(MeshVertex, lightattrib) + 2));
+    glEnableVertexAttribArray(ATTRIB_ROOM);
+    glVertexAttribIPointer(ATTRIB_TEXATTRIB, 1, GL_UNSIGNED_SHORT, sizeof(MeshVertex), (void*)offsetof(MeshVertex, texattrib));
     glEnableVertexAttribArray(ATTRIB_TEXATTRIB);
 }
 
-void Renderer::UploadMeshData(Renderer::RenderData* render_data, const tr::mesh* mesh)
+void Renderer::UploadRoomData(const tr::mesh* mesh)
 {
-    glBindVertexArray(render_data->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, render_data->vbo);
+    MeshGeometry geometry;
+    BuildMeshGeometry(*mesh, true, &geometry, nullptr);
+
+    // the room may need other ranges than before
+    GLsizei num_vertices = geometry.vertices.size();
+    GLint& first_vertex = room_render_data.first_vertex.at(mesh->id);
+    if (room_render_data.num_vertices[mesh->id] != num_vertices) {
+        if (room_render_data.num_vertices[mesh->id] > 0)
+            ReturnFreeRange(&room_free_vertices, first_vertex, room_render_data.num_vertices[mesh->id]);
+        first_vertex = (num_vertices > 0) ? AllocateRoomVertices(num_vertices) : 0;
+        room_render_data.num_vertices[mesh->id] = num_vertices;
+    }
+    GLsizei num_indices = geometry.indices.size();
+    GLint& first_index = room_render_data.first_index.at(mesh->id);
+    if (room_render_data.num_indices[mesh->id] != num_indices) {
+        if (room_render_data.num_indices[mesh->id] > 0)
+            ReturnFreeRange(&room_free_indices, first_index, room_render_data.num_indices[mesh->id]);
+        first_index = (num_indices > 0) ? AllocateRoomIndices(num_indices) : 0;
+        room_render_data.num_indices[mesh->id] = num_indices;
+    }
 
-    MeshVertex* ptr = (MeshVertex*)glMapBufferRange(GL_ARRAY_BUFFER,
-        render_data->first_vertex.at(mesh->id) * sizeof(MeshVertex),
-        render_data->num_vertices.at(mesh->id) * sizeof(MeshVertex),
-        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT
-    );
+    // NOTE: the element array binding belongs to the vao
+    glBindBuffer(GL_COPY_WRITE_BUFFER, room_render_data.vbo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, first_vertex * sizeof(MeshVertex),
+                    num_vertices * sizeof(MeshVertex), geometry.vertices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, room_render_data.ebo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, first_index * sizeof(GLushort),
+                    num_indices * sizeof(GLushort), geometry.indices.data());
 
-    for (const tr::mesh_poly& poly : mesh->polys) {
-        int num_vertices = (poly.verts[3] == (ushort)-1) ? 3 : 4;
-        for (int i = 2; i < num_vertices; ++i) {
-            int indices[] = {0, i-1, i};
-            for (int index : indices) {
-                tr::mesh_vert vert = mesh->verts[poly.verts[index]];
-                ptr->position[0] = vert.position.x;
-                ptr->position[1] = vert.position.y;
-                ptr->position[2] = vert.position.z;
-                ptr->texcoord[0] = poly.texinfo->texcoord[index][0];
-                ptr->texcoord[1] = poly.texinfo->texcoord[index][1];
-                ptr->lightattrib[0] = vert.lightattrib[0];
-                ptr->lightattrib[1] = vert.lightattrib[1];
-                ptr->lightattrib[2] = vert.lightattrib[2];
-                ptr->texpage = poly.texinfo->texpage;
-                ptr->texalphamode = poly.texinfo->texalphamode;
-                ++ptr;
-            }
+    room_render_data.parts.at(mesh->id).swap(geometry.parts);
+    room_animated_polygons.at(mesh->id).swap(geometry.animated_polygons);
+}
+
+void Renderer::AnimateTextures()
+{
+    glBindBuffer(GL_ARRAY_BUFFER, room_render_data.vbo);
+
+    for (size_t i = 0; i < room_animated_polygons.size(); ++i) {
+        std::vector<AnimatedPolygon>& polygons = room_animated_polygons[i];
+        if (polygons.empty())
+            continue;
+
+        // NOTE: the rest of the range keeps its contents
+        MeshVertex* base_ptr = (MeshVertex*)glMapBufferRange(GL_ARRAY_BUFFER,
+            room_render_data.first_vertex[i] * sizeof(MeshVertex),
+            room_render_data.num_vertices[i] * sizeof(MeshVertex),
+            GL_MAP_WRITE_BIT
+        );
+        for (AnimatedPolygon& polygon : polygons) {
+            polygon.texinfo = level->get(polygon.texinfo).texanimchain;
+            const tr::texinfo& texinfo = level->get(polygon.texinfo);
+            for (int c = 0; c < polygon.num_corners; ++c)
+                SetCornerTexture(base_ptr + polygon.vertices[c], texinfo, c);
         }
+        glUnmapBuffer(GL_ARRAY_BUFFER);
     }
+}
 
-    glUnmapBuffer(GL_ARRAY_BUFFER);
+static void PrintGeometryTotals(FILE* fp, const char* name, const std::vector<GLsizei>& num_vertices, const std::vector<GLsizei>& num_indices)
+{
+    long before = 0, after = 0;
+    for (size_t i = 0; i < num_vertices.size(); ++i) {
+        before += num_indices[i];
+        after += num_vertices[i];
+    }
+    fprintf(fp, "  %-6s %9ld -> %9ld vertices, %10zu -> %10zu bytes (+ %zu bytes of indices)\n", name,
+            before, after, before * sizeof(MeshVertex), after * sizeof(MeshVertex), before * sizeof(GLushort));
+}
+
+static void PrintTriangleOrder(FILE* fp, const char* name, long num_triangles, long misses_before, long misses_after,
+                               long shaded_before, long shaded_after, long covered)
+{
+    fprintf(fp, "  %-6s acmr %.3f -> %.3f, overdraw %.3f -> %.3f\n", name,
+            misses_before / std::max(1.0, (double)num_triangles), misses_after / std::max(1.0, (double)num_triangles),
+            shaded_before / std::max(1.0, (double)covered), shaded_after / std::max(1.0, (double)covered));
+}
+
+void Renderer::PrintGeometryReport(FILE* fp) const
+{
+    fprintf(fp, "geometry:\n");
+    PrintGeometryTotals(fp, "rooms", room_render_data.num_vertices, room_render_data.num_indices);
+    PrintGeometryTotals(fp, "meshes", mesh_render_data.num_vertices, mesh_render_data.num_indices);
+
+    if (!measure_triangle_order)
+        return;
+
+    // NOTE: only the geometry built by RegisterLevel(), not streamed rooms
+    fprintf(fp, "triangle order (%d vertex cache):\n", tr::VERTEX_CACHE_SIZE);
+    const GeometryStats& rooms = room_geometry_stats;
+    PrintTriangleOrder(fp, "rooms", rooms.num_triangles, rooms.cache_misses_before, rooms.cache_misses_after,
+                       rooms.shaded_before, rooms.shaded_after, rooms.covered);
+    const GeometryStats& meshes = mesh_geometry_stats;
+    PrintTriangleOrder(fp, "meshes", meshes.num_triangles, meshes.cache_misses_before, meshes.cache_misses_after,
+                       meshes.shaded_before, meshes.shaded_after, meshes.covered);
+}
+
+void Renderer::PrintDrawReport(FILE* fp) const
+{
+    if (indirect_draws) {
+        fprintf(fp, "indirect draws: %ld commands in %ld multi-draws, %ld instanced mesh commands (%ld instances)\n",
+                draw_stats.indirect_draws, draw_stats.indirect_multi_draws,
+                draw_stats.instanced_draws, draw_stats.instances);
+    } else {
+        fprintf(fp, "mesh draws: %ld instanced (%ld instances), %ld individual\n",
+                draw_stats.instanced_draws, draw_stats.instances, draw_stats.individual_draws);
+    }
+}
+
+// returns -1 if none of the ranges is big enough
+static GLint TakeFreeRange(std::vector<std::pair<GLint, GLsizei>>* free_ranges, GLsizei count)
+{
+    for (size_t i = 0; i < free_ranges->size(); ++i) {
+        std::pair<GLint, GLsizei>& range = (*free_ranges)[i];
+        if (range.second >= count) {
+            GLint first = range.first;
+            range.first += count;
+            range.second -= count;
+            if (range.second == 0)
+                free_ranges->erase(free_ranges->begin() + i);
+            return first;
+        }
+    }
+    return -1;
+}
+
+static void ReturnFreeRange(std::vector<std::pair<GLint, GLsizei>>* free_ranges, GLint first, GLsizei count)
+{
+    // keep the ranges sorted and merge the neighbours
+    auto it = std::lower_bound(free_ranges->begin(), free_ranges->end(), std::make_pair(first, count));
+    it = free_ranges->insert(it, std::make_pair(first, count));
+
+    auto next = it + 1;
+    if (next != free_ranges->end() && it->first + it->second == next->first) {
+        it->second += next->second;
+        free_ranges->erase(next);
+    }
+    if (it != free_ranges->begin()) {
+        auto prev = it - 1;
+        if (prev->first + prev->second == it->first) {
+            prev->second += it->second;
+            free_ranges->erase(it);
+        }
+    }
+}
+
+// replaces the buffer with a bigger one with the same contents
+static void GrowBuffer(GLuint* buffer, size_t old_size, size_t new_size)
+{
+    GLuint new_buffer;
+    glGenBuffers(1, &new_buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, new_size, nullptr, GL_STATIC_DRAW);
+    if (old_size > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, *buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_size);
+    }
+    glDeleteBuffers(1, buffer);
+    *buffer = new_buffer;
+}
+
+GLint Renderer::AllocateRoomVertices(GLsizei num_vertices)
+{
+    GLint first_vertex = TakeFreeRange(&room_free_vertices, num_vertices);
+    if (first_vertex >= 0)
+        return first_vertex;
+
+    // grow the buffer, rooms that are already loaded keep their ranges
+    GLsizei old_capacity = room_vertex_capacity;
+    GLsizei new_capacity = std::max(old_capacity * 2, old_capacity + num_vertices);
+    GrowBuffer(&room_render_data.vbo, old_capacity * sizeof(MeshVertex), new_capacity * sizeof(MeshVertex));
+    room_render_data.vbo_size = new_capacity * sizeof(MeshVertex);
+    SetMeshVertexAttribs(room_render_data.vao, room_render_data.vbo);
+
+    room_vertex_capacity = new_capacity;
+    ReturnFreeRange(&room_free_vertices, old_capacity, new_capacity - old_capacity);
+    return AllocateRoomVertices(num_vertices);
+}
+
+GLint Renderer::AllocateRoomIndices(GLsizei num_indices)
+{
+    GLint first_index = TakeFreeRange(&room_free_indices, num_indices);
+    if (first_index >= 0)
+        return first_index;
+
+    GLsizei old_capacity = room_index_capacity;
+    GLsizei new_capacity = std::max(old_capacity * 2, old_capacity + num_indices);
+    GrowBuffer(&room_render_data.ebo, old_capacity * sizeof(GLushort), new_capacity * sizeof(GLushort));
+    room_render_data.ebo_size = new_capacity * sizeof(GLushort);
+    glBindVertexArray(room_render_data.vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, room_render_data.ebo);
+
+    room_index_capacity = new_capacity;
+    ReturnFreeRange(&room_free_indices, old_capacity, new_capacity - old_capacity);
+    return AllocateRoomIndices(num_indices);
 }
 
 // sprite data
@@ -460,20 +1436,41 @@ struct SpriteVertex
 
 void Renderer::AllocateSpriteBuffers(Renderer::RenderData* render_data, const std::vector<const tr::sprite*>& sprites)
 {
+    // all sprites are quads, so they share their indices
+    static const GLushort QUAD_INDICES[] = {0, 1, 2, 0, 2, 3};
+
     render_data->first_vertex.clear();
     render_data->num_vertices.clear();
+    render_data->first_index.clear();
+    render_data->num_indices.clear();
+    render_data->parts.clear();
     render_data->num_objects = sprites.size();
 
     long total_num_vertices = 0;
     for (size_t i = 0; i < sprites.size(); ++i) {
         render_data->first_vertex.push_back(total_num_vertices);
         render_data->num_vertices.push_back(4);
+        render_data->first_index.push_back(0);
+        render_data->num_indices.push_back(6);
+        render_data->parts.push_back({ { 0, 4, 0, 6 } });
         total_num_vertices += render_data->num_vertices.back();
     }
 
     glBindVertexArray(render_data->vao);
     glBindBuffer(GL_ARRAY_BUFFER, render_data->vbo);
-    glBufferData(GL_ARRAY_BUFFER, total_num_vertices * sizeof(SpriteVertex), nullptr, GL_STATIC_DRAW);
+    render_data->vbo_size = total_num_vertices * sizeof(SpriteVertex);
+    glBufferData(GL_ARRAY_BUFFER, render_data->vbo_size, nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render_data->ebo);
+    render_data->ebo_size = sizeof(QUAD_INDICES);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, render_data->ebo_size, QUAD_INDICES, GL_STATIC_DRAW);
+
+    SetSpriteVertexAttribs(render_data->vao, render_data->vbo);
+}
+
+void Renderer::SetSpriteVertexAttribs(GLuint vao, GLuint vbo)
+{
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
 
     glVertexAttribPointer(ATTRIB_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(SpriteVertex), (void*)offsetof(SpriteVertex, position));
     glEnableVertexAttribArray(ATTRIB_POSITION);
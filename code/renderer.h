@@ -29,6 +29,10 @@
 #include "shaders.h"
 #include "tr_types.h"
 
+#include <stdio.h>
+
+#include <memory>
+#include <utility>
 #include <vector>
 
 /*
@@ -51,8 +55,18 @@ public:
         bool debug_draw_all_sprites;
     };
 
+    enum TexPageFormat
+    {
+        // r8 palette indices, the shaders look up the palette
+        TEXPAGE_FORMAT_INDEXED,
+        // expanded through the palette on upload
+        TEXPAGE_FORMAT_RGBA8,
+        // the 16-bit texpages, for levels that have them
+        TEXPAGE_FORMAT_RGB5_A1
+    };
+
 public:
-    Renderer();
+    explicit Renderer(TexPageFormat texpage_format = TEXPAGE_FORMAT_INDEXED);
     ~Renderer();
 
     void RegisterLevel(const tr::level& level);
@@ -60,10 +74,49 @@ public:
 
     void NotifyRoomMeshUpdated(const tr::mesh& mesh);
 
+    // advances the animated textures of the rooms by one frame, only the
+    // texinfos of the level are used, see tr::level::release_uploaded_data()
+    void AnimateTextures();
+
+    // GPU bytes of the buffers and textures, as allocated
+    void MemoryUsage(tr::memory_report* report) const;
+
+    // vertex counts and bytes of the rooms and meshes, before and after
+    // deduplication, before is one vertex per triangle corner; and the
+    // vertex cache misses and overdraw of their triangle order
+    void PrintGeometryReport(FILE* fp) const;
+    // measuring the overdraw is slow, so the triangle order is
+    // only measured when this is set before RegisterLevel()
+    void SetMeasureTriangleOrder(bool measure) { measure_triangle_order = measure; }
+
+    // static meshes are transformed and lit into the geometry of their
+    // rooms and drawn with them, set before RegisterLevel()
+    void SetBatchStaticMeshes(bool batch) { batch_static_meshes = batch; }
+
+    // static meshes and internally lit model nodes are grouped by mesh and
+    // each mesh is drawn with one instanced draw, or with one instanced
+    // command of the indirect multi-draw
+    void SetInstanceMeshes(bool instance) { instance_meshes = instance; }
+
+    // with GL 4.3, static meshes, model nodes and sprites are drawn with
+    // one indirect multi-draw per shader, this falls back to the GL 3.2 path
+    bool HasIndirectDraws() const { return has_indirect_draws; }
+    void SetIndirectDraws(bool indirect) { indirect_draws = indirect && has_indirect_draws; }
+
+    // draws of the last frame, instanced and individual
+    void PrintDrawReport(FILE* fp) const;
+
+    // NOTE: for levels with streamed rooms
+    void NotifyRoomLoaded(const tr::room& room);
+    void NotifyRoomEvicted(const tr::room& room);
+
 private:
     Renderer(const Renderer&) = delete;
     Renderer& operator=(const Renderer&) = delete;
 
+    // the handles of the level are resolved against it
+    const tr::level* level;
+
     // NOTE: rooms use a separate shader because their vertices
     // are already in world space
 
@@ -73,8 +126,10 @@ private:
     MeshConstantShader mesh_constant_shader;
     MeshInternalShader mesh_internal_shader;
     MeshExternalShader mesh_external_shader;
+    MeshInstancedShader mesh_instanced_shader;
     void DrawStaticMeshes(const FrameInfo& frameinfo);
     void DrawModelObjects(const FrameInfo& frameinfo);
+    void DrawInstancedMeshes(const FrameInfo& frameinfo);
     void DebugDrawAllMeshes();
 
     SpriteShader sprite_shader;
@@ -86,26 +141,123 @@ private:
 
     std::vector<GLuint> room_lighting_ubos;
     void InitRoomLightingUniformBuffers(const tr::level& level);
+    void UploadRoomLighting(const tr::room& room);
 
+    TexPageFormat texpage_format;
     GLuint texpages;
+    GLuint palette;
+    size_t texpages_size;
     void InitTexPages(const tr::level& level);
 
+    // room geometry is stored relative to these, see MeshVertex
+    GLuint room_origins_buffer;
+    GLuint room_origins;
+    void InitRoomOrigins(const tr::level& level);
+
+    // the placements of DrawInstancedMeshes(), rewritten every frame
+    bool instance_meshes;
+    GLuint instance_buffer;
+    GLuint instances;
+    size_t instance_buffer_size;
+
+    struct DrawStats
+    {
+        long instanced_draws = 0, instances = 0;
+        long individual_draws = 0;
+        long indirect_multi_draws = 0, indirect_draws = 0;
+    };
+    DrawStats draw_stats;
+
+    // the commands of DrawIndirect() and their data, indexed by the base
+    // instance of the command plus the instance, see the indirect shaders
+    bool has_indirect_draws;
+    bool indirect_draws;
+    std::unique_ptr<MeshInternalIndirectShader> mesh_internal_indirect_shader;
+    std::unique_ptr<MeshExternalIndirectShader> mesh_external_indirect_shader;
+    std::unique_ptr<SpriteIndirectShader> sprite_indirect_shader;
+    GLuint indirect_mesh_vao, indirect_sprite_vao;
+    GLuint draw_command_buffer, draw_data_buffer, draw_index_buffer;
+    size_t draw_command_buffer_size, draw_data_buffer_size;
+    GLsizei draw_index_capacity;
+    // the room lighting blocks, one after another
+    GLuint room_lighting_buffer;
+    void InitIndirectDraws();
+    void DrawIndirect(const FrameInfo& frameinfo);
+
+    // a range of 16-bit indices that are relative to the first vertex of
+    // the part; both ranges are relative to the ranges of the object
+    struct DrawPart
+    {
+        GLint first_vertex;
+        GLsizei num_vertices;
+        GLint first_index;
+        GLsizei num_indices;
+    };
+
+    // objects are drawn as indexed triangles, one draw per part; objects
+    // with more vertices than 16-bit indices can reach have several parts
     struct RenderData
     {
-        GLuint vao, vbo;
+        GLuint vao, vbo, ebo;
+        size_t vbo_size, ebo_size;
         GLuint num_objects;
         std::vector<GLint> first_vertex;
         std::vector<GLsizei> num_vertices;
+        std::vector<GLint> first_index;
+        std::vector<GLsizei> num_indices;
+        std::vector<std::vector<DrawPart>> parts;
     };
 
     RenderData room_render_data;
     RenderData mesh_render_data;
     RenderData sprite_render_data;
 
-    void AllocateMeshBuffers(RenderData* render_data, const std::vector<const tr::mesh*>& meshes);
-    void UploadMeshData(RenderData* render_data, const tr::mesh* mesh);
+    static void DrawElements(const RenderData& render_data, GLuint object);
+
+    // totals of the meshes that RegisterLevel() builds, before and
+    // after optimizing their triangle order, see PrintGeometryReport()
+    struct GeometryStats
+    {
+        long num_triangles = 0;
+        long cache_misses_before = 0, cache_misses_after = 0;
+        long shaded_before = 0, shaded_after = 0, covered = 0;
+    };
+    bool measure_triangle_order;
+    GeometryStats room_geometry_stats;
+    GeometryStats mesh_geometry_stats;
+
+    bool batch_static_meshes;
+
+    struct MeshGeometry;
+    void BuildMeshGeometry(const tr::mesh& mesh, bool is_room, MeshGeometry* geometry, GeometryStats* stats) const;
+    void AppendMeshGeometry(const tr::mesh& mesh, const glm::mat4& transform, glm::vec3 origin,
+                            float intensity_scale, uint16_t room, bool animate, MeshGeometry* geometry) const;
+    static void OptimizeMeshGeometry(MeshGeometry* geometry, GeometryStats* stats);
+    void InitMeshBuffers(RenderData* render_data, const std::vector<const tr::mesh*>& meshes);
+    static void SetMeshVertexAttribs(GLuint vao, GLuint vbo);
+    void UploadRoomData(const tr::mesh* mesh);
+
+    // room polygons with animated textures, by room; the vertices
+    // are relative to the first vertex of the room
+    struct AnimatedPolygon
+    {
+        tr::handle<tr::texinfo> texinfo;
+        GLuint vertices[4];
+        int num_corners;
+    };
+    std::vector<std::vector<AnimatedPolygon>> room_animated_polygons;
+
+    // vertex and index ranges of streamed rooms, the room buffers
+    // grow when none of the free ranges is big enough
+    GLsizei room_vertex_capacity;
+    GLsizei room_index_capacity;
+    std::vector<std::pair<GLint, GLsizei>> room_free_vertices;
+    std::vector<std::pair<GLint, GLsizei>> room_free_indices;
+    GLint AllocateRoomVertices(GLsizei num_vertices);
+    GLint AllocateRoomIndices(GLsizei num_indices);
 
     void AllocateSpriteBuffers(RenderData* render_data, const std::vector<const tr::sprite*>& sprites);
+    static void SetSpriteVertexAttribs(GLuint vao, GLuint vbo);
     void UploadSpriteData(RenderData* render_data, const tr::sprite* sprite);
 };
 
@@ -49,14 +49,17 @@ RoomShader::RoomShader()
         .AddShader(GL_FRAGMENT_SHADER, "shaders/mesh.frag")
         .BindAttrib("VertPosition", ATTRIB_POSITION)
         .BindAttrib("VertTexCoord", ATTRIB_TEXCOORD)
-        .BindAttrib("VertColor", ATTRIB_COLOR)
+        .BindAttrib("VertIntensity", ATTRIB_INTENSITY)
         .BindAttrib("VertTexAttrib", ATTRIB_TEXATTRIB)
+        .BindAttrib("VertRoom", ATTRIB_ROOM)
         .BindFragData("FragColor", FRAGDATA_COLOR)
         .BindUniformBlock("TransformBlock", UNIFORMBLOCK_TRANSFORM)
         .Build();
 
     glUseProgram(program);
     glUniform1i(glGetUniformLocation(program, "TexPages"), 0);
+    glUniform1i(glGetUniformLocation(program, "Palette"), 1);
+    glUniform1i(glGetUniformLocation(program, "RoomOrigins"), 2);
 }
 
 RoomShader::~RoomShader()
@@ -93,6 +96,7 @@ MeshConstantShader::MeshConstantShader()
 
     glUseProgram(program);
     glUniform1i(glGetUniformLocation(program, "TexPages"), 0);
+    glUniform1i(glGetUniformLocation(program, "Palette"), 1);
     uniforms.model_matrix = glGetUniformLocation(program, "ModelMatrix");
     uniforms.light_intensity = glGetUniformLocation(program, "LightIntensity");
 
@@ -125,7 +129,7 @@ MeshInternalShader::MeshInternalShader()
         .AddShader(GL_FRAGMENT_SHADER, "shaders/mesh.frag")
         .BindAttrib("VertPosition", ATTRIB_POSITION)
         .BindAttrib("VertTexCoord", ATTRIB_TEXCOORD)
-        .BindAttrib("VertColor", ATTRIB_COLOR)
+        .BindAttrib("VertIntensity", ATTRIB_INTENSITY)
         .BindAttrib("VertTexAttrib", ATTRIB_TEXATTRIB)
         .BindFragData("FragColor", FRAGDATA_COLOR)
         .BindUniformBlock("TransformBlock", UNIFORMBLOCK_TRANSFORM)
@@ -134,6 +138,7 @@ MeshInternalShader::MeshInternalShader()
 
     glUseProgram(program);
     glUniform1i(glGetUniformLocation(program, "TexPages"), 0);
+    glUniform1i(glGetUniformLocation(program, "Palette"), 1);
     uniforms.model_matrix = glGetUniformLocation(program, "ModelMatrix");
     uniforms.light_intensity = glGetUniformLocation(program, "LightIntensity");
 }
@@ -154,6 +159,46 @@ MeshInternalShader& MeshInternalShader::operator=(MeshInternalShader&& other)
     return *this;
 }
 
+/*
+ * MeshInstancedShader
+ */
+
+MeshInstancedShader::MeshInstancedShader()
+{
+    program = ShaderBuilder()
+        .AddShader(GL_VERTEX_SHADER, "shaders/mesh_instanced.vert")
+        .AddShader(GL_FRAGMENT_SHADER, "shaders/mesh.frag")
+        .BindAttrib("VertPosition", ATTRIB_POSITION)
+        .BindAttrib("VertTexCoord", ATTRIB_TEXCOORD)
+        .BindAttrib("VertIntensity", ATTRIB_INTENSITY)
+        .BindAttrib("VertTexAttrib", ATTRIB_TEXATTRIB)
+        .BindFragData("FragColor", FRAGDATA_COLOR)
+        .BindUniformBlock("TransformBlock", UNIFORMBLOCK_TRANSFORM)
+        .Build();
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "TexPages"), 0);
+    glUniform1i(glGetUniformLocation(program, "Palette"), 1);
+    glUniform1i(glGetUniformLocation(program, "Instances"), 3);
+    uniforms.first_instance = glGetUniformLocation(program, "FirstInstance");
+}
+
+MeshInstancedShader::~MeshInstancedShader()
+{
+    glDeleteProgram(program);
+}
+
+MeshInstancedShader::MeshInstancedShader(MeshInstancedShader&& other)
+{
+    std::swap(program, other.program);
+}
+
+MeshInstancedShader& MeshInstancedShader::operator=(MeshInstancedShader&& other)
+{
+    std::swap(program, other.program);
+    return *this;
+}
+
 /*
  * MeshExternalShader
  */
@@ -174,6 +219,7 @@ MeshExternalShader::MeshExternalShader()
 
     glUseProgram(program);
     glUniform1i(glGetUniformLocation(program, "TexPages"), 0);
+    glUniform1i(glGetUniformLocation(program, "Palette"), 1);
     uniforms.model_matrix = glGetUniformLocation(program, "ModelMatrix");
     uniforms.light_intensity = glGetUniformLocation(program, "LightIntensity");
 }
@@ -212,6 +258,7 @@ SpriteShader::SpriteShader()
 
     glUseProgram(program);
     glUniform1i(glGetUniformLocation(program, "TexPages"), 0);
+    glUniform1i(glGetUniformLocation(program, "Palette"), 1);
     uniforms.sprite_position = glGetUniformLocation(program, "SpritePosition");
     uniforms.sprite_light_intensity = glGetUniformLocation(program, "SpriteLightIntensity");
 }
@@ -232,6 +279,126 @@ SpriteShader& SpriteShader::operator=(SpriteShader&& other)
     return *this;
 }
 
+/*
+ * MeshInternalIndirectShader
+ */
+
+MeshInternalIndirectShader::MeshInternalIndirectShader()
+{
+    program = ShaderBuilder()
+        .AddShader(GL_VERTEX_SHADER, "shaders/mesh_internal_indirect.vert")
+        .AddShader(GL_FRAGMENT_SHADER, "shaders/mesh.frag")
+        .BindAttrib("VertPosition", ATTRIB_POSITION)
+        .BindAttrib("VertTexCoord", ATTRIB_TEXCOORD)
+        .BindAttrib("VertIntensity", ATTRIB_INTENSITY)
+        .BindAttrib("VertTexAttrib", ATTRIB_TEXATTRIB)
+        .BindAttrib("VertDrawIndex", ATTRIB_DRAWINDEX)
+        .BindFragData("FragColor", FRAGDATA_COLOR)
+        .BindUniformBlock("TransformBlock", UNIFORMBLOCK_TRANSFORM)
+        .BindStorageBlock("DrawDataBlock", STORAGEBLOCK_DRAWDATA)
+        .Build();
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "TexPages"), 0);
+    glUniform1i(glGetUniformLocation(program, "Palette"), 1);
+}
+
+MeshInternalIndirectShader::~MeshInternalIndirectShader()
+{
+    glDeleteProgram(program);
+}
+
+MeshInternalIndirectShader::MeshInternalIndirectShader(MeshInternalIndirectShader&& other)
+{
+    std::swap(program, other.program);
+}
+
+MeshInternalIndirectShader& MeshInternalIndirectShader::operator=(MeshInternalIndirectShader&& other)
+{
+    std::swap(program, other.program);
+    return *this;
+}
+
+/*
+ * MeshExternalIndirectShader
+ */
+
+MeshExternalIndirectShader::MeshExternalIndirectShader()
+{
+    program = ShaderBuilder()
+        .AddShader(GL_VERTEX_SHADER, "shaders/mesh_external_indirect.vert")
+        .AddShader(GL_FRAGMENT_SHADER, "shaders/mesh.frag")
+        .BindAttrib("VertPosition", ATTRIB_POSITION)
+        .BindAttrib("VertTexCoord", ATTRIB_TEXCOORD)
+        .BindAttrib("VertNormal", ATTRIB_NORMAL)
+        .BindAttrib("VertTexAttrib", ATTRIB_TEXATTRIB)
+        .BindAttrib("VertDrawIndex", ATTRIB_DRAWINDEX)
+        .BindFragData("FragColor", FRAGDATA_COLOR)
+        .BindUniformBlock("TransformBlock", UNIFORMBLOCK_TRANSFORM)
+        .BindStorageBlock("DrawDataBlock", STORAGEBLOCK_DRAWDATA)
+        .BindStorageBlock("RoomLightingBuffer", STORAGEBLOCK_ROOMLIGHTING)
+        .Build();
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "TexPages"), 0);
+    glUniform1i(glGetUniformLocation(program, "Palette"), 1);
+}
+
+MeshExternalIndirectShader::~MeshExternalIndirectShader()
+{
+    glDeleteProgram(program);
+}
+
+MeshExternalIndirectShader::MeshExternalIndirectShader(MeshExternalIndirectShader&& other)
+{
+    std::swap(program, other.program);
+}
+
+MeshExternalIndirectShader& MeshExternalIndirectShader::operator=(MeshExternalIndirectShader&& other)
+{
+    std::swap(program, other.program);
+    return *this;
+}
+
+/*
+ * SpriteIndirectShader
+ */
+
+SpriteIndirectShader::SpriteIndirectShader()
+{
+    program = ShaderBuilder()
+        .AddShader(GL_VERTEX_SHADER, "shaders/sprite_indirect.vert")
+        .AddShader(GL_FRAGMENT_SHADER, "shaders/sprite.frag")
+        .BindAttrib("VertPosition", ATTRIB_POSITION)
+        .BindAttrib("VertTexCoord", ATTRIB_TEXCOORD)
+        .BindAttrib("VertTexLayer", ATTRIB_TEXATTRIB)
+        .BindAttrib("VertDrawIndex", ATTRIB_DRAWINDEX)
+        .BindFragData("FragColor", FRAGDATA_COLOR)
+        .BindUniformBlock("TransformBlock", UNIFORMBLOCK_TRANSFORM)
+        .BindStorageBlock("DrawDataBlock", STORAGEBLOCK_DRAWDATA)
+        .Build();
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "TexPages"), 0);
+    glUniform1i(glGetUniformLocation(program, "Palette"), 1);
+}
+
+SpriteIndirectShader::~SpriteIndirectShader()
+{
+    glDeleteProgram(program);
+}
+
+SpriteIndirectShader::SpriteIndirectShader(SpriteIndirectShader&& other)
+{
+    std::swap(program, other.program);
+}
+
+SpriteIndirectShader& SpriteIndirectShader::operator=(SpriteIndirectShader&& other)
+{
+    std::swap(program, other.program);
+    return *this;
+}
+
 /*
  * ShaderBuilder
  */
@@ -276,6 +443,12 @@ ShaderBuilder& ShaderBuilder::BindUniformBlock(const std::string& name, GLuint b
     return *this;
 }
 
+ShaderBuilder& ShaderBuilder::BindStorageBlock(const std::string& name, GLuint binding_point)
+{
+    storage_block_bindings[name] = binding_point;
+    return *this;
+}
+
 GLuint ShaderBuilder::CreateShader(GLenum type, const GLchar* source)
 {
     GLuint shader = glCreateShader(type);
@@ -314,6 +487,10 @@ GLuint ShaderBuilder::CreateProgram(const std::vector<GLuint>& shaders)
         GLuint blockIndex = glGetUniformBlockIndex(program, uniform_block_binding.first.c_str());
         glUniformBlockBinding(program, blockIndex, uniform_block_binding.second);
     }
+    for (auto storage_block_binding : storage_block_bindings) {
+        GLuint blockIndex = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, storage_block_binding.first.c_str());
+        glShaderStorageBlockBinding(program, blockIndex, storage_block_binding.second);
+    }
 
     GLint status = GL_FALSE;
     glGetProgramiv(program, GL_LINK_STATUS, &status);
@@ -29,15 +29,20 @@
 
 #define ATTRIB_POSITION             0
 #define ATTRIB_TEXCOORD             1
-#define ATTRIB_COLOR                2
-#define ATTRIB_NORMAL               2
-#define ATTRIB_TEXATTRIB            3
+#define ATTRIB_INTENSITY            2
+#define ATTRIB_NORMAL               3
+#define ATTRIB_TEXATTRIB            4
+#define ATTRIB_ROOM                 5
+#define ATTRIB_DRAWINDEX            6
 
 #define FRAGDATA_COLOR              0
 
 #define UNIFORMBLOCK_TRANSFORM      0
 #define UNIFORMBLOCK_ROOMLIGHTING   1
 
+#define STORAGEBLOCK_DRAWDATA       0
+#define STORAGEBLOCK_ROOMLIGHTING   1
+
 /*
  * RoomShader
  */
@@ -96,6 +101,26 @@ struct MeshInternalShader
     MeshInternalShader& operator=(const MeshInternalShader&) = delete;
 };
 
+/*
+ * MeshInstancedShader
+ */
+
+struct MeshInstancedShader
+{
+    GLuint program;
+
+    struct {
+        GLuint first_instance;
+    } uniforms;
+
+    MeshInstancedShader();
+    ~MeshInstancedShader();
+    MeshInstancedShader(MeshInstancedShader&&);
+    MeshInstancedShader& operator=(MeshInstancedShader&&);
+    MeshInstancedShader(const MeshInstancedShader&) = delete;
+    MeshInstancedShader& operator=(const MeshInstancedShader&) = delete;
+};
+
 /*
  * MeshExternalShader
  */
@@ -138,6 +163,56 @@ struct SpriteShader
     SpriteShader& operator=(const SpriteShader&) = delete;
 };
 
+/*
+ * MeshInternalIndirectShader
+ */
+
+// NOTE: the indirect shaders need GL 4.3
+
+struct MeshInternalIndirectShader
+{
+    GLuint program;
+
+    MeshInternalIndirectShader();
+    ~MeshInternalIndirectShader();
+    MeshInternalIndirectShader(MeshInternalIndirectShader&&);
+    MeshInternalIndirectShader& operator=(MeshInternalIndirectShader&&);
+    MeshInternalIndirectShader(const MeshInternalIndirectShader&) = delete;
+    MeshInternalIndirectShader& operator=(const MeshInternalIndirectShader&) = delete;
+};
+
+/*
+ * MeshExternalIndirectShader
+ */
+
+struct MeshExternalIndirectShader
+{
+    GLuint program;
+
+    MeshExternalIndirectShader();
+    ~MeshExternalIndirectShader();
+    MeshExternalIndirectShader(MeshExternalIndirectShader&&);
+    MeshExternalIndirectShader& operator=(MeshExternalIndirectShader&&);
+    MeshExternalIndirectShader(const MeshExternalIndirectShader&) = delete;
+    MeshExternalIndirectShader& operator=(const MeshExternalIndirectShader&) = delete;
+};
+
+/*
+ * SpriteIndirectShader
+ */
+
+struct SpriteIndirectShader
+{
+    GLuint program;
+
+    SpriteIndirectShader();
+    ~SpriteIndirectShader();
+    SpriteIndirectShader(SpriteIndirectShader&&);
+    SpriteIndirectShader& operator=(SpriteIndirectShader&&);
+    SpriteIndirectShader(const SpriteIndirectShader&) = delete;
+    SpriteIndirectShader& operator=(const SpriteIndirectShader&) = delete;
+};
+
 /*
  * ShaderBuilder
  */
@@ -152,6 +227,7 @@ public:
     ShaderBuilder& BindAttrib(const std::string& name, GLuint location);
     ShaderBuilder& BindFragData(const std::string& name, GLuint location);
     ShaderBuilder& BindUniformBlock(const std::string& name, GLuint binding_point);
+    ShaderBuilder& BindStorageBlock(const std::string& name, GLuint binding_point);
 
 private:
     GLuint CreateShader(GLenum type, const GLchar* source);
@@ -162,6 +238,7 @@ private:
     std::map<std::string, GLuint> attrib_bindings;
     std::map<std::string, GLuint> frag_data_bindings;
     std::map<std::string, GLuint> uniform_block_bindings;
+    std::map<std::string, GLuint> storage_block_bindings;
 };
 
 #endif
@@ -0,0 +1,97 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tr_arena.h"
+
+#include <stdint.h>
+
+#include <algorithm>
+
+tr::arena::arena(size_t block_size) :
+    block_size(block_size), block_used(0), total_used(0), total_reserved(0)
+{
+}
+
+void tr::arena::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<block>().swap(blocks);
+    block_used = 0;
+    total_used = 0;
+    total_reserved = 0;
+}
+
+void tr::arena::swap(tr::arena& other)
+{
+    if (&other == this)
+        return;
+    std::lock(mutex, other.mutex);
+    std::lock_guard<std::mutex> lock(mutex, std::adopt_lock);
+    std::lock_guard<std::mutex> other_lock(other.mutex, std::adopt_lock);
+    std::swap(block_size, other.block_size);
+    blocks.swap(other.blocks);
+    std::swap(block_used, other.block_used);
+    std::swap(total_used, other.total_used);
+    std::swap(total_reserved, other.total_reserved);
+}
+
+size_t tr::arena::used() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return total_used;
+}
+
+size_t tr::arena::reserved() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return total_reserved;
+}
+
+void* tr::arena::allocate_bytes(size_t size, size_t alignment)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!blocks.empty()) {
+        block& last = blocks.back();
+        uintptr_t base = (uintptr_t)last.data.get();
+        size_t offset = ((base + block_used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+        if (offset + size <= last.size) {
+            block_used = offset + size;
+            total_used += size;
+            return last.data.get() + offset;
+        }
+    }
+
+    // large arrays get a block of their own, exactly as big as they are,
+    // so that the current one isn't abandoned half-empty
+    bool dedicated = size > block_size / 4 && !blocks.empty();
+    block b;
+    b.size = dedicated ? size : std::max(size, block_size);
+    b.data.reset(new char[b.size]);
+    total_used += size;
+    total_reserved += b.size;
+
+    if (dedicated) {
+        blocks.insert(blocks.end() - 1, std::move(b));
+        return (blocks.end() - 2)->data.get();
+    }
+
+    blocks.push_back(std::move(b));
+    block_used = size;
+    return blocks.back().data.get();
+}
@@ -0,0 +1,145 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TR_ARENA_H
+#define TR_ARENA_H
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace tr
+{
+    /*
+     * tr::span
+     *
+     * A view of an array that is owned by someone else, usually a tr::arena
+     * or the mapped level cache.
+     */
+
+    template <typename T>
+    class span
+    {
+    public:
+        span() : ptr(nullptr), count(0) {}
+        span(T* ptr, size_t count) : ptr(ptr), count(count) {}
+
+        T* data() const { return ptr; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+
+        T* begin() const { return ptr; }
+        T* end() const { return ptr + count; }
+
+        T& operator[](size_t idx) const { assert(idx < count); return ptr[idx]; }
+        T& at(size_t idx) const
+        {
+            if (idx >= count)
+                throw std::out_of_range("tr::span::at");
+            return ptr[idx];
+        }
+
+        T& front() const { return (*this)[0]; }
+        T& back() const { return (*this)[count - 1]; }
+
+        span<T> first(size_t n) const { assert(n <= count); return span<T>(ptr, n); }
+        span<T> subspan(size_t offset, size_t n) const
+        {
+            assert(offset <= count && n <= count - offset);
+            return span<T>(ptr + offset, n);
+        }
+
+    private:
+        T* ptr;
+        size_t count;
+    };
+
+    /*
+     * tr::arena
+     *
+     * Bump allocator for arrays that live as long as the arena. Memory is
+     * taken from large blocks and only given back all at once, by clear()
+     * or the destructor. Allocation is thread-safe.
+     */
+
+    class arena
+    {
+    public:
+        explicit arena(size_t block_size = 1024 * 1024);
+
+        // the items are value-initialized and never destroyed
+        template <typename T>
+        tr::span<T> allocate(size_t count)
+        {
+            static_assert(std::is_trivially_destructible<T>::value, "tr::arena: T must be trivially destructible");
+            // new[] memory is aligned for any fundamental type
+            static_assert(alignof(T) <= alignof(long double), "tr::arena: T is overaligned");
+            if (count == 0)
+                return tr::span<T>();
+            T* ptr = (T*)allocate_bytes(count * sizeof(T), alignof(T));
+            for (size_t i = 0; i < count; ++i)
+                new (ptr + i) T();
+            return tr::span<T>(ptr, count);
+        }
+
+        template <typename T>
+        tr::span<T> copy(const T* data, size_t count)
+        {
+            tr::span<T> result = allocate<T>(count);
+            std::copy(data, data + count, result.begin());
+            return result;
+        }
+
+        void clear();
+        // the spans of both arenas stay valid
+        void swap(arena& other);
+
+        // bytes handed out and bytes reserved from the system
+        size_t used() const;
+        size_t reserved() const;
+
+    private:
+        arena(const arena&) = delete;
+        arena& operator=(const arena&) = delete;
+
+        struct block
+        {
+            std::unique_ptr<char[]> data;
+            size_t size;
+        };
+
+        size_t block_size;
+
+        mutable std::mutex mutex;
+        std::vector<block> blocks;
+        size_t block_used;
+        size_t total_used;
+        size_t total_reserved;
+
+        void* allocate_bytes(size_t size, size_t alignment);
+    };
+}
+
+#endif
@@ -0,0 +1,727 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tr_cache.h"
+
+#include "tr_reader.h"
+#include "tr_version.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+ * hash
+ */
+
+static const uint64_t PRIME64_1 = 11400714785074694791ULL;
+static const uint64_t PRIME64_2 = 14029467366897019727ULL;
+static const uint64_t PRIME64_3 = 1609587929392839161ULL;
+static const uint64_t PRIME64_4 = 9650029242287828579ULL;
+static const uint64_t PRIME64_5 = 2870177450012600261ULL;
+
+static inline uint64_t Rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t Load64(const uchar* p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+#ifdef TR_BIG_ENDIAN
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint32_t Load32(const uchar* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+#ifdef TR_BIG_ENDIAN
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t HashRound(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = Rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t HashMerge(uint64_t acc, uint64_t val)
+{
+    acc ^= HashRound(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t tr::hash64(const void* data, size_t size, uint64_t seed)
+{
+    const uchar* p = (const uchar*)data;
+    const uchar* end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        do {
+            v1 = HashRound(v1, Load64(p));
+            v2 = HashRound(v2, Load64(p + 8));
+            v3 = HashRound(v3, Load64(p + 16));
+            v4 = HashRound(v4, Load64(p + 24));
+            p += 32;
+        } while (p <= end - 32);
+
+        h = Rotl64(v1, 1) + Rotl64(v2, 7) + Rotl64(v3, 12) + Rotl64(v4, 18);
+        h = HashMerge(h, v1);
+        h = HashMerge(h, v2);
+        h = HashMerge(h, v3);
+        h = HashMerge(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+
+    h += size;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= HashRound(0, Load64(p));
+        h = Rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        h ^= Load32(p) * PRIME64_1;
+        h = Rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= *p * PRIME64_5;
+        h = Rotl64(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+/*
+ * cache format
+ */
+
+static const char CACHE_MAGIC[8] = { 'T', 'R', 'C', 'A', 'C', 'H', 'E', '\0' };
+static const uint32_t CACHE_FORMAT_VERSION = 8;
+static const long SECTION_ALIGNMENT = 16;
+
+enum CacheSection
+{
+    SECTION_PALETTE,
+    SECTION_TEXPAGES,
+    SECTION_TEXPAGES16,
+    SECTION_TEXINFOS,
+    SECTION_FILE_TEXINFOS,
+    SECTION_MESHES,
+    SECTION_MESH_POSITIONS,
+    SECTION_MESH_LIGHTATTRIBS,
+    SECTION_MESH_POLY_VERTS,
+    SECTION_MESH_POLY_TEXINFOS,
+    SECTION_FILE_MESHES,
+    SECTION_ANIMATIONS,
+    SECTION_ANIM_STRUCTS,
+    SECTION_ANIM_RANGES,
+    SECTION_ANIM_COMMAND_DATA,
+    SECTION_ANIM_FRAME_DATA,
+    SECTION_MODELS,
+    SECTION_MODEL_NODES,
+    SECTION_STATIC_MESHES,
+    SECTION_SPRITES,
+    SECTION_SPRITE_SEQUENCES,
+    SECTION_SPRITE_SEQUENCE_FRAMES,
+    SECTION_ROOMS,
+    SECTION_ROOM_LIGHTS,
+    SECTION_ROOM_STATIC_MESHES,
+    SECTION_ROOM_STATIC_SPRITES,
+    SECTION_MODEL_OBJECTS,
+    SECTION_SPRITE_OBJECTS,
+
+    NUM_SECTIONS
+};
+
+struct CacheHeader
+{
+    char magic[8];
+    uint32_t format_version;
+    uint32_t level_version;
+    uint64_t layout;
+    uint64_t source_hash;
+    uint32_t num_sections;
+    uint32_t reserved;
+};
+
+struct CacheSectionEntry
+{
+    uint64_t offset, size;
+};
+
+struct CacheMesh
+{
+    uint32_t id, lightmode;
+    uint32_t first_vert, num_verts;
+    uint32_t first_poly, num_polys;
+};
+
+struct CacheModel
+{
+    uint32_t id;
+    tr::handle<tr::animation> animation;
+    uint32_t first_node, num_nodes;
+};
+
+struct CacheSpriteSequence
+{
+    uint32_t id;
+    uint32_t first_frame, num_frames;
+};
+
+struct CacheRoom
+{
+    uint32_t id;
+    glm::vec3 aabb[2];
+    CacheMesh geometry;
+    float ambient_light_intensity;
+    uint32_t first_light, num_lights;
+    uint32_t first_static_mesh, num_static_meshes;
+    uint32_t first_static_sprite, num_static_sprites;
+    uint16_t altroom, flags;
+};
+
+struct CacheModelObject
+{
+    tr::handle<tr::model> model;
+    tr::handle<tr::room> room;
+    glm::mat4 transform;
+    float light_intensity;
+};
+
+// changes whenever a struct that is copied in bulk changes
+static uint64_t CacheLayout()
+{
+    const uint32_t sizes[] = {
+        sizeof(void*), 0x01020304,
+        sizeof(tr::handle<tr::texinfo>),
+        sizeof(tr::palette), sizeof(tr::texpage), sizeof(tr::texpage16), sizeof(tr::texinfo),
+        sizeof(glm::vec3), sizeof(tr::mesh_poly_verts),
+        sizeof(tr::animation), sizeof(tr::anim_struct), sizeof(tr::anim_range),
+        sizeof(tr::model_node), sizeof(tr::static_mesh), sizeof(tr::sprite),
+        sizeof(tr::room_light), sizeof(tr::room_static_mesh), sizeof(tr::room_static_sprite),
+        sizeof(tr::sprite_object),
+        sizeof(CacheMesh), sizeof(CacheModel), sizeof(CacheSpriteSequence),
+        sizeof(CacheRoom), sizeof(CacheModelObject)
+    };
+    return tr::hash64(sizes, sizeof(sizes));
+}
+
+/*
+ * writing
+ */
+
+namespace
+{
+    class CacheWriter
+    {
+    public:
+        template <typename T>
+        uint32_t Put(CacheSection section, const T* data, size_t count)
+        {
+            std::vector<uchar>& bytes = sections[section];
+            uint32_t first = bytes.size() / sizeof(T);
+            bytes.insert(bytes.end(), (const uchar*)data, (const uchar*)(data + count));
+            return first;
+        }
+
+        template <typename T>
+        uint32_t Put(CacheSection section, const std::vector<T>& data)
+        {
+            return Put(section, data.data(), data.size());
+        }
+
+        template <typename T>
+        uint32_t Put(CacheSection section, const tr::span<T>& data)
+        {
+            return Put(section, data.data(), data.size());
+        }
+
+        void Write(FILE* fp, const CacheHeader& header) const;
+
+    private:
+        std::vector<uchar> sections[NUM_SECTIONS];
+    };
+}
+
+void CacheWriter::Write(FILE* fp, const CacheHeader& header) const
+{
+    CacheSectionEntry table[NUM_SECTIONS];
+    uint64_t offset = sizeof(CacheHeader) + sizeof(table);
+    for (int i = 0; i < NUM_SECTIONS; ++i) {
+        offset = (offset + SECTION_ALIGNMENT - 1) & ~(uint64_t)(SECTION_ALIGNMENT - 1);
+        table[i].offset = offset;
+        table[i].size = sections[i].size();
+        offset += sections[i].size();
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 && fwrite(table, sizeof(table), 1, fp) == 1;
+    uint64_t pos = sizeof(CacheHeader) + sizeof(table);
+    static const uchar padding[SECTION_ALIGNMENT] = {};
+    for (int i = 0; ok && i < NUM_SECTIONS; ++i) {
+        ok = fwrite(padding, 1, table[i].offset - pos, fp) == table[i].offset - pos;
+        if (ok && !sections[i].empty())
+            ok = fwrite(sections[i].data(), sections[i].size(), 1, fp) == 1;
+        pos = table[i].offset + table[i].size;
+    }
+
+    if (!ok)
+        throw std::runtime_error("tr::write_level_cache: can't write file");
+}
+
+static CacheMesh PutMesh(CacheWriter* writer, const tr::mesh& mesh)
+{
+    CacheMesh cmesh;
+    cmesh.id = mesh.id;
+    cmesh.lightmode = mesh.lightmode;
+    assert(mesh.lightattribs.size() == mesh.num_verts());
+    cmesh.first_vert = writer->Put(SECTION_MESH_POSITIONS, mesh.positions);
+    writer->Put(SECTION_MESH_LIGHTATTRIBS, mesh.lightattribs);
+    cmesh.num_verts = mesh.num_verts();
+
+    assert(mesh.poly_texinfos.size() == mesh.num_polys());
+    cmesh.first_poly = writer->Put(SECTION_MESH_POLY_VERTS, mesh.poly_verts);
+    writer->Put(SECTION_MESH_POLY_TEXINFOS, mesh.poly_texinfos);
+    cmesh.num_polys = mesh.num_polys();
+
+    return cmesh;
+}
+
+void tr::write_level_cache(const char* filename, const tr::level& level, tr::version version, uint64_t source_hash)
+{
+    if (level.uploaded_data_released())
+        throw std::runtime_error("tr::write_level_cache: the level was released");
+
+    CacheWriter writer;
+
+    // textures
+    writer.Put(SECTION_PALETTE, &level.palette, 1);
+    writer.Put(SECTION_TEXPAGES, level.texpages);
+    writer.Put(SECTION_TEXPAGES16, level.texpages16);
+
+    writer.Put(SECTION_TEXINFOS, level.texinfos);
+    writer.Put(SECTION_FILE_TEXINFOS, level.file_texinfos);
+
+    // meshes
+    for (const tr::mesh& mesh : level.meshes) {
+        CacheMesh cmesh = PutMesh(&writer, mesh);
+        writer.Put(SECTION_MESHES, &cmesh, 1);
+    }
+    writer.Put(SECTION_FILE_MESHES, level.file_meshes);
+
+    // animations
+    writer.Put(SECTION_ANIMATIONS, level.animations);
+    writer.Put(SECTION_ANIM_STRUCTS, level.anim_structs);
+    writer.Put(SECTION_ANIM_RANGES, level.anim_ranges);
+    writer.Put(SECTION_ANIM_COMMAND_DATA, level.anim_command_data);
+    writer.Put(SECTION_ANIM_FRAME_DATA, level.anim_frame_data);
+
+    // models
+    for (const tr::model& model : level.models) {
+        CacheModel cmodel;
+        cmodel.id = model.id;
+        cmodel.animation = model.animation;
+        cmodel.first_node = writer.Put(SECTION_MODEL_NODES, model.nodes);
+        cmodel.num_nodes = model.nodes.size();
+        writer.Put(SECTION_MODELS, &cmodel, 1);
+    }
+
+    // static meshes
+    writer.Put(SECTION_STATIC_MESHES, level.static_meshes);
+
+    // sprites
+    writer.Put(SECTION_SPRITES, level.sprites);
+
+    for (const tr::sprite_sequence& sequence : level.sprite_sequences) {
+        CacheSpriteSequence csequence;
+        csequence.id = sequence.id;
+        csequence.first_frame = writer.Put(SECTION_SPRITE_SEQUENCE_FRAMES, sequence.sprites);
+        csequence.num_frames = sequence.sprites.size();
+        writer.Put(SECTION_SPRITE_SEQUENCES, &csequence, 1);
+    }
+
+    // rooms
+    for (const tr::room& room : level.rooms) {
+        CacheRoom croom;
+        croom.id = room.id;
+        croom.aabb[0] = room.aabb[0];
+        croom.aabb[1] = room.aabb[1];
+        croom.geometry = PutMesh(&writer, room.geometry);
+        croom.ambient_light_intensity = room.ambient_light_intensity;
+
+        croom.first_light = writer.Put(SECTION_ROOM_LIGHTS, room.lights);
+        croom.num_lights = room.lights.size();
+
+        croom.first_static_mesh = writer.Put(SECTION_ROOM_STATIC_MESHES, room.static_meshes);
+        croom.num_static_meshes = room.static_meshes.size();
+
+        croom.first_static_sprite = writer.Put(SECTION_ROOM_STATIC_SPRITES, room.static_sprites);
+        croom.num_static_sprites = room.static_sprites.size();
+
+        croom.altroom = room.altroom;
+        croom.flags = room.flags;
+        writer.Put(SECTION_ROOMS, &croom, 1);
+    }
+
+    // objects
+    for (const tr::model_object& modelobj : level.model_objects) {
+        CacheModelObject cmodelobj;
+        cmodelobj.model = modelobj.model;
+        cmodelobj.room = modelobj.room;
+        cmodelobj.transform = modelobj.transform;
+        cmodelobj.light_intensity = modelobj.light_intensity;
+        writer.Put(SECTION_MODEL_OBJECTS, &cmodelobj, 1);
+    }
+
+    writer.Put(SECTION_SPRITE_OBJECTS, level.sprite_objects);
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.format_version = CACHE_FORMAT_VERSION;
+    header.level_version = version;
+    header.layout = CacheLayout();
+    header.source_hash = source_hash;
+    header.num_sections = NUM_SECTIONS;
+
+    // write to a temporary file first, so a failed write never
+    // leaves a broken cache behind
+    std::string tmp_filename = std::string(filename) + ".tmp";
+    FILE* fp = fopen(tmp_filename.c_str(), "wb");
+    if (!fp)
+        throw std::runtime_error("tr::write_level_cache: can't open file");
+
+    try {
+        writer.Write(fp, header);
+    } catch (...) {
+        fclose(fp);
+        remove(tmp_filename.c_str());
+        throw;
+    }
+
+    if (fclose(fp) != 0 || rename(tmp_filename.c_str(), filename) != 0) {
+        remove(tmp_filename.c_str());
+        throw std::runtime_error("tr::write_level_cache: can't write file");
+    }
+}
+
+/*
+ * reading
+ */
+
+namespace
+{
+    class CacheReader
+    {
+    public:
+        explicit CacheReader(const tr::file_view& file) : file(file) {}
+
+        bool ReadHeader(tr::version version, uint64_t source_hash);
+
+        template <typename T>
+        const T* Get(CacheSection section, size_t* count) const
+        {
+            static_assert(alignof(T) <= (size_t)SECTION_ALIGNMENT, "CacheReader: T is overaligned");
+            const CacheSectionEntry& entry = table[section];
+            if (entry.size % sizeof(T) != 0)
+                throw std::runtime_error("tr::read_level_cache: bad section size");
+            *count = entry.size / sizeof(T);
+            return (const T*)(file.data() + entry.offset);
+        }
+
+        template <typename T>
+        void Get(CacheSection section, std::vector<T>* dest) const
+        {
+            size_t count;
+            const T* data = Get<T>(section, &count);
+            dest->assign(data, data + count);
+        }
+
+        // the section itself, for the spans of the level
+        template <typename T>
+        tr::span<T> View(CacheSection section) const
+        {
+            size_t count;
+            const T* data = Get<T>(section, &count);
+            return tr::span<T>((T*)(file.writable_data() + ((const uchar*)data - file.data())), count);
+        }
+
+    private:
+        const tr::file_view& file;
+        CacheSectionEntry table[NUM_SECTIONS];
+    };
+}
+
+bool CacheReader::ReadHeader(tr::version version, uint64_t source_hash)
+{
+    CacheHeader header;
+    if (file.size() < (long)(sizeof(header) + sizeof(table)))
+        return false;
+    memcpy(&header, file.data(), sizeof(header));
+
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0
+        || header.format_version != CACHE_FORMAT_VERSION
+        || header.level_version != (uint32_t)version
+        || header.layout != CacheLayout()
+        || header.source_hash != source_hash
+        || header.num_sections != NUM_SECTIONS)
+        return false;
+
+    memcpy(table, file.data() + sizeof(header), sizeof(table));
+    for (const CacheSectionEntry& entry : table) {
+        if (entry.offset % SECTION_ALIGNMENT != 0 || entry.offset > (uint64_t)file.size()
+            || entry.size > (uint64_t)file.size() - entry.offset)
+            throw std::runtime_error("tr::read_level_cache: bad section table");
+    }
+
+    return true;
+}
+
+static bool HasTexPages16(tr::version version)
+{
+    switch (version) {
+        case tr::version_tr1: return tr::version_traits<tr::version_tr1>::texpages16;
+        case tr::version_tr2: return tr::version_traits<tr::version_tr2>::texpages16;
+        default: return false;
+    }
+}
+
+// checked ranges can't fail tr::span::subspan()
+template <typename T>
+static tr::span<T> Range(tr::span<T> section, uint32_t first, uint32_t count)
+{
+    if (first > section.size() || count > section.size() - first)
+        throw std::runtime_error("tr::read_level_cache: bad range");
+    return section.subspan(first, count);
+}
+
+// handles are stored as they are, so they only have to be checked,
+// once per section
+template <typename T, typename U>
+static void CheckHandle(tr::handle<T> h, const std::vector<U>& array)
+{
+    if (h.valid() && h.index >= array.size())
+        throw std::runtime_error("tr::read_level_cache: bad handle");
+}
+
+namespace
+{
+    // the sections shared by meshes and room geometry
+    struct CacheGeometry
+    {
+        tr::span<glm::vec3> positions;
+        tr::span<glm::vec3> lightattribs;
+        tr::span<tr::mesh_poly_verts> poly_verts;
+        tr::span<tr::handle<tr::texinfo>> poly_texinfos;
+
+        CacheGeometry(const CacheReader& reader, const tr::level& level);
+    };
+}
+
+CacheGeometry::CacheGeometry(const CacheReader& reader, const tr::level& level)
+{
+    positions = reader.View<glm::vec3>(SECTION_MESH_POSITIONS);
+    lightattribs = reader.View<glm::vec3>(SECTION_MESH_LIGHTATTRIBS);
+    poly_verts = reader.View<tr::mesh_poly_verts>(SECTION_MESH_POLY_VERTS);
+    poly_texinfos = reader.View<tr::handle<tr::texinfo>>(SECTION_MESH_POLY_TEXINFOS);
+    if (lightattribs.size() != positions.size() || poly_texinfos.size() != poly_verts.size())
+        throw std::runtime_error("tr::read_level_cache: bad geometry");
+    for (tr::handle<tr::texinfo> texinfo : poly_texinfos)
+        CheckHandle(texinfo, level.texinfos);
+}
+
+static void GetMesh(const CacheMesh& cmesh, const CacheGeometry& geometry, tr::mesh* mesh)
+{
+    mesh->id = cmesh.id;
+    mesh->lightmode = (tr::mesh_lightmode)cmesh.lightmode;
+    mesh->positions = Range(geometry.positions, cmesh.first_vert, cmesh.num_verts);
+    mesh->lightattribs = Range(geometry.lightattribs, cmesh.first_vert, cmesh.num_verts);
+    mesh->poly_verts = Range(geometry.poly_verts, cmesh.first_poly, cmesh.num_polys);
+    mesh->poly_texinfos = Range(geometry.poly_texinfos, cmesh.first_poly, cmesh.num_polys);
+}
+
+std::unique_ptr<tr::level> tr::read_level_cache(const char* filename, tr::version version, uint64_t source_hash, bool texpages16)
+{
+    FILE* fp = fopen(filename, "rb");
+    if (!fp)
+        return nullptr;
+    fclose(fp);
+
+    // the spans of the level point into the file, which is mapped
+    // copy-on-write since they aren't const
+    std::unique_ptr<tr::file_view> file(new tr::file_view(filename, true));
+    CacheReader reader(*file);
+    if (!reader.ReadHeader(version, source_hash))
+        return nullptr;
+
+    std::unique_ptr<tr::level> level(new tr::level());
+
+    // textures
+    size_t num_palettes;
+    const tr::palette* palette = reader.Get<tr::palette>(SECTION_PALETTE, &num_palettes);
+    if (num_palettes != 1)
+        throw std::runtime_error("tr::read_level_cache: bad palette");
+    level->palette = *palette;
+    reader.Get(SECTION_TEXPAGES, &level->texpages);
+    if (texpages16 && HasTexPages16(version)) {
+        reader.Get(SECTION_TEXPAGES16, &level->texpages16);
+        if (level->texpages16.empty())
+            return nullptr;
+        if (level->texpages16.size() != level->texpages.size())
+            throw std::runtime_error("tr::read_level_cache: bad texpages");
+    }
+    reader.Get(SECTION_TEXINFOS, &level->texinfos);
+    for (const tr::texinfo& texinfo : level->texinfos)
+        CheckHandle(texinfo.texanimchain, level->texinfos);
+    reader.Get(SECTION_FILE_TEXINFOS, &level->file_texinfos);
+    for (tr::handle<tr::texinfo> texinfo : level->file_texinfos)
+        CheckHandle(texinfo, level->texinfos);
+
+    // meshes, room geometry uses the same vertex and polygon sections
+    CacheGeometry geometry(reader, *level);
+    size_t num_meshes;
+    const CacheMesh* cmeshes = reader.Get<CacheMesh>(SECTION_MESHES, &num_meshes);
+    level->meshes.resize(num_meshes);
+    for (size_t i = 0; i < num_meshes; ++i)
+        GetMesh(cmeshes[i], geometry, &level->meshes[i]);
+    reader.Get(SECTION_FILE_MESHES, &level->file_meshes);
+    for (tr::handle<tr::mesh> mesh : level->file_meshes)
+        CheckHandle(mesh, level->meshes);
+
+    // animations
+    reader.Get(SECTION_ANIMATIONS, &level->animations);
+    reader.Get(SECTION_ANIM_STRUCTS, &level->anim_structs);
+    reader.Get(SECTION_ANIM_RANGES, &level->anim_ranges);
+    reader.Get(SECTION_ANIM_COMMAND_DATA, &level->anim_command_data);
+    reader.Get(SECTION_ANIM_FRAME_DATA, &level->anim_frame_data);
+
+    // models
+    tr::span<tr::model_node> nodes = reader.View<tr::model_node>(SECTION_MODEL_NODES);
+    for (const tr::model_node& node : nodes)
+        CheckHandle(node.mesh, level->meshes);
+    size_t num_models;
+    const CacheModel* cmodels = reader.Get<CacheModel>(SECTION_MODELS, &num_models);
+    level->models.resize(num_models);
+    for (size_t i = 0; i < num_models; ++i) {
+        const CacheModel& cmodel = cmodels[i];
+        tr::model& model = level->models[i];
+        model.id = cmodel.id;
+        model.animation = cmodel.animation;
+        CheckHandle(model.animation, level->animations);
+        model.nodes = Range(nodes, cmodel.first_node, cmodel.num_nodes);
+    }
+
+    // static meshes
+    reader.Get(SECTION_STATIC_MESHES, &level->static_meshes);
+    for (const tr::static_mesh& static_mesh : level->static_meshes)
+        CheckHandle(static_mesh.mesh, level->meshes);
+
+    // sprites
+    reader.Get(SECTION_SPRITES, &level->sprites);
+
+    tr::span<tr::handle<tr::sprite>> frames = reader.View<tr::handle<tr::sprite>>(SECTION_SPRITE_SEQUENCE_FRAMES);
+    for (tr::handle<tr::sprite> sprite : frames)
+        CheckHandle(sprite, level->sprites);
+    size_t num_sequences;
+    const CacheSpriteSequence* csequences = reader.Get<CacheSpriteSequence>(SECTION_SPRITE_SEQUENCES, &num_sequences);
+    level->sprite_sequences.resize(num_sequences);
+    for (size_t i = 0; i < num_sequences; ++i) {
+        const CacheSpriteSequence& csequence = csequences[i];
+        tr::sprite_sequence& sequence = level->sprite_sequences[i];
+        sequence.id = csequence.id;
+        sequence.sprites = Range(frames, csequence.first_frame, csequence.num_frames);
+    }
+
+    // rooms
+    tr::span<tr::room_light> lights = reader.View<tr::room_light>(SECTION_ROOM_LIGHTS);
+    tr::span<tr::room_static_mesh> static_meshes = reader.View<tr::room_static_mesh>(SECTION_ROOM_STATIC_MESHES);
+    for (const tr::room_static_mesh& static_mesh : static_meshes)
+        CheckHandle(static_mesh.mesh, level->meshes);
+    tr::span<tr::room_static_sprite> static_sprites = reader.View<tr::room_static_sprite>(SECTION_ROOM_STATIC_SPRITES);
+    for (const tr::room_static_sprite& static_sprite : static_sprites)
+        CheckHandle(static_sprite.sprite, level->sprites);
+    size_t num_rooms;
+    const CacheRoom* crooms = reader.Get<CacheRoom>(SECTION_ROOMS, &num_rooms);
+    level->rooms.resize(num_rooms);
+    for (size_t i = 0; i < num_rooms; ++i) {
+        const CacheRoom& croom = crooms[i];
+        tr::room& room = level->rooms[i];
+        room.id = croom.id;
+        room.aabb[0] = croom.aabb[0];
+        room.aabb[1] = croom.aabb[1];
+        GetMesh(croom.geometry, geometry, &room.geometry);
+        room.ambient_light_intensity = croom.ambient_light_intensity;
+        room.lights = Range(lights, croom.first_light, croom.num_lights);
+        room.static_meshes = Range(static_meshes, croom.first_static_mesh, croom.num_static_meshes);
+        room.static_sprites = Range(static_sprites, croom.first_static_sprite, croom.num_static_sprites);
+        room.altroom = croom.altroom;
+        room.flags = croom.flags;
+    }
+
+    // objects
+    size_t num_model_objects;
+    const CacheModelObject* cmodelobjs = reader.Get<CacheModelObject>(SECTION_MODEL_OBJECTS, &num_model_objects);
+    level->model_objects.reserve(num_model_objects);
+    for (size_t i = 0; i < num_model_objects; ++i) {
+        const CacheModelObject& cmodelobj = cmodelobjs[i];
+        CheckHandle(cmodelobj.model, level->models);
+        CheckHandle(cmodelobj.room, level->rooms);
+        if (!cmodelobj.model.valid())
+            throw std::runtime_error("tr::read_level_cache: bad model");
+
+        tr::model_object modelobj(level.get(), cmodelobj.model);
+        modelobj.room = cmodelobj.room;
+        modelobj.transform = cmodelobj.transform;
+        modelobj.light_intensity = cmodelobj.light_intensity;
+        level->model_objects.push_back(modelobj);
+    }
+
+    reader.Get(SECTION_SPRITE_OBJECTS, &level->sprite_objects);
+    for (const tr::sprite_object& spriteobj : level->sprite_objects) {
+        CheckHandle(spriteobj.sequence, level->sprite_sequences);
+        CheckHandle(spriteobj.room, level->rooms);
+    }
+
+    level->build_id_index();
+    level->cache_files.push_back(std::move(file));
+
+    return level;
+}
@@ -0,0 +1,54 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TR_CACHE_H
+#define TR_CACHE_H
+
+#include "tr_types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace tr
+{
+    // xxhash64 of a block of memory
+    uint64_t hash64(const void* data, size_t size, uint64_t seed = 0);
+
+    /*
+     * level cache
+     *
+     * A fully resolved tr::level, stored as a table of sections. Every
+     * array of the level is one section, along with the tr::handle
+     * references inside it. The level's own arrays are copied in bulk and
+     * its spans point into the mapped file, see tr::level::cache_files, so
+     * reading only checks each section once.
+     *
+     * The cache is only valid for the source file with the same hash and
+     * for the build with the same struct layout.
+     */
+
+    // returns nullptr if the cache doesn't exist or doesn't match; the
+    // 16-bit texpages are optional, a cache without them doesn't match
+    // if they are wanted and otherwise they are left out
+    std::unique_ptr<tr::level> read_level_cache(const char* filename, tr::version version, uint64_t source_hash, bool texpages16);
+
+    // throws std::runtime_error
+    void write_level_cache(const char* filename, const tr::level& level, tr::version version, uint64_t source_hash);
+}
+
+#endif
@@ -0,0 +1,256 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tr_decode.h"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TR_HAVE_AVX2
+#endif
+
+static_assert(sizeof(glm::vec3) == 12, "glm::vec3 must be tightly packed");
+
+#ifdef TR_HAVE_AVX2
+static bool HaveAVX2()
+{
+    static const bool result = __builtin_cpu_supports("avx2");
+    return result;
+}
+#endif
+
+/*
+ * scalar
+ */
+
+static void DecodeI16Scalar(const uchar* src, long count, float* dest)
+{
+    for (long i = 0; i < count; ++i)
+        dest[i] = (int16_t)tr::load16(src + i * 2);
+}
+
+static void DecodeIntensitiesScalar(const uchar* src, long count, float* dest)
+{
+    for (long i = 0; i < count; ++i)
+        dest[i] = 1.0f - (int16_t)tr::load16(src + i * 2) / 8191.0f;
+}
+
+static void ExpandPaletteScalar(const uchar* src, long count, const uchar (*palette)[4], uchar (*dest)[4])
+{
+    for (long i = 0; i < count; ++i)
+        memcpy(dest[i], palette[src[i]], 4);
+}
+
+#if !defined(__SSE2__)
+static void DecodeRoomVerticesScalar(const uchar* src, long count, long stride, glm::vec3 offset,
+                                     glm::vec3* positions, glm::vec3* lightattribs)
+{
+    for (long i = 0; i < count; ++i) {
+        const uchar* record = src + i * stride;
+        glm::vec3 position(
+            (int16_t)tr::load16(record + 0),
+            (int16_t)tr::load16(record + 2),
+            (int16_t)tr::load16(record + 4)
+        );
+        uint16_t lighting = tr::load16(record + 6);
+        positions[i] = position + offset;
+        lightattribs[i] = glm::vec3(1.0f - lighting / 8191.0f);
+    }
+}
+#endif
+
+/*
+ * SSE2
+ */
+
+#if defined(__SSE2__)
+
+static void DecodeI16SSE2(const uchar* src, long count, float* dest)
+{
+    long i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dest + i, _mm_cvtepi32_ps(lo));
+        _mm_storeu_ps(dest + i + 4, _mm_cvtepi32_ps(hi));
+    }
+    DecodeI16Scalar(src + i * 2, count - i, dest + i);
+}
+
+static void DecodeIntensitiesSSE2(const uchar* src, long count, float* dest)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 max_lighting = _mm_set1_ps(8191.0f);
+
+    long i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+        __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+        _mm_storeu_ps(dest + i, _mm_sub_ps(one, _mm_div_ps(lo, max_lighting)));
+        _mm_storeu_ps(dest + i + 4, _mm_sub_ps(one, _mm_div_ps(hi, max_lighting)));
+    }
+    DecodeIntensitiesScalar(src + i * 2, count - i, dest + i);
+}
+
+static void DecodeRoomVerticesSSE2(const uchar* src, long count, long stride, glm::vec3 offset,
+                                   glm::vec3* positions, glm::vec3* lightattribs)
+{
+    // one vertex per iteration: x, y, z, lighting in the four lanes
+    const __m128i lighting_mask_i = _mm_set_epi32(-1, 0, 0, 0);
+    const __m128 offset4 = _mm_set_ps(0.0f, offset.z, offset.y, offset.x);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 max_lighting = _mm_set1_ps(8191.0f);
+
+    for (long i = 0; i < count; ++i) {
+        __m128i v = _mm_loadl_epi64((const __m128i*)(src + i * stride));
+        __m128i s = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i u = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+        __m128i fields = _mm_or_si128(_mm_andnot_si128(lighting_mask_i, s), _mm_and_si128(lighting_mask_i, u));
+        __m128 f = _mm_cvtepi32_ps(fields);
+
+        __m128 lighting = _mm_shuffle_ps(f, f, _MM_SHUFFLE(3, 3, 3, 3));
+        __m128 intensity = _mm_sub_ps(one, _mm_div_ps(lighting, max_lighting));
+        __m128 position = _mm_add_ps(f, offset4);
+
+        // the fourth lane spills into the next vertex, which is written
+        // after this one; the last vertex is stored without it
+        if (i + 1 < count) {
+            _mm_storeu_ps(&positions[i].x, position);
+            _mm_storeu_ps(&lightattribs[i].x, intensity);
+        } else {
+            _mm_storel_pi((__m64*)&positions[i].x, position);
+            _mm_store_ss(&positions[i].z, _mm_movehl_ps(position, position));
+            _mm_storel_pi((__m64*)&lightattribs[i].x, intensity);
+            _mm_store_ss(&lightattribs[i].z, intensity);
+        }
+    }
+}
+
+#endif
+
+/*
+ * AVX2
+ */
+
+#ifdef TR_HAVE_AVX2
+
+__attribute__((target("avx2")))
+static void DecodeI16AVX2(const uchar* src, long count, float* dest)
+{
+    long i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i * 2));
+        __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+        __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+        _mm256_storeu_ps(dest + i, lo);
+        _mm256_storeu_ps(dest + i + 8, hi);
+    }
+    DecodeI16Scalar(src + i * 2, count - i, dest + i);
+}
+
+__attribute__((target("avx2")))
+static void DecodeIntensitiesAVX2(const uchar* src, long count, float* dest)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 max_lighting = _mm256_set1_ps(8191.0f);
+
+    long i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i * 2));
+        __m256 lo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+        __m256 hi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+        _mm256_storeu_ps(dest + i, _mm256_sub_ps(one, _mm256_div_ps(lo, max_lighting)));
+        _mm256_storeu_ps(dest + i + 8, _mm256_sub_ps(one, _mm256_div_ps(hi, max_lighting)));
+    }
+    DecodeIntensitiesScalar(src + i * 2, count - i, dest + i);
+}
+
+__attribute__((target("avx2")))
+static void ExpandPaletteAVX2(const uchar* src, long count, const uchar (*palette)[4], uchar (*dest)[4])
+{
+    // eight gathers of one color each
+    long i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i indices = _mm_loadu_si128((const __m128i*)(src + i));
+        __m256i lo = _mm256_cvtepu8_epi32(indices);
+        __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(indices, 8));
+        _mm256_storeu_si256((__m256i*)dest[i], _mm256_i32gather_epi32((const int*)palette, lo, 4));
+        _mm256_storeu_si256((__m256i*)dest[i + 8], _mm256_i32gather_epi32((const int*)palette, hi, 4));
+    }
+    ExpandPaletteScalar(src + i, count - i, palette, dest + i);
+}
+
+#endif
+
+/*
+ * dispatch
+ */
+
+void tr::decode_i16(const uchar* src, long count, float* dest)
+{
+#ifdef TR_HAVE_AVX2
+    if (HaveAVX2())
+        return DecodeI16AVX2(src, count, dest);
+#endif
+#if defined(__SSE2__)
+    DecodeI16SSE2(src, count, dest);
+#else
+    DecodeI16Scalar(src, count, dest);
+#endif
+}
+
+void tr::decode_intensities(const uchar* src, long count, float* dest)
+{
+#ifdef TR_HAVE_AVX2
+    if (HaveAVX2())
+        return DecodeIntensitiesAVX2(src, count, dest);
+#endif
+#if defined(__SSE2__)
+    DecodeIntensitiesSSE2(src, count, dest);
+#else
+    DecodeIntensitiesScalar(src, count, dest);
+#endif
+}
+
+void tr::decode_room_vertices(const uchar* src, long count, long stride, glm::vec3 offset,
+                              glm::vec3* positions, glm::vec3* lightattribs)
+{
+    assert(stride >= 8);
+#if defined(__SSE2__)
+    DecodeRoomVerticesSSE2(src, count, stride, offset, positions, lightattribs);
+#else
+    DecodeRoomVerticesScalar(src, count, stride, offset, positions, lightattribs);
+#endif
+}
+
+void tr::expand_palette(const uchar* src, long count, const uchar (*palette)[4], uchar (*dest)[4])
+{
+#ifdef TR_HAVE_AVX2
+    if (HaveAVX2())
+        return ExpandPaletteAVX2(src, count, palette, dest);
+#endif
+    ExpandPaletteScalar(src, count, palette, dest);
+}
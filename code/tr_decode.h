@@ -0,0 +1,56 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TR_DECODE_H
+#define TR_DECODE_H
+
+#include "tr_types.h"
+
+#include <stdint.h>
+
+/*
+ * Bulk decoders for the fixed-stride arrays of level files.
+ *
+ * Sources point straight into the file data, so they are little-endian
+ * and not necessarily aligned. The SSE2/AVX2 paths are picked at runtime,
+ * all paths produce bit-identical results.
+ */
+
+namespace tr
+{
+    inline uint16_t load16(const uchar* src)
+    {
+        return src[0] | (src[1] << 8);
+    }
+
+    // dest[i] = (int16_t)src[i]
+    void decode_i16(const uchar* src, long count, float* dest);
+
+    // dest[i] = 1 - (int16_t)src[i] / 8191
+    void decode_intensities(const uchar* src, long count, float* dest);
+
+    // records of stride bytes, starting with int16 x, y, z and uint16 lighting;
+    // offset is added to the positions
+    void decode_room_vertices(const uchar* src, long count, long stride, glm::vec3 offset,
+                              glm::vec3* positions, glm::vec3* lightattribs);
+
+    // dest[i] = palette[src[i]], four bytes per color
+    void expand_palette(const uchar* src, long count, const uchar (*palette)[4], uchar (*dest)[4]);
+}
+
+#endif
@@ -18,734 +18,898 @@
 
 #include "tr_loader.h"
 
+#include "tr_cache.h"
+#include "tr_decode.h"
+#include "tr_streamer.h"
+#include "tr_task_graph.h"
+#include "tr_thread_pool.h"
+
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <assert.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 
+#include <algorithm>
 #include <stdexcept>
+#include <string>
+#include <unordered_map>
 
-static int8_t read8(FILE* fp)
+// throws std::out_of_range, like std::vector::at()
+template <typename T>
+static tr::handle<T> checked_handle(const std::vector<T>& array, size_t idx)
 {
-    int8_t value = 0;
-    fread(&value, sizeof(value), 1, fp);
-    return value;
+    if (idx >= array.size())
+        throw std::out_of_range("checked_handle");
+    return tr::handle<T>(idx);
 }
 
-static int16_t read16(FILE* fp)
+// polygon records are vertex indices followed by a texinfo index;
+// writes the polygons starting at first and returns the index after them
+static long decode_polygons(const uchar* data, long count, int num_vertices,
+                            uint16_t texinfo_mask, long texinfo_base,
+                            tr::level* level, tr::mesh* mesh, long first)
 {
-    int16_t value = 0;
-    fread(&value, sizeof(value), 1, fp);
-    return value;
+    long record_size = (num_vertices + 1) * 2;
+    for (long i = 0; i < count; ++i) {
+        const uchar* record = data + i * record_size;
+        tr::mesh_poly_verts& poly_verts = mesh->poly_verts[first + i];
+        for (int j = 0; j < num_vertices; ++j)
+            poly_verts.verts[j] = tr::load16(record + j * 2);
+        for (int j = num_vertices; j < 4; ++j)
+            poly_verts.verts[j] = -1;
+        mesh->poly_texinfos[first + i] = level->file_texinfos.at((tr::load16(record + num_vertices * 2) & texinfo_mask) + texinfo_base);
+    }
+    return first + count;
 }
 
-static int32_t read32(FILE* fp)
+/*
+ * tr::load_report
+ */
+
+void tr::load_report::fill(const tr::task_graph& graph, const tr::level& level)
 {
-    int32_t value = 0;
-    fread(&value, sizeof(value), 1, fp);
-    return value;
+    phases = graph.timings();
+    critical_path.clear();
+    for (tr::task_graph::task_id id : graph.critical_path())
+        critical_path.push_back(phases[id].name);
+    total_time = graph.total_time();
+
+    duplicate_texinfos = level.file_texinfos.size() - level.texinfos.size();
+    duplicate_meshes = level.file_meshes.size() - level.meshes.size();
+    duplicate_bytes = duplicate_texinfos * sizeof(tr::texinfo);
+    for (tr::handle<tr::mesh> mesh : level.file_meshes)
+        duplicate_bytes += level.get(mesh).bytes();
+    for (const tr::mesh& mesh : level.meshes)
+        duplicate_bytes -= mesh.bytes();
+
+    // see tr::level::load()
+    peak_bytes = 0;
+}
+
+void tr::load_report::print(FILE* fp) const
+{
+    fprintf(fp, "load report: %.2f ms\n", total_time);
+    for (const tr::task_graph::timing& phase : phases) {
+        bool critical = std::find(critical_path.begin(), critical_path.end(), phase.name) != critical_path.end();
+        fprintf(fp, "  %-18s start %8.2f ms  time %8.2f ms%s\n", phase.name.c_str(), phase.start, phase.duration, critical ? "  *" : "");
+    }
+
+    fprintf(fp, "critical path:");
+    for (size_t i = 0; i < critical_path.size(); ++i)
+        fprintf(fp, "%s%s", (i == 0) ? " " : " -> ", critical_path[i].c_str());
+    fprintf(fp, "\n");
+
+    fprintf(fp, "duplicates: %ld texinfos, %ld meshes, %zu bytes saved\n",
+            duplicate_texinfos, duplicate_meshes, duplicate_bytes);
+
+    fprintf(fp, "peak memory: %zu bytes (%.2f MB)\n", peak_bytes, peak_bytes / (1024.0 * 1024.0));
 }
 
 /*
  * tr::room_loader
  */
 
-void tr::room_loader::load(FILE* fp, tr::level* level, tr::version version, tr::room_loader::params params)
+void tr::room_loader::init(const tr::reader& reader, tr::level* level, tr::version version, const tr::room_loader::params& params, bool evictable)
 {
-    this->fp = fp;
+    this->reader = reader;
+    this->level = level;
     this->version = version;
+    this->room_offsets = params.room_offsets;
 
     // static meshes
-    fseek(fp, params.static_meshes_offset, SEEK_SET);
-    std::vector<d_static_mesh> static_meshes(params.num_static_meshes);
-    for (long i = 0; i < params.num_static_meshes; ++i)
-        read_static_mesh(&static_meshes[i]);
+    tr::reader in = reader;
+    in.seek(params.static_meshes_offset);
+    level->static_meshes.resize(params.num_static_meshes);
+    for (long i = 0; i < params.num_static_meshes; ++i) {
+        d_static_mesh dsm;
+        read_static_mesh(in, &dsm);
+        level->static_meshes[i].id = dsm.id;
+        level->static_meshes[i].mesh = level->file_meshes.at(dsm.mesh);
+    }
+    level->static_mesh_ids.build(level->static_meshes);
 
     // rooms
-    fseek(fp, params.rooms_offset, SEEK_SET);
-    level->rooms.resize(params.num_rooms);
-    for (long room_idx = 0; room_idx < params.num_rooms; ++room_idx) {
-        tr::room& room = level->rooms[room_idx];
-        room.id = room_idx;
-
-        d_room droom;
-        read_room(&droom);
-
-        room.geometry.id = room.id;
-        room.geometry.lightmode = tr::mesh_lightmode_internal;
-
-        // vertices
-        room.geometry.verts.reserve(droom.vertices.size());
-        for (size_t i = 0; i < droom.vertices.size(); ++i) {
-            room.geometry.verts.emplace_back();
-            tr::mesh_vert& vert = room.geometry.verts.back();
-            d_room_vertex& drv = droom.vertices[i];
-            vert.position = drv.position + glm::vec3(droom.x, 0.0f, droom.z);
-            vert.lightattrib = glm::vec3(1.0f - drv.lighting1 / 8191.0f);
-        }
-
-        // polygons
-        room.geometry.polys.reserve(droom.quads.size() + droom.tris.size());
-        for (size_t i = 0; i < droom.quads.size(); ++i) {
-            room.geometry.polys.emplace_back();
-            tr::mesh_poly& poly = room.geometry.polys.back();
-            d_room_polygon& drp = droom.quads[i];
-            for (int j = 0; j < 4; ++j)
-                poly.verts[j] = drp.vertices[j];
-            poly.texinfo = &level->texinfos.at((drp.texinfo & 0x7FFF) + 256);
-        }
-        for (size_t i = 0; i < droom.tris.size(); ++i) {
-            room.geometry.polys.emplace_back();
-            tr::mesh_poly& poly = room.geometry.polys.back();
-            d_room_polygon& drp = droom.tris[i];
-            for (int j = 0; j < 4; ++j)
-                poly.verts[j] = drp.vertices[j];
-            poly.texinfo = &level->texinfos.at((drp.texinfo & 0x7FFF) + 256);
-        }
-
-        // static sprites
-        room.static_sprites.reserve(droom.static_sprites.size());
-        for (size_t i = 0; i < droom.static_sprites.size(); ++i) {
-            room.static_sprites.emplace_back();
-            tr::room_static_sprite& static_sprite = room.static_sprites.back();
-            d_room_static_sprite& drss = droom.static_sprites[i];
-            static_sprite.position = droom.vertices[drss.vertex].position + glm::vec3(droom.x, 0.0f, droom.z);
-            static_sprite.light_intensity = 1.0f - droom.vertices[drss.vertex].lighting1 / 8191.0f;
-            static_sprite.sprite = &level->sprites.at(drss.sprite);
-        }
-
-        // ambient light intensity
-        room.ambient_light_intensity = 1.0f - droom.ambient_lighting1 / 8191.0f;
-
-        // lights
-        room.lights.reserve(droom.lights.size());
-        for (size_t i = 0; i < droom.lights.size(); ++i) {
-            room.lights.emplace_back();
-            tr::room_light& light = room.lights.back();
-            d_room_light& drl = droom.lights[i];
-            light.position = drl.position;
-            light.intensity = (drl.intensity1 >= 0) ? (1.0f - drl.intensity1 / 8191.0f) : 0.0f; // WTF?
-            light.falloff = drl.falloff1;
-        }
+    level->rooms.resize(room_offsets.size());
+    room_sizes.resize(room_offsets.size());
+    for (size_t i = 0; i < room_offsets.size(); ++i)
+        index_room(i);
+
+    // evictable rooms can't share the level arena, give each one
+    // an arena with a single block that fits the whole room
+    room_arenas.clear();
+    if (evictable) {
+        for (size_t i = 0; i < room_offsets.size(); ++i)
+            room_arenas.emplace_back(new tr::arena(room_sizes[i] + 5 * 16));
+    }
+}
 
-        // static meshes
-        room.static_meshes.reserve(droom.static_meshes.size());
-        for (size_t i = 0; i < droom.static_meshes.size(); ++i) {
-            room.static_meshes.emplace_back();
-            tr::room_static_mesh& static_mesh = room.static_meshes.back();
-            d_room_static_mesh& drsm = droom.static_meshes[i];
-
-            static_mesh.transform = glm::translate(glm::mat4(), drsm.position) *
-                glm::rotate(glm::mat4(), ((drsm.orientation >> 14) & 0x03) * glm::pi<float>() / 2.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-            static_mesh.light_intensity = 1.0f - drsm.lighting1 / 8191.0f;
-
-            static_mesh.mesh = nullptr;
-            for (const d_static_mesh& dsm : static_meshes) {
-                if (dsm.id == drsm.static_mesh_id) {
-                    static_mesh.mesh = &level->meshes.at(dsm.mesh);
-                    break;
-                }
-            }
-            assert(static_mesh.mesh);
+void tr::room_loader::load(const tr::reader& reader, tr::level* level, tr::version version, const tr::room_loader::params& params)
+{
+    init(reader, level, version, params, false);
+    tr::thread_pool::global().parallel_for(room_offsets.size(), [this](long room_idx) {
+        load_room(room_idx);
+    });
+}
 
-            if (static_mesh.mesh->lightmode == tr::mesh_lightmode_external) {
-                fprintf(stderr, "[WARNING] tr::room_loader::load(): static mesh references externally-lit mesh\n");
-                room.static_meshes.pop_back();
-            }
-        }
+void tr::room_loader::load_room(long room_idx)
+{
+    switch (version) {
+        case tr::version_tr1:
+            load_room<tr::version_tr1>(room_idx);
+            break;
+        case tr::version_tr2:
+            load_room<tr::version_tr2>(room_idx);
+            break;
+        default:
+            throw std::logic_error("tr::room_loader: bad version");
+    }
+}
 
-        room.altroom = droom.alternate_room;
-        room.flags = droom.flags;
+void tr::room_loader::index_room(long room_idx)
+{
+    switch (version) {
+        case tr::version_tr1:
+            index_room<tr::version_tr1>(room_idx);
+            break;
+        case tr::version_tr2:
+            index_room<tr::version_tr2>(room_idx);
+            break;
+        default:
+            throw std::logic_error("tr::room_loader: bad version");
     }
 }
 
-void tr::room_loader::read_room_vertex(tr::room_loader::d_room_vertex* room_vertex)
+template <tr::version V>
+void tr::room_loader::index_room(long room_idx)
 {
-    room_vertex->position.x = read16(fp);
-    room_vertex->position.y = read16(fp);
-    room_vertex->position.z = read16(fp);
+    tr::reader in = reader;
+    in.seek(room_offsets[room_idx]);
+
+    d_room droom;
+    read_room<V>(in, &droom);
+
+    tr::room& room = level->rooms[room_idx];
+    room.id = room_idx;
+    room.aabb[0] = glm::vec3(droom.x, droom.y_top, droom.z);
+    room.aabb[1] = glm::vec3(droom.x + droom.num_x_sectors * 1024.0f, droom.y_bottom, droom.z + droom.num_z_sectors * 1024.0f);
+    room.ambient_light_intensity = 1.0f - droom.ambient_lighting1 / 8191.0f;
+    room.altroom = droom.alternate_room;
+    room.flags = droom.flags;
+
+    room_sizes[room_idx] =
+        droom.num_vertices * 2 * sizeof(glm::vec3) +
+        (droom.num_quads + droom.num_tris) * (sizeof(tr::mesh_poly_verts) + sizeof(tr::handle<tr::texinfo>)) +
+        droom.static_sprites.size() * sizeof(tr::room_static_sprite) +
+        droom.lights.size() * sizeof(tr::room_light) +
+        droom.static_meshes.size() * sizeof(tr::room_static_mesh);
+}
 
-    room_vertex->lighting1 = read16(fp);
+template <tr::version V>
+void tr::room_loader::load_room(long room_idx)
+{
+    tr::reader in = reader;
+    in.seek(room_offsets[room_idx]);
+
+    tr::room& room = level->rooms[room_idx];
+
+    d_room droom;
+    read_room<V>(in, &droom);
+
+    tr::arena& arena = room_arenas.empty() ? level->arena : *room_arenas[room_idx];
+    tr::arena& geometry_arena = room_arenas.empty() ? level->geometry : *room_arenas[room_idx];
+
+    room.geometry.id = room.id;
+    room.geometry.lightmode = tr::mesh_lightmode_internal;
+
+    // vertices
+    room.geometry.positions = geometry_arena.allocate<glm::vec3>(droom.num_vertices);
+    room.geometry.lightattribs = geometry_arena.allocate<glm::vec3>(droom.num_vertices);
+    tr::decode_room_vertices(droom.vertices, droom.num_vertices, tr::version_traits<V>::room_vertex_size,
+                             glm::vec3(droom.x, 0.0f, droom.z),
+                             room.geometry.positions.data(), room.geometry.lightattribs.data());
+
+    // polygons
+    room.geometry.poly_verts = geometry_arena.allocate<tr::mesh_poly_verts>(droom.num_quads + droom.num_tris);
+    room.geometry.poly_texinfos = geometry_arena.allocate<tr::handle<tr::texinfo>>(droom.num_quads + droom.num_tris);
+    long num_polys = 0;
+    num_polys = decode_polygons(droom.quads, droom.num_quads, 4, 0x7FFF, 256, level, &room.geometry, num_polys);
+    num_polys = decode_polygons(droom.tris, droom.num_tris, 3, 0x7FFF, 256, level, &room.geometry, num_polys);
+
+    // static sprites
+    room.static_sprites = arena.allocate<tr::room_static_sprite>(droom.static_sprites.size());
+    for (size_t i = 0; i < droom.static_sprites.size(); ++i) {
+        tr::room_static_sprite& static_sprite = room.static_sprites[i];
+        d_room_static_sprite& drss = droom.static_sprites[i];
+        static_sprite.position = room.geometry.positions.at(drss.vertex);
+        static_sprite.light_intensity = room.geometry.lightattribs.at(drss.vertex).x;
+        static_sprite.sprite = checked_handle(level->sprites, drss.sprite);
+    }
 
-    if (version == tr::version_tr2) {
-        room_vertex->attributes = read16(fp);
-        room_vertex->lighting2 = read16(fp);
-    } else {
-        room_vertex->attributes = 0;
-        room_vertex->lighting2 = 0;
+    // lights
+    room.lights = arena.allocate<tr::room_light>(droom.lights.size());
+    for (size_t i = 0; i < droom.lights.size(); ++i) {
+        tr::room_light& light = room.lights[i];
+        d_room_light& drl = droom.lights[i];
+        light.position = drl.position;
+        light.intensity = (drl.intensity1 >= 0) ? (1.0f - drl.intensity1 / 8191.0f) : 0.0f; // WTF?
+        light.falloff = drl.falloff1;
     }
+
+    // static meshes
+    tr::span<tr::room_static_mesh> static_meshes = arena.allocate<tr::room_static_mesh>(droom.static_meshes.size());
+    size_t num_static_meshes = 0;
+    for (size_t i = 0; i < droom.static_meshes.size(); ++i) {
+        tr::room_static_mesh& static_mesh = static_meshes[num_static_meshes];
+        d_room_static_mesh& drsm = droom.static_meshes[i];
+
+        static_mesh.transform = glm::translate(glm::mat4(), drsm.position) *
+            glm::rotate(glm::mat4(), ((drsm.orientation >> 14) & 0x03) * glm::pi<float>() / 2.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+        static_mesh.light_intensity = 1.0f - drsm.lighting1 / 8191.0f;
+
+        tr::handle<tr::static_mesh> sm = level->find_static_mesh(drsm.static_mesh_id);
+        assert(sm.valid());
+        static_mesh.mesh = level->get(sm).mesh;
+
+        if (level->get(static_mesh.mesh).lightmode == tr::mesh_lightmode_external)
+            fprintf(stderr, "[WARNING] tr::room_loader::load(): static mesh references externally-lit mesh\n");
+        else
+            ++num_static_meshes;
+    }
+    room.static_meshes = static_meshes.first(num_static_meshes);
 }
 
-void tr::room_loader::read_room_polygon(tr::room_loader::d_room_polygon* room_polygon, int num_vertices)
+void tr::room_loader::evict_room(long room_idx)
 {
-    assert(num_vertices == 3 || num_vertices == 4);
-
-    for (int i = 0; i < num_vertices; ++i)
-        room_polygon->vertices[i] = read16(fp);
-    for (int i = num_vertices; i < 4; ++i)
-        room_polygon->vertices[i] = -1;
-
-    room_polygon->texinfo = read16(fp);
+    assert(!room_arenas.empty());
+
+    tr::room& room = level->rooms[room_idx];
+    room.geometry.positions = tr::span<glm::vec3>();
+    room.geometry.lightattribs = tr::span<glm::vec3>();
+    room.geometry.poly_verts = tr::span<tr::mesh_poly_verts>();
+    room.geometry.poly_texinfos = tr::span<tr::handle<tr::texinfo>>();
+    room.lights = tr::span<tr::room_light>();
+    room.static_meshes = tr::span<tr::room_static_mesh>();
+    room.static_sprites = tr::span<tr::room_static_sprite>();
+
+    room_arenas[room_idx]->clear();
 }
 
-void tr::room_loader::read_room_static_sprite(tr::room_loader::d_room_static_sprite* room_static_sprite)
+void tr::room_loader::read_room_static_sprite(tr::reader& in, tr::room_loader::d_room_static_sprite* room_static_sprite)
 {
-    room_static_sprite->vertex = read16(fp);
-    room_static_sprite->sprite = read16(fp);
+    room_static_sprite->vertex = in.read16();
+    room_static_sprite->sprite = in.read16();
 }
 
-void tr::room_loader::read_room_light(tr::room_loader::d_room_light* room_light)
+template <tr::version V>
+void tr::room_loader::read_room_light(tr::reader& in, tr::room_loader::d_room_light* room_light)
 {
-    room_light->position.x = read32(fp);
-    room_light->position.y = read32(fp);
-    room_light->position.z = read32(fp);
+    room_light->position.x = in.read32();
+    room_light->position.y = in.read32();
+    room_light->position.z = in.read32();
 
-    room_light->intensity1 = read16(fp);
-    if (version == tr::version_tr2)
-        room_light->intensity2 = read16(fp);
-    else
-        room_light->intensity2 = 0;
+    room_light->intensity1 = in.read16();
+    room_light->intensity2 = tr::version_traits<V>::dual_lighting ? in.read16() : 0;
 
-    room_light->falloff1 = read32(fp);
-    if (version == tr::version_tr2)
-        room_light->falloff2 = read32(fp);
-    else
-        room_light->falloff2 = 0;
+    room_light->falloff1 = in.read32();
+    room_light->falloff2 = tr::version_traits<V>::dual_lighting ? in.read32() : 0;
 }
 
-void tr::room_loader::read_room_static_mesh(tr::room_loader::d_room_static_mesh* room_static_mesh)
+template <tr::version V>
+void tr::room_loader::read_room_static_mesh(tr::reader& in, tr::room_loader::d_room_static_mesh* room_static_mesh)
 {
-    room_static_mesh->position.x = read32(fp);
-    room_static_mesh->position.y = read32(fp);
-    room_static_mesh->position.z = read32(fp);
+    room_static_mesh->position.x = in.read32();
+    room_static_mesh->position.y = in.read32();
+    room_static_mesh->position.z = in.read32();
 
-    room_static_mesh->orientation = read16(fp);
+    room_static_mesh->orientation = in.read16();
 
-    room_static_mesh->lighting1 = read16(fp);
-    if (version == tr::version_tr2)
-        room_static_mesh->lighting2 = read16(fp);
-    else
-        room_static_mesh->lighting2 = 0;
+    room_static_mesh->lighting1 = in.read16();
+    room_static_mesh->lighting2 = tr::version_traits<V>::dual_lighting ? in.read16() : 0;
 
-    room_static_mesh->static_mesh_id = read16(fp);
+    room_static_mesh->static_mesh_id = in.read16();
 }
 
-void tr::room_loader::read_room(tr::room_loader::d_room* room)
+template <tr::version V>
+void tr::room_loader::read_room(tr::reader& in, tr::room_loader::d_room* room)
 {
     // room info
-    room->x = read32(fp);
-    room->z = read32(fp);
-    room->y_bottom = read32(fp);
-    room->y_top = read32(fp);
+    room->x = in.read32();
+    room->z = in.read32();
+    room->y_bottom = in.read32();
+    room->y_top = in.read32();
 
     // begin room data
-    uint32_t num_room_data_words = read32(fp);
-    long room_data_offset = ftell(fp);
+    uint32_t num_room_data_words = in.read32();
+    long room_data_offset = in.tell();
 
     // room data: vertices
-    uint16_t num_vertices = read16(fp);
-    room->vertices.resize(num_vertices);
-    for (uint16_t i = 0; i < num_vertices; ++i)
-        read_room_vertex(&room->vertices[i]);
+    room->num_vertices = in.read16();
+    room->vertices = in.read_block(room->num_vertices * tr::version_traits<V>::room_vertex_size);
 
     // room data: quads
-    uint16_t num_quads = read16(fp);
-    room->quads.resize(num_quads);
-    for (uint16_t i = 0; i < num_quads; ++i)
-        read_room_polygon(&room->quads[i], 4);
+    room->num_quads = in.read16();
+    room->quads = in.read_block(room->num_quads * 10);
 
     // room data: tris
-    uint16_t num_tris = read16(fp);
-    room->tris.resize(num_tris);
-    for (uint16_t i = 0; i < num_tris; ++i)
-        read_room_polygon(&room->tris[i], 3);
+    room->num_tris = in.read16();
+    room->tris = in.read_block(room->num_tris * 8);
 
     // room data: static sprites
-    uint16_t num_static_sprites = read16(fp);
+    uint16_t num_static_sprites = in.read16();
     room->static_sprites.resize(num_static_sprites);
     for (uint16_t i = 0; i < num_static_sprites; ++i)
-        read_room_static_sprite(&room->static_sprites[i]);
+        read_room_static_sprite(in, &room->static_sprites[i]);
 
     // end room data
-    fseek(fp, room_data_offset + num_room_data_words * 2, SEEK_SET);
+    in.seek(room_data_offset + num_room_data_words * 2);
 
     // portals
-    uint16_t num_portals = read16(fp);
-    fseek(fp, num_portals * 32, SEEK_CUR);
+    uint16_t num_portals = in.read16();
+    in.skip(num_portals * 32);
 
     // sectors
-    uint16_t num_z_sectors = read16(fp);
-    uint16_t num_x_sectors = read16(fp);
-    fseek(fp, num_z_sectors * num_x_sectors * 8, SEEK_CUR);
+    room->num_z_sectors = in.read16();
+    room->num_x_sectors = in.read16();
+    in.skip(room->num_z_sectors * room->num_x_sectors * 8);
 
     // ambient lighting
-    room->ambient_lighting1 = read16(fp);
-    if (version == tr::version_tr2) {
-        room->ambient_lighting2 = read16(fp);
-        room->light_mode = read16(fp);
-    } else {
-        room->ambient_lighting2 = 0;
-        room->light_mode = 0;
-    }
+    room->ambient_lighting1 = in.read16();
+    room->ambient_lighting2 = tr::version_traits<V>::dual_lighting ? in.read16() : 0;
+    room->light_mode = tr::version_traits<V>::room_light_mode ? in.read16() : 0;
 
     // lights
-    uint16_t num_lights = read16(fp);
+    uint16_t num_lights = in.read16();
     room->lights.resize(num_lights);
     for (uint16_t i = 0; i < num_lights; ++i)
-        read_room_light(&room->lights[i]);
+        read_room_light<V>(in, &room->lights[i]);
 
     // static meshes
-    uint16_t num_static_meshes = read16(fp);
+    uint16_t num_static_meshes = in.read16();
     room->static_meshes.resize(num_static_meshes);
     for (uint16_t i = 0; i < num_static_meshes; ++i)
-        read_room_static_mesh(&room->static_meshes[i]);
+        read_room_static_mesh<V>(in, &room->static_meshes[i]);
 
-    room->alternate_room = read16(fp);
-    room->flags = read16(fp);
+    room->alternate_room = in.read16();
+    room->flags = in.read16();
 }
 
-void tr::room_loader::read_static_mesh(tr::room_loader::d_static_mesh* static_mesh)
+void tr::room_loader::read_static_mesh(tr::reader& in, tr::room_loader::d_static_mesh* static_mesh)
 {
-    static_mesh->id = read32(fp);
-    static_mesh->mesh = read16(fp);
+    static_mesh->id = in.read32();
+    static_mesh->mesh = in.read16();
 
     for (int i = 0; i < 2; ++i) {
         for (int j = 0; j < 2; ++j) {
-            static_mesh->aabb[i][j].x = read16(fp);
-            static_mesh->aabb[i][j].y = read16(fp);
-            static_mesh->aabb[i][j].z = read16(fp);
+            static_mesh->aabb[i][j].x = in.read16();
+            static_mesh->aabb[i][j].y = in.read16();
+            static_mesh->aabb[i][j].z = in.read16();
         }
     }
 
-    static_mesh->flags = read16(fp);
+    static_mesh->flags = in.read16();
 }
 
 /*
  * tr::loader
  */
 
-std::unique_ptr<tr::level> tr::loader::load(const char* filename, tr::version version)
+std::unique_ptr<tr::level> tr::loader::load(const char* filename, tr::version version, bool texpages16, tr::load_report* report)
+{
+    return load_level(filename, version, false, texpages16, report);
+}
+
+std::unique_ptr<tr::level> tr::loader::load_streaming(const char* filename, tr::version version, bool texpages16, tr::load_report* report)
 {
-    tr::loader loader(filename, version);
+    return load_level(filename, version, true, texpages16, report);
+}
 
+std::unique_ptr<tr::level> tr::loader::load_level(const char* filename, tr::version version, bool stream_rooms, bool texpages16, tr::load_report* report)
+{
     switch (version) {
         case tr::version_tr1:
-            loader.build_tr1_level_directory();
-            break;
+            return load_level<tr::version_tr1>(filename, stream_rooms, texpages16, report);
         case tr::version_tr2:
-            loader.build_tr2_level_directory();
-            break;
+            return load_level<tr::version_tr2>(filename, stream_rooms, texpages16, report);
         default:
             throw std::logic_error("tr::loader: bad version");
     }
+}
+
+template <tr::version V>
+std::unique_ptr<tr::level> tr::loader::load_level(const char* filename, bool stream_rooms, bool texpages16, tr::load_report* report)
+{
+    tr::loader loader(filename, V, stream_rooms, texpages16);
 
-    loader.load_palette();
-    loader.load_texpages();
-    loader.load_texinfos();
-    loader.load_meshes();
-    loader.load_animations();
-    loader.load_models();
-    loader.load_sprites();
-    loader.load_sprite_sequences();
-    loader.load_rooms();
-    loader.load_objects();
+    tr::task_graph graph;
+
+    tr::task_graph::task_id directory = graph.add("directory", [&loader]() {
+        if (V == tr::version_tr1)
+            loader.build_tr1_level_directory();
+        else
+            loader.build_tr2_level_directory();
+    });
+
+    // NOTE: phases that run at the same time never touch the same
+    // containers, and pointers are only taken into finished ones
+    tr::task_graph::task_id palette = graph.add("palette", [&loader]() { loader.load_palette(); }, {directory});
+    graph.add("texpages", [&loader]() { loader.load_texpages(); }, {palette});
+    if (tr::version_traits<V>::texpages16 && texpages16)
+        graph.add("texpages16", [&loader]() { loader.load_texpages16(); }, {palette});
+    tr::task_graph::task_id texinfos = graph.add("texinfos", [&loader]() { loader.load_texinfos(); }, {palette});
+    tr::task_graph::task_id meshes = graph.add("meshes", [&loader]() { loader.load_meshes(); }, {texinfos});
+    tr::task_graph::task_id animations = graph.add("animations", [&loader]() { loader.load_animations<V>(); }, {directory});
+    tr::task_graph::task_id models = graph.add("models", [&loader]() { loader.load_models(); }, {meshes, animations});
+    tr::task_graph::task_id sprites = graph.add("sprites", [&loader]() { loader.load_sprites(); }, {directory});
+    tr::task_graph::task_id sprite_sequences = graph.add("sprite_sequences", [&loader]() { loader.load_sprite_sequences(); }, {sprites});
+    tr::task_graph::task_id rooms = graph.add("rooms", [&loader]() { loader.load_rooms(); }, {texinfos, meshes, sprites});
+    graph.add("objects", [&loader]() { loader.load_objects<V>(); }, {models, sprite_sequences, rooms});
+    graph.add("hash", [&loader]() { loader.level->source_hash = tr::hash64(loader.file.data(), loader.file.size()); });
+
+    graph.run(tr::thread_pool::global());
+
+    if (report)
+        report->fill(graph, *loader.level);
 
     return std::move(loader.level);
 }
 
-tr::loader::loader(const char* filename, tr::version version) :
-    fp(nullptr), version(version)
+std::unique_ptr<tr::level> tr::loader::load_cached(const char* filename, tr::version version, bool texpages16, tr::load_report* report)
+{
+    std::string cache_filename = std::string(filename) + ".cache";
+    uint64_t source_hash = 0;
+    std::unique_ptr<tr::level> level;
+
+    tr::task_graph graph;
+    tr::task_graph::task_id hash = graph.add("hash", [filename, &source_hash]() {
+        tr::file_view file(filename);
+        source_hash = tr::hash64(file.data(), file.size());
+    });
+    graph.add("cache", [&cache_filename, version, texpages16, &source_hash, &level]() {
+        try {
+            level = tr::read_level_cache(cache_filename.c_str(), version, source_hash, texpages16);
+        } catch (const std::exception& e) {
+            fprintf(stderr, "[WARNING] tr::loader::load_cached(): %s\n", e.what());
+        }
+    }, {hash});
+    graph.run(tr::thread_pool::global());
+
+    if (level) {
+        level->source_hash = source_hash;
+        if (report)
+            report->fill(graph, *level);
+        return level;
+    }
+
+    level = load(filename, version, texpages16, report);
+
+    try {
+        tr::write_level_cache(cache_filename.c_str(), *level, version, source_hash);
+    } catch (const std::exception& e) {
+        fprintf(stderr, "[WARNING] tr::loader::load_cached(): %s\n", e.what());
+    }
+
+    return level;
+}
+
+tr::loader::loader(const char* filename, tr::version version, bool stream_rooms, bool texpages16) :
+    filename(filename), file(filename), version(version), stream_rooms(stream_rooms), texpages16(texpages16)
 {
-    if (!(fp = fopen(filename, "rb")))
-        throw std::runtime_error("tr::loader: can't open file");
     level.reset(new tr::level());
 }
 
 tr::loader::~loader()
 {
-    fclose(fp);
+}
+
+tr::reader tr::loader::reader_at(long offset) const
+{
+    tr::reader reader(file);
+    reader.seek(offset);
+    return reader;
 }
 
 void tr::loader::build_tr1_level_directory()
 {
-    fseek(fp, 0, SEEK_SET);
+    tr::reader in(file);
 
     // version
-    fseek(fp, 4, SEEK_CUR);
+    in.skip(4);
 
     // texpages
-    num_texpages = read32(fp);
-    texpages8_offset = ftell(fp);
-    fseek(fp, num_texpages * 256 * 256, SEEK_CUR);
+    num_texpages = in.read32();
+    texpages8_offset = in.tell();
+    in.skip(num_texpages * 256 * 256);
     texpages16_offset = -1;
 
     // unused
-    fseek(fp, 4, SEEK_CUR);
+    in.skip(4);
 
     // rooms
-    num_rooms = read16(fp);
-    rooms_offset = ftell(fp);
+    num_rooms = in.read16();
+    rooms_offset = in.tell();
+    room_offsets.resize(num_rooms);
     for (long i = 0; i < num_rooms; ++i) {
+        room_offsets[i] = in.tell();
+
         // room info
-        fseek(fp, 16, SEEK_CUR);
+        in.skip(16);
 
         // room data
-        uint32_t num_room_data_words = read32(fp);
-        fseek(fp, num_room_data_words * 2, SEEK_CUR);
+        uint32_t num_room_data_words = in.read32();
+        in.skip(num_room_data_words * 2);
 
         // portals
-        uint16_t num_portals = read16(fp);
-        fseek(fp, num_portals * 32, SEEK_CUR);
+        uint16_t num_portals = in.read16();
+        in.skip(num_portals * 32);
 
         // sectors
-        uint16_t num_z_sectors = read16(fp);
-        uint16_t num_x_sectors = read16(fp);
-        fseek(fp, num_z_sectors * num_x_sectors * 8, SEEK_CUR);
+        uint16_t num_z_sectors = in.read16();
+        uint16_t num_x_sectors = in.read16();
+        in.skip(num_z_sectors * num_x_sectors * 8);
 
         // ambient light intensity
-        fseek(fp, 2, SEEK_CUR);
+        in.skip(2);
 
         // room lights
-        uint16_t num_room_lights = read16(fp);
-        fseek(fp, num_room_lights * 18, SEEK_CUR);
+        uint16_t num_room_lights = in.read16();
+        in.skip(num_room_lights * 18);
 
         // room static meshes
-        uint16_t num_room_static_meshes = read16(fp);
-        fseek(fp, num_room_static_meshes * 18, SEEK_CUR);
+        uint16_t num_room_static_meshes = in.read16();
+        in.skip(num_room_static_meshes * 18);
 
         // alternate room
-        fseek(fp, 2, SEEK_CUR);
+        in.skip(2);
 
         // flags
-        fseek(fp, 2, SEEK_CUR);
+        in.skip(2);
     }
 
     // floor data
-    uint32_t num_floor_data_words = read32(fp);
-    fseek(fp, num_floor_data_words * 2, SEEK_CUR);
+    uint32_t num_floor_data_words = in.read32();
+    in.skip(num_floor_data_words * 2);
 
     // mesh data
-    num_mesh_data_words = read32(fp);
-    mesh_data_offset = ftell(fp);
-    fseek(fp, num_mesh_data_words * 2, SEEK_CUR);
+    num_mesh_data_words = in.read32();
+    mesh_data_offset = in.tell();
+    in.skip(num_mesh_data_words * 2);
 
     // mesh pointers
-    num_mesh_pointers = read32(fp);
-    mesh_pointers_offset = ftell(fp);
-    fseek(fp, num_mesh_pointers * 4, SEEK_CUR);
+    num_mesh_pointers = in.read32();
+    mesh_pointers_offset = in.tell();
+    in.skip(num_mesh_pointers * 4);
 
     // animations
-    num_animations = read32(fp);
-    animations_offset = ftell(fp);
-    fseek(fp, num_animations * 32, SEEK_CUR);
+    num_animations = in.read32();
+    animations_offset = in.tell();
+    in.skip(num_animations * 32);
 
     // anim structs
-    num_anim_structs = read32(fp);
-    anim_structs_offset = ftell(fp);
-    fseek(fp, num_anim_structs * 6, SEEK_CUR);
+    num_anim_structs = in.read32();
+    anim_structs_offset = in.tell();
+    in.skip(num_anim_structs * 6);
 
     // anim ranges
-    num_anim_ranges = read32(fp);
-    anim_ranges_offset = ftell(fp);
-    fseek(fp, num_anim_ranges * 8, SEEK_CUR);
+    num_anim_ranges = in.read32();
+    anim_ranges_offset = in.tell();
+    in.skip(num_anim_ranges * 8);
 
     // anim command data
-    num_anim_command_data_words = read32(fp);
-    anim_command_data_offset = ftell(fp);
-    fseek(fp, num_anim_command_data_words * 2, SEEK_CUR);
+    num_anim_command_data_words = in.read32();
+    anim_command_data_offset = in.tell();
+    in.skip(num_anim_command_data_words * 2);
 
     // bone data
-    num_bone_data_dwords = read32(fp);
-    bone_data_offset = ftell(fp);
-    fseek(fp, num_bone_data_dwords * 4, SEEK_CUR);
+    num_bone_data_dwords = in.read32();
+    bone_data_offset = in.tell();
+    in.skip(num_bone_data_dwords * 4);
 
     // anim frame data
-    num_anim_frame_data_words = read32(fp);
-    anim_frame_data_offset = ftell(fp);
-    fseek(fp, num_anim_frame_data_words * 2, SEEK_CUR);
+    num_anim_frame_data_words = in.read32();
+    anim_frame_data_offset = in.tell();
+    in.skip(num_anim_frame_data_words * 2);
 
     // models
-    num_models = read32(fp);
-    models_offset = ftell(fp);
-    fseek(fp, num_models * 18, SEEK_CUR);
+    num_models = in.read32();
+    models_offset = in.tell();
+    in.skip(num_models * 18);
 
     // static meshes
-    num_static_meshes = read32(fp);
-    static_meshes_offset = ftell(fp);
-    fseek(fp, num_static_meshes * 32, SEEK_CUR);
+    num_static_meshes = in.read32();
+    static_meshes_offset = in.tell();
+    in.skip(num_static_meshes * 32);
 
     // texinfos
-    num_texinfos = read32(fp);
-    texinfos_offset = ftell(fp);
-    fseek(fp, num_texinfos * 20, SEEK_CUR);
+    num_texinfos = in.read32();
+    texinfos_offset = in.tell();
+    in.skip(num_texinfos * 20);
 
     // sprites
-    num_sprites = read32(fp);
-    sprites_offset = ftell(fp);
-    fseek(fp, num_sprites * 16, SEEK_CUR);
+    num_sprites = in.read32();
+    sprites_offset = in.tell();
+    in.skip(num_sprites * 16);
 
     // sprite sequences
-    num_sprite_sequences = read32(fp);
-    sprite_sequences_offset = ftell(fp);
-    fseek(fp, num_sprite_sequences * 8, SEEK_CUR);
+    num_sprite_sequences = in.read32();
+    sprite_sequences_offset = in.tell();
+    in.skip(num_sprite_sequences * 8);
 
     // cameras
-    uint32_t num_cameras = read32(fp);
-    fseek(fp, num_cameras * 16, SEEK_CUR);
+    uint32_t num_cameras = in.read32();
+    in.skip(num_cameras * 16);
 
     // sound sources
-    uint32_t num_sound_sources = read32(fp);
-    fseek(fp, num_sound_sources * 16, SEEK_CUR);
+    uint32_t num_sound_sources = in.read32();
+    in.skip(num_sound_sources * 16);
 
     // boxes
-    uint32_t num_boxes = read32(fp);
-    fseek(fp, num_boxes * 20, SEEK_CUR);
+    uint32_t num_boxes = in.read32();
+    in.skip(num_boxes * 20);
 
     // overlap data
-    uint32_t num_overlap_data_words = read32(fp);
-    fseek(fp, num_overlap_data_words * 2, SEEK_CUR);
+    uint32_t num_overlap_data_words = in.read32();
+    in.skip(num_overlap_data_words * 2);
 
     // zones
-    fseek(fp, num_boxes * 12, SEEK_CUR);
+    in.skip(num_boxes * 12);
 
     // texanimchain data
-    num_texanimchain_data_words = read32(fp);
-    texanimchain_data_offset = ftell(fp);
-    fseek(fp, num_texanimchain_data_words * 2, SEEK_CUR);
+    num_texanimchain_data_words = in.read32();
+    texanimchain_data_offset = in.tell();
+    in.skip(num_texanimchain_data_words * 2);
 
     // objects
-    num_objects = read32(fp);
-    objects_offset = ftell(fp);
-    fseek(fp, num_objects * 22, SEEK_CUR);
+    num_objects = in.read32();
+    objects_offset = in.tell();
+    in.skip(num_objects * 22);
 
     // light map
-    fseek(fp, 32 * 256, SEEK_CUR);
+    in.skip(32 * 256);
 
     // palette
-    palette8_offset = ftell(fp);
-    fseek(fp, 256 * 3, SEEK_CUR);
+    palette8_offset = in.tell();
+    in.skip(256 * 3);
     palette16_offset = -1;
 
     // cinematic frames
-    uint16_t num_cinematic_frames = read16(fp);
-    fseek(fp, num_cinematic_frames * 16, SEEK_CUR);
+    uint16_t num_cinematic_frames = in.read16();
+    in.skip(num_cinematic_frames * 16);
 
     // demo data
-    uint16_t num_demo_data_bytes = read16(fp);
-    fseek(fp, num_demo_data_bytes, SEEK_CUR);
+    uint16_t num_demo_data_bytes = in.read16();
+    in.skip(num_demo_data_bytes);
 
     // sound map
-    fseek(fp, 256 * 2, SEEK_CUR);
+    in.skip(256 * 2);
 
     // sound details
-    uint32_t num_sound_details = read32(fp);
-    fseek(fp, num_sound_details * 8, SEEK_CUR);
+    uint32_t num_sound_details = in.read32();
+    in.skip(num_sound_details * 8);
 
     // samples
-    uint32_t num_samples = read32(fp);
-    fseek(fp, num_samples, SEEK_CUR);
+    uint32_t num_samples = in.read32();
+    in.skip(num_samples);
 
     // sample indices
-    uint32_t num_sample_indices = read32(fp);
-    fseek(fp, num_sample_indices * 4, SEEK_CUR);
+    uint32_t num_sample_indices = in.read32();
+    in.skip(num_sample_indices * 4);
 
     // sanity check
-    long end_offset = ftell(fp);
-    fseek(fp, 0, SEEK_END);
-    long real_end_offset = ftell(fp);
-    assert(!feof(fp) && !ferror(fp) && (end_offset == real_end_offset));
+    assert(in.tell() == in.size());
 }
 
 void tr::loader::build_tr2_level_directory()
 {
-    fseek(fp, 0, SEEK_SET);
+    tr::reader in(file);
 
     // version
-    fseek(fp, 4, SEEK_CUR);
+    in.skip(4);
 
     // palette
-    palette8_offset = ftell(fp);
-    fseek(fp, 256 * 3, SEEK_CUR);
-    palette16_offset = ftell(fp);
-    fseek(fp, 256 * 4, SEEK_CUR);
+    palette8_offset = in.tell();
+    in.skip(256 * 3);
+    palette16_offset = in.tell();
+    in.skip(256 * 4);
 
     // texpages
-    num_texpages = read32(fp);
-    texpages8_offset = ftell(fp);
-    fseek(fp, num_texpages * 256 * 256, SEEK_CUR);
-    texpages16_offset = ftell(fp);
-    fseek(fp, num_texpages * 256 * 256 * 2, SEEK_CUR);
+    num_texpages = in.read32();
+    texpages8_offset = in.tell();
+    in.skip(num_texpages * 256 * 256);
+    texpages16_offset = in.tell();
+    in.skip(num_texpages * 256 * 256 * 2);
 
     // unused
-    fseek(fp, 4, SEEK_CUR);
+    in.skip(4);
 
     // rooms
-    num_rooms = read16(fp);
-    rooms_offset = ftell(fp);
+    num_rooms = in.read16();
+    rooms_offset = in.tell();
+    room_offsets.resize(num_rooms);
     for (long i = 0; i < num_rooms; ++i) {
+        room_offsets[i] = in.tell();
+
         // room info
-        fseek(fp, 16, SEEK_CUR);
+        in.skip(16);
 
         // room data
-        uint32_t num_room_data_words = read32(fp);
-        fseek(fp, num_room_data_words * 2, SEEK_CUR);
+        uint32_t num_room_data_words = in.read32();
+        in.skip(num_room_data_words * 2);
 
         // portals
-        uint16_t num_portals = read16(fp);
-        fseek(fp, num_portals * 32, SEEK_CUR);
+        uint16_t num_portals = in.read16();
+        in.skip(num_portals * 32);
 
         // sectors
-        uint16_t num_z_sectors = read16(fp);
-        uint16_t num_x_sectors = read16(fp);
-        fseek(fp, num_z_sectors * num_x_sectors * 8, SEEK_CUR);
+        uint16_t num_z_sectors = in.read16();
+        uint16_t num_x_sectors = in.read16();
+        in.skip(num_z_sectors * num_x_sectors * 8);
 
         // ambient light intensity
-        fseek(fp, 2, SEEK_CUR);
+        in.skip(2);
         // ambient light intensity 2
-        fseek(fp, 2, SEEK_CUR);
+        in.skip(2);
         // light mode
-        fseek(fp, 2, SEEK_CUR);
+        in.skip(2);
 
         // room lights
-        uint16_t num_room_lights = read16(fp);
-        fseek(fp, num_room_lights * 24, SEEK_CUR);
+        uint16_t num_room_lights = in.read16();
+        in.skip(num_room_lights * 24);
 
         // room static meshes
-        uint16_t num_room_static_meshes = read16(fp);
-        fseek(fp, num_room_static_meshes * 20, SEEK_CUR);
+        uint16_t num_room_static_meshes = in.read16();
+        in.skip(num_room_static_meshes * 20);
 
         // alternate room
-        fseek(fp, 2, SEEK_CUR);
+        in.skip(2);
 
         // flags
-        fseek(fp, 2, SEEK_CUR);
+        in.skip(2);
     }
 
     // floor data
-    uint32_t num_floor_data_words = read32(fp);
-    fseek(fp, num_floor_data_words * 2, SEEK_CUR);
+    uint32_t num_floor_data_words = in.read32();
+    in.skip(num_floor_data_words * 2);
 
     // mesh data
-    num_mesh_data_words = read32(fp);
-    mesh_data_offset = ftell(fp);
-    fseek(fp, num_mesh_data_words * 2, SEEK_CUR);
+    num_mesh_data_words = in.read32();
+    mesh_data_offset = in.tell();
+    in.skip(num_mesh_data_words * 2);
 
     // mesh pointers
-    num_mesh_pointers = read32(fp);
-    mesh_pointers_offset = ftell(fp);
-    fseek(fp, num_mesh_pointers * 4, SEEK_CUR);
+    num_mesh_pointers = in.read32();
+    mesh_pointers_offset = in.tell();
+    in.skip(num_mesh_pointers * 4);
 
     // animations
-    num_animations = read32(fp);
-    animations_offset = ftell(fp);
-    fseek(fp, num_animations * 32, SEEK_CUR);
+    num_animations = in.read32();
+    animations_offset = in.tell();
+    in.skip(num_animations * 32);
 
     // anim structs
-    num_anim_structs = read32(fp);
-    anim_structs_offset = ftell(fp);
-    fseek(fp, num_anim_structs * 6, SEEK_CUR);
+    num_anim_structs = in.read32();
+    anim_structs_offset = in.tell();
+    in.skip(num_anim_structs * 6);
 
     // anim ranges
-    num_anim_ranges = read32(fp);
-    anim_ranges_offset = ftell(fp);
-    fseek(fp, num_anim_ranges * 8, SEEK_CUR);
+    num_anim_ranges = in.read32();
+    anim_ranges_offset = in.tell();
+    in.skip(num_anim_ranges * 8);
 
     // anim command data
-    num_anim_command_data_words = read32(fp);
-    anim_command_data_offset = ftell(fp);
-    fseek(fp, num_anim_command_data_words * 2, SEEK_CUR);
+    num_anim_command_data_words = in.read32();
+    anim_command_data_offset = in.tell();
+    in.skip(num_anim_command_data_words * 2);
 
     // bones
-    num_bone_data_dwords = read32(fp);
-    bone_data_offset = ftell(fp);
-    fseek(fp, num_bone_data_dwords * 4, SEEK_CUR);
+    num_bone_data_dwords = in.read32();
+    bone_data_offset = in.tell();
+    in.skip(num_bone_data_dwords * 4);
 
     // anim frame data
-    num_anim_frame_data_words = read32(fp);
-    anim_frame_data_offset = ftell(fp);
-    fseek(fp, num_anim_frame_data_words * 2, SEEK_CUR);
+    num_anim_frame_data_words = in.read32();
+    anim_frame_data_offset = in.tell();
+    in.skip(num_anim_frame_data_words * 2);
 
     // models
-    num_models = read32(fp);
-    models_offset = ftell(fp);
-    fseek(fp, num_models * 18, SEEK_CUR);
+    num_models = in.read32();
+    models_offset = in.tell();
+    in.skip(num_models * 18);
 
     // static meshes
-    num_static_meshes = read32(fp);
-    static_meshes_offset = ftell(fp);
-    fseek(fp, num_static_meshes * 32, SEEK_CUR);
+    num_static_meshes = in.read32();
+    static_meshes_offset = in.tell();
+    in.skip(num_static_meshes * 32);
 
     // texinfos
-    num_texinfos = read32(fp);
-    texinfos_offset = ftell(fp);
-    fseek(fp, num_texinfos * 20, SEEK_CUR);
+    num_texinfos = in.read32();
+    texinfos_offset = in.tell();
+    in.skip(num_texinfos * 20);
 
     // sprites
-    num_sprites = read32(fp);
-    sprites_offset = ftell(fp);
-    fseek(fp, num_sprites * 16, SEEK_CUR);
+    num_sprites = in.read32();
+    sprites_offset = in.tell();
+    in.skip(num_sprites * 16);
 
     // sprite sequences
-    num_sprite_sequences = read32(fp);
-    sprite_sequences_offset = ftell(fp);
-    fseek(fp, num_sprite_sequences * 8, SEEK_CUR);
+    num_sprite_sequences = in.read32();
+    sprite_sequences_offset = in.tell();
+    in.skip(num_sprite_sequences * 8);
 
     // cameras
-    uint32_t num_cameras = read32(fp);
-    fseek(fp, num_cameras * 16, SEEK_CUR);
+    uint32_t num_cameras = in.read32();
+    in.skip(num_cameras * 16);
 
     // sound sources
-    uint32_t num_sound_sources = read32(fp);
-    fseek(fp, num_sound_sources * 16, SEEK_CUR);
+    uint32_t num_sound_sources = in.read32();
+    in.skip(num_sound_sources * 16);
 
     // boxes
-    uint32_t num_boxes = read32(fp);
-    fseek(fp, num_boxes * 8, SEEK_CUR);
+    uint32_t num_boxes = in.read32();
+    in.skip(num_boxes * 8);
 
     // overlap data
-    uint32_t num_overlap_data_words = read32(fp);
-    fseek(fp, num_overlap_data_words * 2, SEEK_CUR);
+    uint32_t num_overlap_data_words = in.read32();
+    in.skip(num_overlap_data_words * 2);
 
     // zones
-    fseek(fp, num_boxes * 20, SEEK_CUR);
+    in.skip(num_boxes * 20);
 
     // texanimchain data
-    num_texanimchain_data_words = read32(fp);
-    texanimchain_data_offset = ftell(fp);
-    fseek(fp, num_texanimchain_data_words * 2, SEEK_CUR);
+    num_texanimchain_data_words = in.read32();
+    texanimchain_data_offset = in.tell();
+    in.skip(num_texanimchain_data_words * 2);
 
     // objects
-    num_objects = read32(fp);
-    objects_offset = ftell(fp);
-    fseek(fp, num_objects * 24, SEEK_CUR);
+    num_objects = in.read32();
+    objects_offset = in.tell();
+    in.skip(num_objects * 24);
 
     // light map
-    fseek(fp, 32 * 256, SEEK_CUR);
+    in.skip(32 * 256);
 
     // cinematic frames
-    uint16_t num_cinematic_frames = read16(fp);
-    fseek(fp, num_cinematic_frames * 16, SEEK_CUR);
+    uint16_t num_cinematic_frames = in.read16();
+    in.skip(num_cinematic_frames * 16);
 
     // demo data
-    uint16_t num_demo_data_bytes = read16(fp);
-    fseek(fp, num_demo_data_bytes, SEEK_CUR);
+    uint16_t num_demo_data_bytes = in.read16();
+    in.skip(num_demo_data_bytes);
 
     // sound map
-    fseek(fp, 370 * 2, SEEK_CUR);
+    in.skip(370 * 2);
 
     // sound details
-    uint32_t num_sound_details = read32(fp);
-    fseek(fp, num_sound_details * 8, SEEK_CUR);
+    uint32_t num_sound_details = in.read32();
+    in.skip(num_sound_details * 8);
 
     // sample indices
-    uint32_t num_sample_indices = read32(fp);
-    fseek(fp, num_sample_indices * 4, SEEK_CUR);
+    uint32_t num_sample_indices = in.read32();
+    in.skip(num_sample_indices * 4);
 
     // sanity check
-    long end_offset = ftell(fp);
-    fseek(fp, 0, SEEK_END);
-    long real_end_offset = ftell(fp);
-    assert(!feof(fp) && !ferror(fp) && (end_offset == real_end_offset));
+    assert(in.tell() == in.size());
 }
 
 long tr::loader::emit_anim_frame_tr1(const std::vector<uint16_t>& rawdata, long offset)
@@ -794,20 +958,22 @@ void tr::loader::load_palette()
     assert(level->texinfos.empty());
 
     uint8_t palette[256][3];
-    fseek(fp, palette8_offset, SEEK_SET);
-    fread(palette, 3, 256, fp);
+    tr::reader in = reader_at(palette8_offset);
+    in.read_bytes(palette, 256 * 3);
 
     level->texpages.emplace_back();
     tr::texpage& palpage = level->texpages.at(0);
+    memset(palpage.pixels, 0, sizeof(palpage.pixels));
     for (int i = 0; i < 256; ++i) {
-        palpage.pixels[0][i][0] = palette[i][0] * 4;
-        palpage.pixels[0][i][1] = palette[i][1] * 4;
-        palpage.pixels[0][i][2] = palette[i][2] * 4;
-        palpage.pixels[0][i][3] = (i == 0) ? 0 : 255;
+        level->palette.colors[i][0] = palette[i][0] * 4;
+        level->palette.colors[i][1] = palette[i][1] * 4;
+        level->palette.colors[i][2] = palette[i][2] * 4;
+        level->palette.colors[i][3] = (i == 0) ? 0 : 255;
+        palpage.pixels[0][i] = i;
 
         level->texinfos.emplace_back();
         tr::texinfo& palinfo = level->texinfos.at(i);
-        palinfo.texanimchain = nullptr;
+        palinfo.texanimchain = tr::handle<tr::texinfo>();
         palinfo.texalphamode = 0;
         palinfo.texpage = 0;
         for (int j = 0; j < 4; ++j) {
@@ -824,181 +990,267 @@ void tr::loader::load_texpages()
 {
     assert(level->texpages.size() == 1);
 
-    fseek(fp, texpages8_offset, SEEK_SET);
-    for (int p = 0; p < num_texpages; ++p) {
-        uint8_t pixels[256][256];
-        fread(pixels, 1, 256 * 256, fp);
-        level->texpages.emplace_back();
-        tr::texpage& texpage = level->texpages.back();
-        for (int i = 0; i < 256; ++i) {
-            for (int j = 0; j < 256; ++j) {
-                uchar* color = level->texpages.front().pixels[0][pixels[i][j]];
-                std::copy(color, color + 4, texpage.pixels[i][j]);
-            }
-        }
+    tr::reader in = reader_at(texpages8_offset);
+    const uchar* pixels = in.read_block(num_texpages * 256 * 256);
+
+    // pages stay indexed, the palette is applied when they are drawn
+    level->texpages.resize(1 + num_texpages);
+    if (num_texpages > 0)
+        memcpy(level->texpages[1].pixels, pixels, num_texpages * 256 * 256);
+}
+
+void tr::loader::load_texpages16()
+{
+    assert(texpages16_offset >= 0);
+    assert(level->texpages16.empty());
+
+    // the palette page, see load_palette()
+    level->texpages16.resize(1 + num_texpages);
+    tr::texpage16& palpage = level->texpages16[0];
+    memset(palpage.pixels, 0, sizeof(palpage.pixels));
+    for (int i = 0; i < 256; ++i) {
+        const uchar* color = level->palette.colors[i];
+        palpage.pixels[0][i] = ((i == 0) ? 0 : 0x8000) | (color[0] >> 3) << 10 | (color[1] >> 3) << 5 | (color[2] >> 3);
     }
+
+    // already in the format the renderer uploads
+    tr::reader in = reader_at(texpages16_offset);
+    if (num_texpages > 0)
+        in.read16_array(level->texpages16[1].pixels[0], num_texpages * 256 * 256);
 }
 
 void tr::loader::load_texinfos()
 {
     assert(level->texinfos.size() == 256);
 
-    fseek(fp, texinfos_offset, SEEK_SET);
+    tr::reader in = reader_at(texinfos_offset);
     for (long i = 0; i < num_texinfos; ++i) {
         level->texinfos.emplace_back();
         tr::texinfo& texinfo = level->texinfos.back();
-        texinfo.texanimchain = nullptr;
-        texinfo.texalphamode = (uint16_t)read16(fp);
-        texinfo.texpage = (uint16_t)read16(fp) + 1;
+        texinfo.texanimchain = tr::handle<tr::texinfo>();
+        texinfo.texalphamode = (uint16_t)in.read16();
+        texinfo.texpage = (uint16_t)in.read16() + 1;
         for (int j = 0; j < 4; ++j) {
-            fseek(fp, 1, SEEK_CUR);
-            texinfo.texcoord[j][0] = ((uint8_t)read8(fp) + 0.5f) / 256.0f;
-            fseek(fp, 1, SEEK_CUR);
-            texinfo.texcoord[j][1] = ((uint8_t)read8(fp) + 0.5f) / 256.0f;
+            in.skip(1);
+            texinfo.texcoord[j][0] = ((uint8_t)in.read8() + 0.5f) / 256.0f;
+            in.skip(1);
+            texinfo.texcoord[j][1] = ((uint8_t)in.read8() + 0.5f) / 256.0f;
         }
     }
 
-    fseek(fp, texanimchain_data_offset, SEEK_SET);
-    uint16_t num_texanimchains = read16(fp);
+    in.seek(texanimchain_data_offset);
+    uint16_t num_texanimchains = in.read16();
     for (uint16_t i = 0; i < num_texanimchains; ++i) {
-        uint32_t num_texinfos = read16(fp) + 1;
+        uint32_t num_texinfos = in.read16() + 1;
         std::vector<uint16_t> texinfos(num_texinfos);
         for (uint32_t j = 0; j < num_texinfos; ++j)
-            texinfos[j] = read16(fp) + 256;
+            texinfos[j] = in.read16() + 256;
         for (uint32_t j = 0; j < num_texinfos; ++j) {
             uint16_t src = texinfos[j], dest = texinfos[(j + 1) % num_texinfos];
-            level->texinfos.at(src).texanimchain = &level->texinfos.at(dest);
+            level->texinfos.at(src).texanimchain = checked_handle(level->texinfos, dest);
+        }
+    }
+
+    // collapse identical texinfos, except for the animated ones
+    // whose chains have to stay apart
+    std::vector<tr::texinfo> unique;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+    level->file_texinfos.resize(level->texinfos.size());
+    for (size_t i = 0; i < level->texinfos.size(); ++i) {
+        const tr::texinfo& texinfo = level->texinfos[i];
+        tr::handle<tr::texinfo> handle(unique.size());
+        if (!texinfo.texanimchain.valid()) {
+            std::vector<uint32_t>& bucket = buckets[tr::hash64(&texinfo, sizeof(texinfo))];
+            for (uint32_t j : bucket) {
+                if (memcmp(&unique[j], &texinfo, sizeof(texinfo)) == 0) {
+                    handle = tr::handle<tr::texinfo>(j);
+                    break;
+                }
+            }
+            if (handle.index == unique.size())
+                bucket.push_back(handle.index);
         }
+        if (handle.index == unique.size())
+            unique.push_back(texinfo);
+        level->file_texinfos[i] = handle;
+    }
+    for (tr::texinfo& texinfo : unique) {
+        if (texinfo.texanimchain.valid())
+            texinfo.texanimchain = level->file_texinfos[texinfo.texanimchain.index];
     }
+    level->texinfos.swap(unique);
 }
 
-void tr::loader::load_meshes()
+void tr::loader::read_mesh(tr::reader& in, d_mesh* mesh)
 {
-    fseek(fp, mesh_pointers_offset, SEEK_SET);
-    std::vector<uint32_t> mesh_pointers(num_mesh_pointers);
-    fread(mesh_pointers.data(), 4, num_mesh_pointers, fp);
+    // bounding sphere
+    in.skip(10);
 
-    level->meshes.resize(num_mesh_pointers);
-    for (long i = 0; i < num_mesh_pointers; ++i) {
-        tr::mesh& mesh = level->meshes.at(i);
-        mesh.id = i;
+    mesh->num_verts = in.read16();
+    mesh->positions = in.read_block(mesh->num_verts * 6);
 
-        fseek(fp, mesh_data_offset + mesh_pointers[i], SEEK_SET);
+    mesh->num_lightattribs = in.read16();
+    if (mesh->num_lightattribs > 0) {
+        assert(mesh->num_lightattribs == mesh->num_verts);
+        mesh->lightattribs = in.read_block(mesh->num_lightattribs * 6);
+    } else {
+        assert(-mesh->num_lightattribs == mesh->num_verts);
+        mesh->lightattribs = in.read_block(-mesh->num_lightattribs * 2);
+    }
 
-        // bounding sphere
-        fseek(fp, 10, SEEK_CUR);
+    mesh->num_textured_quads = in.read16();
+    mesh->textured_quads = in.read_block(mesh->num_textured_quads * 10);
+    mesh->num_textured_tris = in.read16();
+    mesh->textured_tris = in.read_block(mesh->num_textured_tris * 8);
+    mesh->num_colored_quads = in.read16();
+    mesh->colored_quads = in.read_block(mesh->num_colored_quads * 10);
+    mesh->num_colored_tris = in.read16();
+    mesh->colored_tris = in.read_block(mesh->num_colored_tris * 8);
+}
 
-        // positions
-        int16_t num_verts = read16(fp);
-        mesh.verts.resize(num_verts);
-        for (int16_t j = 0; j < num_verts; ++j) {
-            mesh.verts[j].position.x = read16(fp);
-            mesh.verts[j].position.y = read16(fp);
-            mesh.verts[j].position.z = read16(fp);
-        }
+// appends the polygon records with their texinfo indices resolved,
+// so polygons that use identical texinfos compare equal
+static void AppendPolygonKey(const uchar* data, long count, int num_vertices,
+                             uint16_t texinfo_mask, long texinfo_base,
+                             const tr::level* level, std::vector<uchar>* key)
+{
+    long record_size = (num_vertices + 1) * 2;
+    for (long i = 0; i < count; ++i) {
+        const uchar* record = data + i * record_size;
+        key->insert(key->end(), record, record + num_vertices * 2);
+        uint32_t texinfo = level->file_texinfos.at((tr::load16(record + num_vertices * 2) & texinfo_mask) + texinfo_base).index;
+        const uchar* bytes = (const uchar*)&texinfo;
+        key->insert(key->end(), bytes, bytes + sizeof(texinfo));
+    }
+}
 
-        // light attribs
-        int16_t num_lightattribs = read16(fp);
-        if (num_lightattribs > 0) {
-            // normals
-            assert(num_lightattribs == num_verts);
-            mesh.lightmode = tr::mesh_lightmode_external;
-            for (int16_t j = 0; j < num_lightattribs; ++j) {
-                mesh.verts[j].lightattrib.x = read16(fp);
-                mesh.verts[j].lightattrib.y = read16(fp);
-                mesh.verts[j].lightattrib.z = read16(fp);
-            }
-        } else {
-            // colors
-            assert(-num_lightattribs == num_verts);
-            mesh.lightmode = tr::mesh_lightmode_internal;
-            for (int16_t j = 0; j < -num_lightattribs; ++j) {
-                float lightintensity = 1.0f - read16(fp) / 8191.0f;
-                mesh.verts[j].lightattrib.r = lightintensity;
-                mesh.verts[j].lightattrib.g = lightintensity;
-                mesh.verts[j].lightattrib.b = lightintensity;
-            }
-        }
+void tr::loader::mesh_key(const d_mesh& dmesh, std::vector<uchar>* key) const
+{
+    int16_t counts[6] = {
+        dmesh.num_verts, dmesh.num_lightattribs,
+        dmesh.num_textured_quads, dmesh.num_textured_tris,
+        dmesh.num_colored_quads, dmesh.num_colored_tris
+    };
 
-        // textured quads
-        int16_t num_textured_quads = read16(fp);
-        for (int16_t j = 0; j < num_textured_quads; ++j) {
-            mesh.polys.emplace_back();
-            tr::mesh_poly& poly = mesh.polys.back();
-            for (int k = 0; k < 4; ++k)
-                poly.verts[k] = read16(fp);
-            poly.texinfo = &level->texinfos.at((read16(fp) & 0x7FFF) + 256);
-        }
+    key->clear();
+    key->insert(key->end(), (const uchar*)counts, (const uchar*)(counts + 6));
+    key->insert(key->end(), dmesh.positions, dmesh.positions + dmesh.num_verts * 6);
+    if (dmesh.num_lightattribs > 0)
+        key->insert(key->end(), dmesh.lightattribs, dmesh.lightattribs + dmesh.num_lightattribs * 6);
+    else
+        key->insert(key->end(), dmesh.lightattribs, dmesh.lightattribs - dmesh.num_lightattribs * 2);
+    AppendPolygonKey(dmesh.textured_quads, dmesh.num_textured_quads, 4, 0x7FFF, 256, level.get(), key);
+    AppendPolygonKey(dmesh.textured_tris, dmesh.num_textured_tris, 3, 0x7FFF, 256, level.get(), key);
+    AppendPolygonKey(dmesh.colored_quads, dmesh.num_colored_quads, 4, 0xFF, 0, level.get(), key);
+    AppendPolygonKey(dmesh.colored_tris, dmesh.num_colored_tris, 3, 0xFF, 0, level.get(), key);
+}
 
-        // textured tris
-        int16_t num_textured_tris = read16(fp);
-        for (int16_t j = 0; j < num_textured_tris; ++j) {
-            mesh.polys.emplace_back();
-            tr::mesh_poly& poly = mesh.polys.back();
-            for (int k = 0; k < 3; ++k)
-                poly.verts[k] = read16(fp);
-            poly.verts[3] = -1;
-            poly.texinfo = &level->texinfos.at((read16(fp) & 0x7FFF) + 256);
-        }
+void tr::loader::decode_mesh(const d_mesh& dmesh, tr::mesh* mesh)
+{
+    // positions
+    mesh->positions = level->geometry.allocate<glm::vec3>(dmesh.num_verts);
+    tr::decode_i16(dmesh.positions, dmesh.num_verts * 3, &mesh->positions.data()->x);
+
+    // light attribs
+    if (dmesh.num_lightattribs > 0) {
+        // normals
+        mesh->lightmode = tr::mesh_lightmode_external;
+        mesh->lightattribs = level->geometry.allocate<glm::vec3>(dmesh.num_lightattribs);
+        tr::decode_i16(dmesh.lightattribs, dmesh.num_lightattribs * 3, &mesh->lightattribs.data()->x);
+    } else {
+        // colors
+        mesh->lightmode = tr::mesh_lightmode_internal;
+        mesh->lightattribs = level->geometry.allocate<glm::vec3>(-dmesh.num_lightattribs);
+        std::vector<float> intensities(-dmesh.num_lightattribs);
+        tr::decode_intensities(dmesh.lightattribs, -dmesh.num_lightattribs, intensities.data());
+        for (int16_t j = 0; j < -dmesh.num_lightattribs; ++j)
+            mesh->lightattribs[j] = glm::vec3(intensities[j]);
+    }
 
-        // colored quads
-        int16_t num_colored_quads = read16(fp);
-        for (int16_t j = 0; j < num_colored_quads; ++j) {
-            mesh.polys.emplace_back();
-            tr::mesh_poly& poly = mesh.polys.back();
-            for (int k = 0; k < 4; ++k)
-                poly.verts[k] = read16(fp);
-            poly.texinfo = &level->texinfos.at(read16(fp) & 0xFF);
-        }
+    // textured quads, textured tris, colored quads, colored tris
+    long num_polys = dmesh.num_textured_quads + dmesh.num_textured_tris + dmesh.num_colored_quads + dmesh.num_colored_tris;
+    mesh->poly_verts = level->geometry.allocate<tr::mesh_poly_verts>(num_polys);
+    mesh->poly_texinfos = level->geometry.allocate<tr::handle<tr::texinfo>>(num_polys);
+    long first = 0;
+    first = decode_polygons(dmesh.textured_quads, dmesh.num_textured_quads, 4, 0x7FFF, 256, level.get(), mesh, first);
+    first = decode_polygons(dmesh.textured_tris, dmesh.num_textured_tris, 3, 0x7FFF, 256, level.get(), mesh, first);
+    first = decode_polygons(dmesh.colored_quads, dmesh.num_colored_quads, 4, 0xFF, 0, level.get(), mesh, first);
+    first = decode_polygons(dmesh.colored_tris, dmesh.num_colored_tris, 3, 0xFF, 0, level.get(), mesh, first);
+}
 
-        // colored tris
-        int16_t num_colored_tris = read16(fp);
-        for (int16_t j = 0; j < num_colored_tris; ++j) {
-            mesh.polys.emplace_back();
-            tr::mesh_poly& poly = mesh.polys.back();
-            for (int k = 0; k < 3; ++k)
-                poly.verts[k] = read16(fp);
-            poly.verts[3] = -1;
-            poly.texinfo = &level->texinfos.at(read16(fp) & 0xFF);
+void tr::loader::load_meshes()
+{
+    tr::reader in = reader_at(mesh_pointers_offset);
+    std::vector<uint32_t> mesh_pointers(num_mesh_pointers);
+    in.read32_array(mesh_pointers.data(), num_mesh_pointers);
+
+    // identical meshes are decoded once, the rest of the
+    // mesh pointers refer to the first one
+    std::vector<std::vector<uchar>> keys;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+    std::vector<uchar> key;
+    level->file_meshes.resize(num_mesh_pointers);
+    for (long i = 0; i < num_mesh_pointers; ++i) {
+        in.seek(mesh_data_offset + mesh_pointers[i]);
+        d_mesh dmesh;
+        read_mesh(in, &dmesh);
+        mesh_key(dmesh, &key);
+
+        std::vector<uint32_t>& bucket = buckets[tr::hash64(key.data(), key.size())];
+        auto it = std::find_if(bucket.begin(), bucket.end(), [&keys, &key](uint32_t j) { return keys[j] == key; });
+        if (it != bucket.end()) {
+            level->file_meshes[i] = tr::handle<tr::mesh>(*it);
+            continue;
         }
+
+        tr::handle<tr::mesh> handle(level->meshes.size());
+        bucket.push_back(handle.index);
+        keys.push_back(key);
+        level->file_meshes[i] = handle;
+
+        level->meshes.emplace_back();
+        tr::mesh& mesh = level->meshes.back();
+        mesh.id = handle.index;
+        decode_mesh(dmesh, &mesh);
     }
 }
 
+template <tr::version V>
 void tr::loader::load_animations()
 {
     // anim frame data
-    fseek(fp, anim_frame_data_offset, SEEK_SET);
+    tr::reader in = reader_at(anim_frame_data_offset);
     std::vector<uint16_t> frame_data(num_anim_frame_data_words);
-    fread(frame_data.data(), 2, num_anim_frame_data_words, fp);
+    in.read16_array(frame_data.data(), num_anim_frame_data_words);
 
     // anim command data
-    fseek(fp, anim_command_data_offset, SEEK_SET);
+    in.seek(anim_command_data_offset);
     level->anim_command_data.resize(num_anim_command_data_words);
-    fread(level->anim_command_data.data(), 2, num_anim_command_data_words, fp);
+    in.read16_array(level->anim_command_data.data(), num_anim_command_data_words);
 
     // anim ranges
-    fseek(fp, anim_ranges_offset, SEEK_SET);
+    in.seek(anim_ranges_offset);
     level->anim_ranges.resize(num_anim_ranges);
     for (long i = 0; i < num_anim_ranges; ++i) {
         tr::anim_range& anim_range = level->anim_ranges.at(i);
-        anim_range.first_tick = read16(fp);
-        anim_range.last_tick = read16(fp);
-        anim_range.next_anim = read16(fp);
-        anim_range.next_anim_tick = read16(fp);
+        anim_range.first_tick = in.read16();
+        anim_range.last_tick = in.read16();
+        anim_range.next_anim = in.read16();
+        anim_range.next_anim_tick = in.read16();
     }
 
     // anim structs
-    fseek(fp, anim_structs_offset, SEEK_SET);
+    in.seek(anim_structs_offset);
     level->anim_structs.resize(num_anim_structs);
     for (long i = 0; i < num_anim_structs; ++i) {
         tr::anim_struct& anim_struct = level->anim_structs.at(i);
-        anim_struct.state_id = read16(fp);
-        anim_struct.num_anim_ranges = read16(fp);
-        anim_struct.anim_range_offset = read16(fp);
+        anim_struct.state_id = in.read16();
+        anim_struct.num_anim_ranges = in.read16();
+        anim_struct.anim_range_offset = in.read16();
     }
 
     // animations
-    fseek(fp, animations_offset, SEEK_SET);
+    in.seek(animations_offset);
     level->animations.resize(num_animations);
 
     struct d_anim_extra
@@ -1012,25 +1264,24 @@ void tr::loader::load_animations()
         tr::animation& animation = level->animations.at(i);
         d_anim_extra& anim_extra = anim_extras.at(i);
 
-        anim_extra.frame_offset = read32(fp);
+        anim_extra.frame_offset = in.read32();
         assert(anim_extra.frame_offset % 2 == 0);
 
-        animation.ticks_per_frame = read8(fp);
-
-        anim_extra.frame_size = read8(fp);
-        assert((version == tr::version_tr1 && anim_extra.frame_size == 0)
-            || (version == tr::version_tr2 && anim_extra.frame_size != 0));
-
-        animation.state_id = read16(fp);
-        fseek(fp, 8, SEEK_CUR); // unknown
-        animation.first_tick = read16(fp);
-        animation.last_tick = read16(fp);
-        animation.next_anim = read16(fp);
-        animation.next_anim_tick = read16(fp);
-        animation.num_anim_structs = read16(fp);
-        animation.anim_struct_offset = read16(fp);
-        animation.num_anim_commands = read16(fp);
-        animation.anim_command_offset = read16(fp);
+        animation.ticks_per_frame = in.read8();
+
+        anim_extra.frame_size = in.read8();
+        assert(tr::version_traits<V>::sized_anim_frames == (anim_extra.frame_size != 0));
+
+        animation.state_id = in.read16();
+        in.skip(8); // unknown
+        animation.first_tick = in.read16();
+        animation.last_tick = in.read16();
+        animation.next_anim = in.read16();
+        animation.next_anim_tick = in.read16();
+        animation.num_anim_structs = in.read16();
+        animation.anim_struct_offset = in.read16();
+        animation.num_anim_commands = in.read16();
+        animation.anim_command_offset = in.read16();
     }
 
     // convert anim frames to a common format
@@ -1043,16 +1294,10 @@ void tr::loader::load_animations()
 
         uint32_t next_anim_frame_offset = ((i == num_animations-1) ? frame_data.size() : anim_extras.at(i+1).frame_offset / 2);
         while (frame_offset < next_anim_frame_offset) {
-            switch (version) {
-                case tr::version_tr1:
-                    frame_offset = emit_anim_frame_tr1(frame_data, frame_offset);
-                    break;
-                case tr::version_tr2:
-                    frame_offset = emit_anim_frame_tr2(frame_data, frame_offset, anim_extra.frame_size);
-                    break;
-                default:
-                    throw std::logic_error("loader::load_animations: bad version");
-            }
+            if (tr::version_traits<V>::sized_anim_frames)
+                frame_offset = emit_anim_frame_tr2(frame_data, frame_offset, anim_extra.frame_size);
+            else
+                frame_offset = emit_anim_frame_tr1(frame_data, frame_offset);
         }
         assert(frame_offset == next_anim_frame_offset);
     }
@@ -1060,9 +1305,9 @@ void tr::loader::load_animations()
 
 void tr::loader::load_models()
 {
-    fseek(fp, bone_data_offset, SEEK_SET);
+    tr::reader in = reader_at(bone_data_offset);
     std::vector<int32_t> bone_data(num_bone_data_dwords);
-    fread(bone_data.data(), 4, num_bone_data_dwords, fp);
+    in.read32_array((uint32_t*)bone_data.data(), num_bone_data_dwords);
 
     struct d_model
     {
@@ -1074,29 +1319,30 @@ void tr::loader::load_models()
         uint16_t animation;
     };
 
-    fseek(fp, models_offset, SEEK_SET);
+    in.seek(models_offset);
     for (long i = 0; i < num_models; ++i) {
         d_model dmodel;
-        dmodel.id = read32(fp);
-        dmodel.num_meshes = read16(fp);
-        dmodel.first_mesh = read16(fp);
-        dmodel.bone_data_offset = read32(fp);
-        dmodel.frame_data_offset = read32(fp);
-        dmodel.animation = read16(fp);
+        dmodel.id = in.read32();
+        dmodel.num_meshes = in.read16();
+        dmodel.first_mesh = in.read16();
+        dmodel.bone_data_offset = in.read32();
+        dmodel.frame_data_offset = in.read32();
+        dmodel.animation = in.read16();
 
         level->models.emplace_back();
         tr::model& model = level->models.back();
         model.id = dmodel.id;
-        model.animation = (dmodel.animation != (uint16_t)-1) ? &level->animations.at(dmodel.animation) : nullptr;
+        if (dmodel.animation != (uint16_t)-1)
+            model.animation = checked_handle(level->animations, dmodel.animation);
 
         std::vector<int> node_stack;
         node_stack.reserve(8);
+        model.nodes = level->arena.allocate<tr::model_node>(dmodel.num_meshes);
         for (uint16_t j = 0; j < dmodel.num_meshes; ++j) {
-            model.nodes.emplace_back();
-            tr::model_node& node = model.nodes.back();
+            tr::model_node& node = model.nodes[j];
             node.parent = j-1;
             node.offset = glm::vec3(0.0f, 0.0f, 0.0f);
-            node.mesh = &level->meshes.at(dmodel.first_mesh + j);
+            node.mesh = level->file_meshes.at(dmodel.first_mesh + j);
 
             if (j != 0) {
                 uint32_t bone_op = bone_data[dmodel.bone_data_offset + (j-1) * 4];
@@ -1116,6 +1362,8 @@ void tr::loader::load_models()
             }
         }
     }
+
+    level->model_ids.build(level->models);
 }
 
 void tr::loader::load_sprites()
@@ -1128,19 +1376,19 @@ void tr::loader::load_sprites()
         int16_t left, top, right, bottom;
     };
 
-    fseek(fp, sprites_offset, SEEK_SET);
+    tr::reader in = reader_at(sprites_offset);
     level->sprites.resize(num_sprites);
     for (long i = 0; i < num_sprites; ++i) {
         d_sprite dsprite;
-        dsprite.texpage = read16(fp);
-        dsprite.x = read8(fp);
-        dsprite.y = read8(fp);
-        dsprite.w = read16(fp);
-        dsprite.h = read16(fp);
-        dsprite.left = read16(fp);
-        dsprite.top = read16(fp);
-        dsprite.right = read16(fp);
-        dsprite.bottom = read16(fp);
+        dsprite.texpage = in.read16();
+        dsprite.x = in.read8();
+        dsprite.y = in.read8();
+        dsprite.w = in.read16();
+        dsprite.h = in.read16();
+        dsprite.left = in.read16();
+        dsprite.top = in.read16();
+        dsprite.right = in.read16();
+        dsprite.bottom = in.read16();
 
         tr::sprite& sprite = level->sprites.at(i);
         sprite.id = i;
@@ -1175,33 +1423,40 @@ void tr::loader::load_sprite_sequences()
         uint16_t first_frame;
     };
 
-    fseek(fp, sprite_sequences_offset, SEEK_SET);
+    tr::reader in = reader_at(sprite_sequences_offset);
     level->sprite_sequences.resize(num_sprite_sequences);
     for (long i = 0; i < num_sprite_sequences; ++i) {
         d_sprite_sequence dspritesequence;
-        dspritesequence.id = read32(fp);
-        dspritesequence.num_frames = -read16(fp);
-        dspritesequence.first_frame = read16(fp);
+        dspritesequence.id = in.read32();
+        dspritesequence.num_frames = -in.read16();
+        dspritesequence.first_frame = in.read16();
 
         tr::sprite_sequence& sprite  = level->sprite_sequences.at(i);
         sprite.id = dspritesequence.id;
+        sprite.sprites = level->arena.allocate<tr::handle<tr::sprite>>(dspritesequence.num_frames);
         for (uint16_t j = 0; j < dspritesequence.num_frames; ++j)
-            sprite.sprites.push_back(&level->sprites.at(dspritesequence.first_frame + j));
+            sprite.sprites[j] = checked_handle(level->sprites, dspritesequence.first_frame + j);
     }
+
+    level->sprite_sequence_ids.build(level->sprite_sequences);
 }
 
 void tr::loader::load_rooms()
 {
     tr::room_loader::params params;
-    params.num_rooms = num_rooms;
-    params.rooms_offset = rooms_offset;
+    params.room_offsets = room_offsets;
     params.num_static_meshes = num_static_meshes;
     params.static_meshes_offset = static_meshes_offset;
 
-    tr::room_loader room_loader;
-    room_loader.load(fp, level.get(), version, params);
+    if (stream_rooms) {
+        level->room_streamer.reset(new tr::room_streamer(filename.c_str(), level.get(), version, params));
+    } else {
+        tr::room_loader room_loader;
+        room_loader.load(tr::reader(file), level.get(), version, params);
+    }
 }
 
+template <tr::version V>
 void tr::loader::load_objects()
 {
     struct d_object
@@ -1216,61 +1471,55 @@ void tr::loader::load_objects()
         uint16_t flags;
     };
 
-    fseek(fp, objects_offset, SEEK_SET);
+    tr::reader in = reader_at(objects_offset);
     for (long i = 0; i < num_objects; ++i) {
         d_object dobject;
-        dobject.id = read16(fp);
-        dobject.room = read16(fp);
-        dobject.position.x = read32(fp);
-        dobject.position.y = read32(fp);
-        dobject.position.z = read32(fp);
-        dobject.orientation = read16(fp);
-        dobject.light_intensity = read16(fp);
-        if (version == tr::version_tr2)
-            fseek(fp, 2, SEEK_CUR); // light_intensity2
-        dobject.flags = read16(fp);
-
-        for (const tr::model& model : level->models) {
-            if (model.id == dobject.id) {
-                tr::model_object modelobj(level.get(), &model);
-
-                modelobj.room = &level->rooms.at(dobject.room);
-
-                modelobj.transform =
-                        glm::translate(glm::mat4(), dobject.position) *
-                        glm::rotate(glm::mat4(), ((dobject.orientation >> 14) & 0xFF) * glm::pi<float>() / 2.0f, glm::vec3(0.0f, 1.0f, 0.0f));
-
-                if (dobject.light_intensity == 0xFFFF)
-                    modelobj.light_intensity = 1.0f;
-                else
-                    modelobj.light_intensity = 1.0f - dobject.light_intensity / 8191.0f;
-
-                level->model_objects.push_back(modelobj);
-
-                break;
-            }
+        dobject.id = in.read16();
+        dobject.room = in.read16();
+        dobject.position.x = in.read32();
+        dobject.position.y = in.read32();
+        dobject.position.z = in.read32();
+        dobject.orientation = in.read16();
+        dobject.light_intensity = in.read16();
+        if (tr::version_traits<V>::dual_lighting)
+            in.skip(2); // light_intensity2
+        dobject.flags = in.read16();
+
+        tr::handle<tr::model> model = level->find_model(dobject.id);
+        if (model.valid()) {
+            tr::model_object modelobj(level.get(), model);
+
+            modelobj.room = checked_handle(level->rooms, dobject.room);
+
+            modelobj.transform =
+                    glm::translate(glm::mat4(), dobject.position) *
+                    glm::rotate(glm::mat4(), ((dobject.orientation >> 14) & 0xFF) * glm::pi<float>() / 2.0f, glm::vec3(0.0f, 1.0f, 0.0f));
+
+            if (dobject.light_intensity == 0xFFFF)
+                modelobj.light_intensity = 1.0f;
+            else
+                modelobj.light_intensity = 1.0f - dobject.light_intensity / 8191.0f;
+
+            level->model_objects.push_back(modelobj);
         }
 
-        for (const tr::sprite_sequence& sequence : level->sprite_sequences) {
-            if (sequence.id == dobject.id) {
-                tr::sprite_object spriteobj;
+        tr::handle<tr::sprite_sequence> sequence = level->find_sprite_sequence(dobject.id);
+        if (sequence.valid()) {
+            tr::sprite_object spriteobj;
 
-                spriteobj.sequence = &sequence;
-                spriteobj.frame = 0;
+            spriteobj.sequence = sequence;
+            spriteobj.frame = 0;
 
-                spriteobj.room = &level->rooms.at(dobject.room);
+            spriteobj.room = checked_handle(level->rooms, dobject.room);
 
-                spriteobj.position = dobject.position;
+            spriteobj.position = dobject.position;
 
-                if (dobject.light_intensity == 0xFFFF)
-                    spriteobj.light_intensity = 1.0f;
-                else
-                    spriteobj.light_intensity = 1.0f - dobject.light_intensity / 8191.0f;
+            if (dobject.light_intensity == 0xFFFF)
+                spriteobj.light_intensity = 1.0f;
+            else
+                spriteobj.light_intensity = 1.0f - dobject.light_intensity / 8191.0f;
 
-                level->sprite_objects.push_back(spriteobj);
-
-                break;
-            }
+            level->sprite_objects.push_back(spriteobj);
         }
     }
 }
@@ -19,17 +19,45 @@
 #ifndef TR_LOADER_H
 #define TR_LOADER_H
 
+#include "tr_reader.h"
+#include "tr_task_graph.h"
 #include "tr_types.h"
+#include "tr_version.h"
 
-#include <stdio.h>
 #include <stdint.h>
+#include <stdio.h>
 
+#include <memory>
+#include <string>
 #include <vector>
 
 // TODO: clean up the loader
 
 namespace tr
 {
+    /*
+     * tr::load_report
+     */
+
+    struct load_report
+    {
+        std::vector<tr::task_graph::timing> phases;
+        // phases that the load had to wait for, in order
+        std::vector<std::string> critical_path;
+        double total_time; // in milliseconds
+
+        // collapsed onto an identical texinfo or mesh
+        long duplicate_texinfos, duplicate_meshes;
+        size_t duplicate_bytes;
+
+        // how much the resident size of the process
+        // rose during the load, 0 if unknown
+        size_t peak_bytes;
+
+        void fill(const tr::task_graph& graph, const tr::level& level);
+        void print(FILE* fp) const;
+    };
+
     /*
      * tr::room_loader
      */
@@ -39,38 +67,40 @@ namespace tr
     public:
         struct params
         {
-            long num_rooms, rooms_offset;
+            std::vector<long> room_offsets;
             long num_static_meshes, static_meshes_offset;
         };
 
-        void load(FILE* fp, tr::level* level, tr::version version, tr::room_loader::params params);
+        // reads the static mesh table and everything about the rooms
+        // that is loaded eagerly: ids, bounds, ambient light and flags;
+        // rooms are only evictable if they don't use the level arena
+        void init(const tr::reader& reader, tr::level* level, tr::version version, const tr::room_loader::params& params, bool evictable);
 
-    private:
-        FILE* fp;
-        tr::version version;
+        // NOTE: different rooms can be loaded and evicted in parallel
+        void load_room(long room_idx);
+        void evict_room(long room_idx);
+        // memory taken by the decoded room, known before it's loaded
+        size_t room_size(long room_idx) const { return room_sizes.at(room_idx); }
 
-        struct d_room_vertex
-        {
-            glm::vec3 position;
-            uint16_t lighting1;
-            uint16_t attributes;
-            uint16_t lighting2;
-        };
-        void read_room_vertex(d_room_vertex* room_vertex);
+        // NOTE: rooms are decoded in parallel, the result doesn't
+        // depend on the number of threads
+        void load(const tr::reader& reader, tr::level* level, tr::version version, const tr::room_loader::params& params);
 
-        struct d_room_polygon
-        {
-            uint16_t vertices[4];
-            uint16_t texinfo;
-        };
-        void read_room_polygon(d_room_polygon* room_polygon, int num_vertices);
+    private:
+        tr::reader reader;
+        tr::level* level;
+        tr::version version;
+        std::vector<long> room_offsets;
+        std::vector<size_t> room_sizes;
+        // only for evictable rooms, see init()
+        std::vector<std::unique_ptr<tr::arena>> room_arenas;
 
         struct d_room_static_sprite
         {
             uint16_t vertex;
             uint16_t sprite;
         };
-        void read_room_static_sprite(d_room_static_sprite* room_static_sprite);
+        void read_room_static_sprite(tr::reader& in, d_room_static_sprite* room_static_sprite);
 
         struct d_room_light
         {
@@ -80,7 +110,8 @@ namespace tr
             int32_t falloff1;
             int32_t falloff2;
         };
-        void read_room_light(d_room_light* room_light);
+        template <tr::version V>
+        void read_room_light(tr::reader& in, d_room_light* room_light);
 
         struct d_room_static_mesh
         {
@@ -90,15 +121,21 @@ namespace tr
             uint16_t lighting2;
             uint16_t static_mesh_id;
         };
-        void read_room_static_mesh(d_room_static_mesh* room_static_mesh);
+        template <tr::version V>
+        void read_room_static_mesh(tr::reader& in, d_room_static_mesh* room_static_mesh);
 
         struct d_room
         {
             int32_t x, z, y_bottom, y_top;
-            std::vector<d_room_vertex> vertices;
-            std::vector<d_room_polygon> quads;
-            std::vector<d_room_polygon> tris;
+            // raw vertex and polygon arrays, decoded in bulk
+            uint16_t num_vertices;
+            const uchar* vertices;
+            uint16_t num_quads;
+            const uchar* quads;
+            uint16_t num_tris;
+            const uchar* tris;
             std::vector<d_room_static_sprite> static_sprites;
+            uint16_t num_z_sectors, num_x_sectors;
             int16_t ambient_lighting1;
             int16_t ambient_lighting2;
             uint16_t light_mode;
@@ -107,7 +144,8 @@ namespace tr
             uint16_t alternate_room;
             uint16_t flags;
         };
-        void read_room(d_room* room);
+        template <tr::version V>
+        void read_room(tr::reader& in, d_room* room);
 
         struct d_static_mesh
         {
@@ -116,7 +154,13 @@ namespace tr
             glm::vec3 aabb[2][2];
             uint16_t flags;
         };
-        void read_static_mesh(d_static_mesh* static_mesh);
+        void read_static_mesh(tr::reader& in, d_static_mesh* static_mesh);
+
+        void index_room(long room_idx);
+        template <tr::version V>
+        void index_room(long room_idx);
+        template <tr::version V>
+        void load_room(long room_idx);
     };
 
     /*
@@ -126,18 +170,36 @@ namespace tr
     class loader
     {
     public:
-        static std::unique_ptr<tr::level> load(const char* filename, tr::version version);
+        // NOTE: independent phases are loaded in parallel, the
+        // result doesn't depend on the number of threads
+        static std::unique_ptr<tr::level> load(const char* filename, tr::version version, bool texpages16, tr::load_report* report = nullptr);
+
+        // uses <filename>.cache if it matches the level file,
+        // otherwise loads the level and writes the cache
+        static std::unique_ptr<tr::level> load_cached(const char* filename, tr::version version, bool texpages16, tr::load_report* report = nullptr);
+
+        // only indexes the rooms and leaves loading them to level->room_streamer
+        static std::unique_ptr<tr::level> load_streaming(const char* filename, tr::version version, bool texpages16, tr::load_report* report = nullptr);
 
     private:
-        loader(const char* filename, tr::version version);
+        loader(const char* filename, tr::version version, bool stream_rooms, bool texpages16);
         ~loader();
         loader(const loader&) = delete;
         loader& operator=(const loader&) = delete;
 
-        FILE* fp;
+        std::string filename;
+        tr::file_view file;
         tr::version version;
+        bool stream_rooms;
+        bool texpages16;
         std::unique_ptr<tr::level> level;
 
+        static std::unique_ptr<tr::level> load_level(const char* filename, tr::version version, bool stream_rooms, bool texpages16, tr::load_report* report);
+        template <tr::version V>
+        static std::unique_ptr<tr::level> load_level(const char* filename, bool stream_rooms, bool texpages16, tr::load_report* report);
+
+        tr::reader reader_at(long offset) const;
+
         void build_tr1_level_directory();
         void build_tr2_level_directory();
 
@@ -166,19 +228,44 @@ namespace tr
         long num_sprite_sequences, sprite_sequences_offset;
 
         long num_rooms, rooms_offset;
+        std::vector<long> room_offsets;
         long num_static_meshes, static_meshes_offset;
 
         long num_objects, objects_offset;
 
+        struct d_mesh
+        {
+            // raw vertex and polygon arrays, decoded in bulk
+            int16_t num_verts;
+            const uchar* positions;
+            // normals if positive, intensities if negative
+            int16_t num_lightattribs;
+            const uchar* lightattribs;
+            int16_t num_textured_quads;
+            const uchar* textured_quads;
+            int16_t num_textured_tris;
+            const uchar* textured_tris;
+            int16_t num_colored_quads;
+            const uchar* colored_quads;
+            int16_t num_colored_tris;
+            const uchar* colored_tris;
+        };
+        void read_mesh(tr::reader& in, d_mesh* mesh);
+        void mesh_key(const d_mesh& dmesh, std::vector<uchar>* key) const;
+        void decode_mesh(const d_mesh& dmesh, tr::mesh* mesh);
+
         void load_palette();
         void load_texpages();
+        void load_texpages16();
         void load_texinfos();
         void load_meshes();
+        template <tr::version V>
         void load_animations();
         void load_models();
         void load_sprites();
         void load_sprite_sequences();
         void load_rooms();
+        template <tr::version V>
         void load_objects();
     };
 }
@@ -0,0 +1,116 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tr_memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * tr::memory_report
+ */
+
+void tr::memory_report::add(const std::string& name, size_t bytes)
+{
+    entry e;
+    e.name = name;
+    e.bytes = bytes;
+    entries.push_back(e);
+}
+
+size_t tr::memory_report::total() const
+{
+    size_t total = 0;
+    for (const entry& e : entries)
+        total += e.bytes;
+    return total;
+}
+
+void tr::memory_report::print(FILE* fp, const char* title) const
+{
+    fprintf(fp, "%s: %zu bytes (%.2f MB)\n", title, total(), total() / (1024.0 * 1024.0));
+    for (const entry& e : entries)
+        fprintf(fp, "  %-18s %12zu bytes\n", e.name.c_str(), e.bytes);
+}
+
+/*
+ * resident size
+ */
+
+#if defined(__linux__)
+
+// returns the value of a "Name:   1234 kB" line of /proc/self/status
+static size_t ReadProcStatus(const char* name)
+{
+    FILE* fp = fopen("/proc/self/status", "r");
+    if (!fp)
+        return 0;
+
+    size_t result = 0;
+    size_t name_length = strlen(name);
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        if (strncmp(line, name, name_length) == 0 && line[name_length] == ':') {
+            result = strtoul(line + name_length + 1, nullptr, 10) * 1024;
+            break;
+        }
+    }
+
+    fclose(fp);
+    return result;
+}
+
+size_t tr::resident_size()
+{
+    return ReadProcStatus("VmRSS");
+}
+
+size_t tr::peak_resident_size()
+{
+    return ReadProcStatus("VmHWM");
+}
+
+size_t tr::reset_peak_resident_size()
+{
+    // NOTE: since linux 4.0
+    FILE* fp = fopen("/proc/self/clear_refs", "w");
+    if (fp) {
+        fputs("5", fp);
+        fclose(fp);
+    }
+    return resident_size();
+}
+
+#else
+
+size_t tr::resident_size()
+{
+    return 0;
+}
+
+size_t tr::peak_resident_size()
+{
+    return 0;
+}
+
+size_t tr::reset_peak_resident_size()
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TR_MEMORY_H
+#define TR_MEMORY_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+namespace tr
+{
+    /*
+     * tr::memory_report
+     *
+     * Bytes used per subsystem, see tr::level::memory_usage()
+     * and Renderer::MemoryUsage().
+     */
+
+    struct memory_report
+    {
+        struct entry
+        {
+            std::string name;
+            size_t bytes;
+        };
+        std::vector<entry> entries;
+
+        void add(const std::string& name, size_t bytes);
+        size_t total() const;
+        void print(FILE* fp, const char* title) const;
+    };
+
+    // resident size of the process and its peak since the last
+    // reset, in bytes; 0 where the system doesn't report them
+    size_t resident_size();
+    size_t peak_resident_size();
+    // returns the resident size; if the peak can't be reset,
+    // it stays the peak of the whole process
+    size_t reset_peak_resident_size();
+}
+
+#endif
@@ -0,0 +1,335 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "tr_meshopt.h"
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <limits>
+
+// clusters are split once their local miss ratio is below this
+static const float SOFT_BOUNDARY_ACMR = 0.75f;
+
+static const int OVERDRAW_RESOLUTION = 64;
+
+/*
+ * tipsify
+ */
+
+// the triangles of every vertex, as a compressed table
+struct VertexTriangles
+{
+    std::vector<uint32_t> first;
+    std::vector<uint32_t> triangles;
+
+    VertexTriangles(const ushort* indices, size_t num_indices, size_t num_vertices) :
+        first(num_vertices + 1, 0), triangles(num_indices)
+    {
+        for (size_t i = 0; i < num_indices; ++i)
+            ++first[indices[i] + 1];
+        for (size_t v = 0; v < num_vertices; ++v)
+            first[v + 1] += first[v];
+
+        std::vector<uint32_t> next(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < num_indices; ++i)
+            triangles[next[indices[i]]++] = i / 3;
+    }
+
+    uint32_t count(size_t v) const { return first[v + 1] - first[v]; }
+};
+
+void tr::optimize_vertex_cache(ushort* indices, size_t num_indices, size_t num_vertices,
+                               std::vector<size_t>* clusters, int cache_size)
+{
+    assert(num_indices % 3 == 0);
+
+    clusters->clear();
+    if (num_indices == 0)
+        return;
+
+    VertexTriangles adjacency(indices, num_indices, num_vertices);
+
+    // triangles left to emit, and when each vertex last entered the cache
+    std::vector<uint32_t> live(num_vertices);
+    for (size_t v = 0; v < num_vertices; ++v)
+        live[v] = adjacency.count(v);
+    std::vector<long> timestamp(num_vertices, 0);
+    long time = cache_size + 1;
+
+    std::vector<bool> emitted(num_indices / 3, false);
+    std::vector<ushort> dead_end;
+    std::vector<ushort> candidates;
+    std::vector<ushort> output;
+    output.reserve(num_indices);
+    std::vector<size_t> hard_boundaries;
+
+    size_t cursor = 0;
+    long fanning = indices[0];
+    bool jumped = true;
+    while (fanning >= 0) {
+        candidates.clear();
+        for (uint32_t i = adjacency.first[fanning]; i < adjacency.first[fanning + 1]; ++i) {
+            uint32_t t = adjacency.triangles[i];
+            if (emitted[t])
+                continue;
+            if (jumped) {
+                hard_boundaries.push_back(output.size() / 3);
+                jumped = false;
+            }
+            for (int j = 0; j < 3; ++j) {
+                ushort v = indices[3 * t + j];
+                output.push_back(v);
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                --live[v];
+                if (time - timestamp[v] > cache_size)
+                    timestamp[v] = time++;
+            }
+            emitted[t] = true;
+        }
+
+        // the candidate that will still be in the cache after its
+        // triangles are emitted, the oldest one of those
+        fanning = -1;
+        long best_priority = -1;
+        for (ushort v : candidates) {
+            if (live[v] == 0)
+                continue;
+            long priority = 0;
+            if (time - timestamp[v] + 2 * live[v] <= cache_size)
+                priority = time - timestamp[v];
+            if (priority > best_priority) {
+                fanning = v;
+                best_priority = priority;
+            }
+        }
+
+        if (fanning < 0) {
+            jumped = true;
+            while (!dead_end.empty() && fanning < 0) {
+                ushort v = dead_end.back();
+                dead_end.pop_back();
+                if (live[v] > 0)
+                    fanning = v;
+            }
+            for (; cursor < num_vertices && fanning < 0; ++cursor) {
+                if (live[cursor] > 0)
+                    fanning = cursor;
+            }
+        }
+    }
+
+    assert(output.size() == num_indices);
+    std::copy(output.begin(), output.end(), indices);
+
+    // soft boundaries, once a cluster that starts with an empty cache
+    // has made up for it, since the clusters get reordered
+    hard_boundaries.push_back(num_indices / 3);
+    std::vector<long> entered(num_vertices, -1);
+    long misses = 0;
+    for (size_t h = 0; h + 1 < hard_boundaries.size(); ++h) {
+        size_t cluster_start = hard_boundaries[h];
+        long cluster_first_miss = misses;
+        clusters->push_back(cluster_start);
+        for (size_t t = hard_boundaries[h]; t < hard_boundaries[h + 1]; ++t) {
+            for (int j = 0; j < 3; ++j) {
+                ushort v = indices[3 * t + j];
+                if (entered[v] < cluster_first_miss || misses - entered[v] > cache_size)
+                    entered[v] = misses++;
+            }
+            size_t cluster_size = t + 1 - cluster_start;
+            if (t + 1 < hard_boundaries[h + 1] && misses - cluster_first_miss < SOFT_BOUNDARY_ACMR * cluster_size) {
+                cluster_start = t + 1;
+                cluster_first_miss = misses;
+                clusters->push_back(cluster_start);
+            }
+        }
+    }
+}
+
+/*
+ * overdraw
+ */
+
+void tr::optimize_overdraw(ushort* indices, size_t num_indices, const glm::vec3* positions,
+                           const std::vector<size_t>& clusters)
+{
+    size_t num_triangles = num_indices / 3;
+    size_t num_clusters = clusters.size();
+    if (num_clusters < 2)
+        return;
+
+    // area weighted centroids and normals
+    std::vector<glm::vec3> centroids(num_clusters, glm::vec3(0.0f));
+    std::vector<glm::vec3> normals(num_clusters, glm::vec3(0.0f));
+    std::vector<float> areas(num_clusters, 0.0f);
+    glm::vec3 mesh_centroid(0.0f);
+    float mesh_area = 0.0f;
+    for (size_t c = 0; c < num_clusters; ++c) {
+        size_t end = (c + 1 < num_clusters) ? clusters[c + 1] : num_triangles;
+        for (size_t t = clusters[c]; t < end; ++t) {
+            glm::vec3 a = positions[indices[3 * t + 0]];
+            glm::vec3 b = positions[indices[3 * t + 1]];
+            glm::vec3 d = positions[indices[3 * t + 2]];
+            glm::vec3 normal = glm::cross(b - a, d - a);
+            float area = glm::length(normal);
+            centroids[c] += (a + b + d) / 3.0f * area;
+            normals[c] += normal;
+            areas[c] += area;
+        }
+        mesh_centroid += centroids[c];
+        mesh_area += areas[c];
+    }
+    if (mesh_area <= 0.0f)
+        return;
+    mesh_centroid /= mesh_area;
+
+    // clusters that face away from the rest of the mesh can only be
+    // in front of it, so they go first
+    std::vector<float> occlusion(num_clusters, 0.0f);
+    for (size_t c = 0; c < num_clusters; ++c) {
+        float length = glm::length(normals[c]);
+        if (areas[c] > 0.0f && length > 0.0f)
+            occlusion[c] = glm::dot(centroids[c] / areas[c] - mesh_centroid, normals[c] / length);
+    }
+
+    std::vector<size_t> order(num_clusters);
+    for (size_t c = 0; c < num_clusters; ++c)
+        order[c] = c;
+    std::stable_sort(order.begin(), order.end(), [&occlusion](size_t a, size_t b) {
+        return occlusion[a] > occlusion[b];
+    });
+
+    std::vector<ushort> output;
+    output.reserve(num_indices);
+    for (size_t c : order) {
+        size_t end = (c + 1 < num_clusters) ? clusters[c + 1] : num_triangles;
+        output.insert(output.end(), indices + 3 * clusters[c], indices + 3 * end);
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+/*
+ * vertex fetch
+ */
+
+void tr::optimize_vertex_fetch(ushort* indices, size_t num_indices, size_t num_vertices,
+                               std::vector<ushort>* remap)
+{
+    static const ushort UNUSED = (ushort)-1;
+
+    // NOTE: unused vertices keep their place after the used ones
+    remap->assign(num_vertices, UNUSED);
+    size_t next = 0;
+    for (size_t i = 0; i < num_indices; ++i) {
+        if ((*remap)[indices[i]] == UNUSED)
+            (*remap)[indices[i]] = next++;
+        indices[i] = (*remap)[indices[i]];
+    }
+    for (size_t v = 0; v < num_vertices; ++v) {
+        if ((*remap)[v] == UNUSED)
+            (*remap)[v] = next++;
+    }
+}
+
+/*
+ * metrics
+ */
+
+long tr::count_cache_misses(const ushort* indices, size_t num_indices, size_t num_vertices, int cache_size)
+{
+    // a vertex is in the FIFO if fewer than cache_size
+    // vertices have entered it since
+    std::vector<long> entered(num_vertices, -(long)cache_size - 1);
+    long misses = 0;
+    for (size_t i = 0; i < num_indices; ++i) {
+        if (misses - entered[indices[i]] > cache_size)
+            entered[indices[i]] = misses++;
+    }
+    return misses;
+}
+
+void tr::measure_overdraw(const ushort* indices, size_t num_indices, const glm::vec3* positions,
+                          long* shaded, long* covered)
+{
+    static const int N = OVERDRAW_RESOLUTION;
+
+    *shaded = 0;
+    *covered = 0;
+    if (num_indices == 0)
+        return;
+
+    glm::vec3 lo(std::numeric_limits<float>::max()), hi(-std::numeric_limits<float>::max());
+    for (size_t i = 0; i < num_indices; ++i) {
+        lo = glm::min(lo, positions[indices[i]]);
+        hi = glm::max(hi, positions[indices[i]]);
+    }
+    glm::vec3 scale = glm::vec3(float(N)) / glm::max(hi - lo, glm::vec3(1.0f));
+
+    std::vector<float> depth(N * N);
+    for (int axis = 0; axis < 3; ++axis) {
+        int u = (axis + 1) % 3, v = (axis + 2) % 3;
+        for (float sign : {1.0f, -1.0f}) {
+            // looking along the axis, nearer is smaller
+            std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::max());
+
+            for (size_t i = 0; i < num_indices; i += 3) {
+                glm::vec3 p[3];
+                for (int j = 0; j < 3; ++j) {
+                    glm::vec3 position = positions[indices[i + j]];
+                    p[j] = glm::vec3((position[u] - lo[u]) * scale[u], (position[v] - lo[v]) * scale[v], sign * position[axis]);
+                }
+
+                glm::vec3 normal = glm::cross(positions[indices[i + 1]] - positions[indices[i]],
+                                              positions[indices[i + 2]] - positions[indices[i]]);
+                if (sign * normal[axis] >= 0.0f)
+                    continue;
+
+                float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+                if (area == 0.0f)
+                    continue;
+
+                int x0 = std::max(0, (int)std::floor(std::min({p[0].x, p[1].x, p[2].x})));
+                int x1 = std::min(N - 1, (int)std::ceil(std::max({p[0].x, p[1].x, p[2].x})));
+                int y0 = std::max(0, (int)std::floor(std::min({p[0].y, p[1].y, p[2].y})));
+                int y1 = std::min(N - 1, (int)std::ceil(std::max({p[0].y, p[1].y, p[2].y})));
+                for (int y = y0; y <= y1; ++y) {
+                    for (int x = x0; x <= x1; ++x) {
+                        float px = x + 0.5f, py = y + 0.5f;
+                        float w0 = ((p[2].x - p[1].x) * (py - p[1].y) - (p[2].y - p[1].y) * (px - p[1].x)) / area;
+                        float w1 = ((p[0].x - p[2].x) * (py - p[2].y) - (p[0].y - p[2].y) * (px - p[2].x)) / area;
+                        float w2 = 1.0f - w0 - w1;
+                        if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                            continue;
+                        float z = w0 * p[0].z + w1 * p[1].z + w2 * p[2].z;
+                        if (z < depth[y * N + x]) {
+                            depth[y * N + x] = z;
+                            ++*shaded;
+                        }
+                    }
+                }
+            }
+
+            for (float z : depth)
+                *covered += (z != std::numeric_limits<float>::max());
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TR_MESHOPT_H
+#define TR_MESHOPT_H
+
+#include "tr_types.h"
+
+#include <stddef.h>
+
+#include <vector>
+
+namespace tr
+{
+    /*
+     * triangle order optimization
+     *
+     * Reorders indexed triangle lists for the post-transform vertex cache
+     * and for early depth rejection, after "Fast Triangle Reordering for
+     * Vertex Locality and Reduced Overdraw" (Sander, Nehab, Barczak 2007):
+     * the triangles are fanned around vertices that are still in the cache
+     * (tipsify), then the resulting clusters are sorted so that the ones
+     * likely to occlude the others are drawn first.
+     *
+     * Triangles are front facing along the normal cross(b - a, c - a).
+     */
+
+    // a FIFO cache, the size is what tipsify optimizes for
+    static const int VERTEX_CACHE_SIZE = 16;
+
+    // returns the first triangle of every cluster, the clusters are split
+    // where the order had to jump and where the cache is already warm
+    void optimize_vertex_cache(ushort* indices, size_t num_indices, size_t num_vertices,
+                               std::vector<size_t>* clusters, int cache_size = VERTEX_CACHE_SIZE);
+
+    // sorts the clusters by how much of the mesh they face
+    void optimize_overdraw(ushort* indices, size_t num_indices, const glm::vec3* positions,
+                           const std::vector<size_t>& clusters);
+
+    // renumbers the vertices in the order they are first used, remap[old] is
+    // the new index; the vertex data has to be reordered to match
+    void optimize_vertex_fetch(ushort* indices, size_t num_indices, size_t num_vertices,
+                               std::vector<ushort>* remap);
+
+    // metrics
+
+    // for the average cache miss ratio, misses per triangle
+    long count_cache_misses(const ushort* indices, size_t num_indices, size_t num_vertices,
+                            int cache_size = VERTEX_CACHE_SIZE);
+
+    // pixels that pass the depth test and pixels that are covered, along the
+    // six axis directions at a low resolution; shaded / covered is the overdraw
+    void measure_overdraw(const ushort* indices, size_t num_indices, const glm::vec3* positions,
+                          long* shaded, long* covered);
+}
+
+#endif
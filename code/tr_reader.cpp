@@ -0,0 +1,124 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tr_reader.h"
+
+#include <stdio.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define TR_HAVE_MMAP
+#endif
+
+/*
+ * tr::file_view
+ */
+
+tr::file_view::file_view(const char* filename, bool writable) :
+    ptr(nullptr), len(0), is_mapped(false), is_writable(writable)
+{
+    if (!map(filename))
+        read(filename);
+}
+
+tr::file_view::~file_view()
+{
+#ifdef TR_HAVE_MMAP
+    if (is_mapped)
+        munmap((void*)ptr, len);
+#endif
+}
+
+bool tr::file_view::map(const char* filename)
+{
+#ifdef TR_HAVE_MMAP
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+
+    int prot = is_writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* addr = mmap(nullptr, st.st_size, prot, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return false;
+
+    // the whole file is parsed front to back
+    // madvise takes one advice at a time
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    madvise(addr, st.st_size, MADV_WILLNEED);
+
+    ptr = (const uchar*)addr;
+    len = st.st_size;
+    is_mapped = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void tr::file_view::read(const char* filename)
+{
+    FILE* fp = fopen(filename, "rb");
+    if (!fp)
+        throw std::runtime_error("tr::file_view: can't open file");
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    buffer.resize(size > 0 ? size : 0);
+    bool ok = (size >= 0) && ((long)fread(buffer.data(), 1, buffer.size(), fp) == size);
+    fclose(fp);
+    if (!ok)
+        throw std::runtime_error("tr::file_view: can't read file");
+
+    ptr = buffer.data();
+    len = buffer.size();
+    is_mapped = false;
+}
+
+/*
+ * tr::reader
+ */
+
+void tr::reader::read16_array(uint16_t* dest, long count)
+{
+    read_bytes(dest, count * 2);
+#ifdef TR_BIG_ENDIAN
+    for (long i = 0; i < count; ++i)
+        dest[i] = __builtin_bswap16(dest[i]);
+#endif
+}
+
+void tr::reader::read32_array(uint32_t* dest, long count)
+{
+    read_bytes(dest, count * 4);
+#ifdef TR_BIG_ENDIAN
+    for (long i = 0; i < count; ++i)
+        dest[i] = __builtin_bswap32(dest[i]);
+#endif
+}
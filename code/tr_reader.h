@@ -0,0 +1,158 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TR_READER_H
+#define TR_READER_H
+
+#include "tr_types.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <stdexcept>
+#include <vector>
+
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#define TR_BIG_ENDIAN
+#endif
+
+namespace tr
+{
+    /*
+     * tr::file_view
+     *
+     * View of a whole file. The file is mapped into memory when the
+     * platform allows it, otherwise it is read into a buffer with stdio.
+     * A writable view is mapped copy-on-write, so writes never reach the
+     * file.
+     */
+
+    class file_view
+    {
+    public:
+        explicit file_view(const char* filename, bool writable = false);
+        ~file_view();
+
+        const uchar* data() const { return ptr; }
+        uchar* writable_data() const { assert(is_writable); return (uchar*)ptr; }
+        long size() const { return len; }
+        bool mapped() const { return is_mapped; }
+
+    private:
+        file_view(const file_view&) = delete;
+        file_view& operator=(const file_view&) = delete;
+
+        const uchar* ptr;
+        long len;
+        bool is_mapped;
+        bool is_writable;
+        std::vector<uchar> buffer;
+
+        bool map(const char* filename);
+        void read(const char* filename);
+    };
+
+    /*
+     * tr::reader
+     *
+     * Cursor over a range of bytes. All values are stored little-endian,
+     * reads past the end of the range throw std::runtime_error.
+     */
+
+    class reader
+    {
+    public:
+        reader() : base(nullptr), cur(nullptr), end(nullptr) {}
+        reader(const uchar* data, long size) : base(data), cur(data), end(data + size) {}
+        explicit reader(const tr::file_view& file) : reader(file.data(), file.size()) {}
+
+        int8_t read8()
+        {
+            int8_t value;
+            read_bytes(&value, 1);
+            return value;
+        }
+
+        int16_t read16()
+        {
+            uint16_t value;
+            read_bytes(&value, 2);
+#ifdef TR_BIG_ENDIAN
+            value = __builtin_bswap16(value);
+#endif
+            return value;
+        }
+
+        int32_t read32()
+        {
+            uint32_t value;
+            read_bytes(&value, 4);
+#ifdef TR_BIG_ENDIAN
+            value = __builtin_bswap32(value);
+#endif
+            return value;
+        }
+
+        void read_bytes(void* dest, long size)
+        {
+            memcpy(dest, read_block(size), size);
+        }
+
+        void read16_array(uint16_t* dest, long count);
+        void read32_array(uint32_t* dest, long count);
+
+        // returns a pointer to the next size bytes and skips them
+        const uchar* read_block(long size)
+        {
+            check(size);
+            const uchar* block = cur;
+            cur += size;
+            return block;
+        }
+
+        void skip(long size)
+        {
+            check(size);
+            cur += size;
+        }
+
+        void seek(long offset)
+        {
+            if (offset < 0 || offset > end - base)
+                throw std::runtime_error("tr::reader: bad seek offset");
+            cur = base + offset;
+        }
+
+        long tell() const { return cur - base; }
+        long size() const { return end - base; }
+
+    private:
+        const uchar* base;
+        const uchar* cur;
+        const uchar* end;
+
+        void check(long size) const
+        {
+            if (size < 0 || size > end - cur)
+                throw std::runtime_error("tr::reader: unexpected end of file");
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tr_streamer.h"
+
+#include "tr_thread_pool.h"
+
+#include <algorithm>
+
+static float DistanceToAABB(glm::vec3 point, const glm::vec3 aabb[2])
+{
+    glm::vec3 d = glm::max(glm::max(aabb[0] - point, point - aabb[1]), glm::vec3(0.0f));
+    return glm::length(d);
+}
+
+/*
+ * tr::room_streamer
+ */
+
+tr::room_streamer::room_streamer(const char* filename, tr::level* level, tr::version version, const tr::room_loader::params& params) :
+    file(filename), level(level), radius(16 * 1024.0f), budget(64 * 1024 * 1024), total_resident_size(0)
+{
+    loader.init(tr::reader(file), level, version, params, true);
+    is_resident.resize(level->rooms.size(), false);
+}
+
+void tr::room_streamer::update(glm::vec3 position, std::vector<long>* loaded, std::vector<long>* evicted)
+{
+    loaded->clear();
+    evicted->clear();
+
+    long num_rooms = level->rooms.size();
+
+    std::vector<float> distance(num_rooms);
+    std::vector<long> order(num_rooms);
+    for (long i = 0; i < num_rooms; ++i) {
+        distance[i] = DistanceToAABB(position, level->rooms[i].aabb);
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&distance](long a, long b) {
+        return distance[a] < distance[b];
+    });
+
+    // rooms that should be loaded, nearest first
+    std::vector<bool> wanted(num_rooms, false);
+    size_t wanted_size = 0;
+    for (long i : order) {
+        if (distance[i] > radius)
+            break;
+        size_t size = loader.room_size(i);
+        if (wanted_size != 0 && wanted_size + size > budget)
+            break;
+        wanted[i] = true;
+        wanted_size += size;
+    }
+
+    std::vector<long> missing;
+    size_t missing_size = 0;
+    for (long i : order) {
+        if (wanted[i] && !is_resident[i]) {
+            missing.push_back(i);
+            missing_size += loader.room_size(i);
+        }
+    }
+
+    // evict the farthest rooms until the missing ones fit
+    for (auto it = order.rbegin(); it != order.rend() && total_resident_size + missing_size > budget; ++it) {
+        long i = *it;
+        if (is_resident[i] && !wanted[i]) {
+            loader.evict_room(i);
+            is_resident[i] = false;
+            total_resident_size -= loader.room_size(i);
+            evicted->push_back(i);
+        }
+    }
+
+    tr::thread_pool::global().parallel_for(missing.size(), [this, &missing](long j) {
+        loader.load_room(missing[j]);
+    });
+
+    for (long i : missing) {
+        is_resident[i] = true;
+        total_resident_size += loader.room_size(i);
+        loaded->push_back(i);
+    }
+}
@@ -0,0 +1,74 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TR_STREAMER_H
+#define TR_STREAMER_H
+
+#include "tr_loader.h"
+#include "tr_reader.h"
+#include "tr_types.h"
+
+#include <stddef.h>
+
+#include <vector>
+
+namespace tr
+{
+    /*
+     * tr::room_streamer
+     *
+     * Loads the rooms around the camera and evicts the rest when they
+     * don't fit into the memory budget. Rooms within the radius are loaded
+     * nearest first for as long as they fit (the nearest room always does),
+     * rooms outside of it stay loaded until their memory is needed.
+     *
+     * NOTE: only room geometry, lights, static meshes and static sprites
+     * are streamed, see tr::room_loader::init() for what is always loaded
+     */
+
+    class room_streamer
+    {
+    public:
+        room_streamer(const char* filename, tr::level* level, tr::version version, const tr::room_loader::params& params);
+
+        void set_radius(float radius) { this->radius = radius; }
+        void set_budget(size_t budget) { this->budget = budget; }
+
+        // returns the indices of the rooms that were loaded and evicted
+        void update(glm::vec3 position, std::vector<long>* loaded, std::vector<long>* evicted);
+
+        bool resident(long room_idx) const { return is_resident.at(room_idx); }
+        size_t resident_size() const { return total_resident_size; }
+
+    private:
+        room_streamer(const room_streamer&) = delete;
+        room_streamer& operator=(const room_streamer&) = delete;
+
+        tr::file_view file;
+        tr::level* level;
+        tr::room_loader loader;
+
+        float radius;
+        size_t budget;
+
+        std::vector<bool> is_resident;
+        size_t total_resident_size;
+    };
+}
+
+#endif
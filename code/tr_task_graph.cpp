@@ -0,0 +1,159 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tr_task_graph.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+
+typedef std::chrono::steady_clock Clock;
+
+static double Milliseconds(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+/*
+ * tr::task_graph
+ */
+
+tr::task_graph::task_id tr::task_graph::add(const std::string& name, std::function<void()> fn,
+                                            std::initializer_list<task_id> dependencies)
+{
+    task_id id = tasks.size();
+
+    tasks.emplace_back();
+    tasks.back().fn = std::move(fn);
+    for (task_id dependency : dependencies) {
+        assert(dependency >= 0 && dependency < id);
+        tasks.back().dependencies.push_back(dependency);
+        tasks[dependency].dependents.push_back(id);
+    }
+
+    task_timings.emplace_back();
+    task_timings.back().name = name;
+    task_timings.back().start = 0;
+    task_timings.back().duration = 0;
+
+    return id;
+}
+
+void tr::task_graph::run(tr::thread_pool& pool)
+{
+    std::mutex mutex;
+    std::condition_variable done_cv;
+    std::vector<size_t> num_pending(tasks.size());
+    long num_running = 0;
+    std::exception_ptr error;
+
+    Clock::time_point start_time = Clock::now();
+
+    std::vector<task_id> ready;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        num_pending[i] = tasks[i].dependencies.size();
+        if (num_pending[i] == 0)
+            ready.push_back(i);
+    }
+
+    // NOTE: the pool may run jobs inline, so jobs are never
+    // submitted while the mutex is held
+    std::function<void(task_id)> execute;
+    auto submit = [&](const std::vector<task_id>& ids) {
+        for (task_id id : ids)
+            pool.submit([&execute, id]() { execute(id); });
+    };
+
+    execute = [&](task_id id) {
+        Clock::time_point task_start = Clock::now();
+        std::exception_ptr task_error;
+        try {
+            tasks[id].fn();
+        } catch (...) {
+            task_error = std::current_exception();
+        }
+        Clock::time_point task_end = Clock::now();
+
+        std::vector<task_id> next;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task_timings[id].start = Milliseconds(start_time, task_start);
+            task_timings[id].duration = Milliseconds(task_start, task_end);
+            if (task_error && !error)
+                error = task_error;
+            if (!error) {
+                for (task_id dependent : tasks[id].dependents) {
+                    if (--num_pending[dependent] == 0)
+                        next.push_back(dependent);
+                }
+            }
+            num_running += next.size();
+        }
+
+        submit(next);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--num_running == 0)
+            done_cv.notify_all();
+    };
+
+    num_running = ready.size();
+    submit(ready);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cv.wait(lock, [&num_running]() { return num_running == 0; });
+    run_time = Milliseconds(start_time, Clock::now());
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+std::vector<tr::task_graph::task_id> tr::task_graph::critical_path() const
+{
+    std::vector<task_id> path;
+    if (tasks.empty())
+        return path;
+
+    auto end_time = [this](task_id id) {
+        return task_timings[id].start + task_timings[id].duration;
+    };
+
+    task_id last = 0;
+    for (size_t i = 1; i < tasks.size(); ++i) {
+        if (end_time(i) > end_time(last))
+            last = i;
+    }
+
+    // walk back through the dependency that finished last
+    for (task_id id = last; id >= 0; ) {
+        path.push_back(id);
+        task_id critical = -1;
+        for (task_id dependency : tasks[id].dependencies) {
+            if (critical < 0 || end_time(dependency) > end_time(critical))
+                critical = dependency;
+        }
+        id = critical;
+    }
+
+    std::reverse(path.begin(), path.end());
+    return path;
+}
@@ -0,0 +1,79 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TR_TASK_GRAPH_H
+#define TR_TASK_GRAPH_H
+
+#include "tr_thread_pool.h"
+
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+namespace tr
+{
+    /*
+     * tr::task_graph
+     *
+     * Runs a set of tasks on a thread pool, every task starts
+     * as soon as all of its dependencies have finished.
+     */
+
+    class task_graph
+    {
+    public:
+        typedef int task_id;
+
+        struct timing
+        {
+            std::string name;
+            double start, duration; // in milliseconds, relative to run()
+        };
+
+        // dependencies must be added before the tasks that depend on them
+        task_id add(const std::string& name, std::function<void()> fn,
+                    std::initializer_list<task_id> dependencies = {});
+
+        // rethrows the first exception thrown by a task, tasks that
+        // depend on the failed one are not started
+        void run(tr::thread_pool& pool);
+
+        // valid after run()
+        const std::vector<tr::task_graph::timing>& timings() const { return task_timings; }
+        double total_time() const { return run_time; }
+
+        // chain of tasks, each waiting on the previous one, that
+        // ends with the last task to finish
+        std::vector<task_id> critical_path() const;
+
+    private:
+        struct task
+        {
+            std::function<void()> fn;
+            std::vector<task_id> dependencies;
+            std::vector<task_id> dependents;
+        };
+
+        std::vector<task> tasks;
+        std::vector<tr::task_graph::timing> task_timings;
+        double run_time = 0;
+    };
+}
+
+#endif
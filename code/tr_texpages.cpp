@@ -0,0 +1,257 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "tr_texpages.h"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+    // inclusive texel bounds
+    struct TexRect
+    {
+        int x0, y0, x1, y1;
+
+        int Width() const { return x1 - x0 + 1; }
+        int Height() const { return y1 - y0 + 1; }
+    };
+
+    // texels of one page that are moved together
+    struct Island
+    {
+        long page;
+        TexRect rect;
+
+        long new_page;
+        int new_x, new_y;
+    };
+
+    // a texinfo or sprite
+    struct TexUser
+    {
+        ushort* texpage;
+        float (*texcoord)[2];
+        TexRect rect;
+        long island;
+    };
+}
+
+static bool Overlap(const TexRect& a, const TexRect& b)
+{
+    return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1;
+}
+
+static bool Contains(const TexRect& outer, const TexRect& inner)
+{
+    return outer.x0 <= inner.x0 && inner.x1 <= outer.x1 && outer.y0 <= inner.y0 && inner.y1 <= outer.y1;
+}
+
+static TexRect Union(const TexRect& a, const TexRect& b)
+{
+    TexRect result;
+    result.x0 = std::min(a.x0, b.x0);
+    result.y0 = std::min(a.y0, b.y0);
+    result.x1 = std::max(a.x1, b.x1);
+    result.y1 = std::max(a.y1, b.y1);
+    return result;
+}
+
+// texcoords are interpolated between the corners,
+// so the corners bound everything that is sampled
+static TexRect SampledRect(const float (*texcoord)[2])
+{
+    TexRect rect;
+    rect.x0 = rect.y0 = 0x7FFFFFFF;
+    rect.x1 = rect.y1 = -0x7FFFFFFF;
+    for (int i = 0; i < 4; ++i) {
+        int x = (int)floorf(texcoord[i][0] * 256.0f);
+        int y = (int)floorf(texcoord[i][1] * 256.0f);
+        rect.x0 = std::min(rect.x0, x);
+        rect.y0 = std::min(rect.y0, y);
+        rect.x1 = std::max(rect.x1, x);
+        rect.y1 = std::max(rect.y1, y);
+    }
+    return rect;
+}
+
+// merges the rectangles until none of them overlap
+static std::vector<TexRect> MergeRects(const std::vector<TexRect>& rects)
+{
+    std::vector<TexRect> merged;
+    for (TexRect rect : rects) {
+        for (size_t i = 0; i < merged.size(); ) {
+            if (Overlap(rect, merged[i])) {
+                rect = Union(rect, merged[i]);
+                merged.erase(merged.begin() + i);
+                i = 0;
+            } else {
+                ++i;
+            }
+        }
+        merged.push_back(rect);
+    }
+    return merged;
+}
+
+template <typename T>
+static void CopyRect(const T& src, const TexRect& rect, T* dest, int dest_x, int dest_y)
+{
+    for (int y = 0; y < rect.Height(); ++y) {
+        memcpy(&dest->pixels[dest_y + y][dest_x], &src.pixels[rect.y0 + y][rect.x0],
+               rect.Width() * sizeof(src.pixels[0][0]));
+    }
+}
+
+/*
+ * tr::compaction_report
+ */
+
+void tr::compaction_report::print(FILE* fp) const
+{
+    fprintf(fp, "texpage compaction: %ld -> %ld pages, %zu -> %zu bytes, %zu saved\n",
+            pages_before, pages_after, bytes_before, bytes_after, bytes_before - bytes_after);
+}
+
+/*
+ * texpage compaction
+ */
+
+void tr::compact_texpages(tr::level* level, tr::compaction_report* report)
+{
+    static const TexRect WHOLE_PAGE = { 0, 0, 255, 255 };
+
+    if (level->uploaded_data_released())
+        throw std::logic_error("tr::compact_texpages: the texpages were released");
+
+    long num_pages = level->texpages.size();
+    bool have_texpages16 = !level->texpages16.empty();
+    assert(!have_texpages16 || (long)level->texpages16.size() == num_pages);
+
+    std::vector<TexUser> users;
+    for (tr::texinfo& texinfo : level->texinfos)
+        users.push_back(TexUser{ &texinfo.texpage, texinfo.texcoord, TexRect(), -1 });
+    for (tr::sprite& sprite : level->sprites)
+        users.push_back(TexUser{ &sprite.texpage, sprite.texcoord, TexRect(), -1 });
+
+    // the rectangles each page is sampled in
+    std::vector<std::vector<TexRect>> page_rects(num_pages);
+    std::vector<bool> pinned(num_pages, false);
+    if (num_pages > 0)
+        pinned[0] = true;
+    for (TexUser& user : users) {
+        if (*user.texpage >= num_pages)
+            throw std::out_of_range("tr::compact_texpages: bad texpage");
+        user.rect = SampledRect(user.texcoord);
+        if (!Contains(WHOLE_PAGE, user.rect))
+            pinned[*user.texpage] = true;
+        page_rects[*user.texpage].push_back(user.rect);
+    }
+
+    std::vector<Island> islands;
+    for (long page = 0; page < num_pages; ++page) {
+        if (page_rects[page].empty() && !pinned[page])
+            continue;
+        std::vector<TexRect> rects = pinned[page] ? std::vector<TexRect>(1, WHOLE_PAGE) : MergeRects(page_rects[page]);
+        for (const TexRect& rect : rects)
+            islands.push_back(Island{ page, rect, -1, 0, 0 });
+    }
+
+    for (TexUser& user : users) {
+        for (size_t i = 0; i < islands.size(); ++i) {
+            const Island& island = islands[i];
+            if (island.page == *user.texpage && (pinned[island.page] || Contains(island.rect, user.rect))) {
+                user.island = i;
+                break;
+            }
+        }
+        assert(user.island >= 0);
+    }
+
+    // shelf packing, tallest first; page 0 stays where it is
+    std::vector<long> order;
+    for (size_t i = 0; i < islands.size(); ++i) {
+        if (islands[i].page == 0)
+            islands[i].new_page = 0;
+        else
+            order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&islands](long a, long b) {
+        if (islands[a].rect.Height() != islands[b].rect.Height())
+            return islands[a].rect.Height() > islands[b].rect.Height();
+        return islands[a].rect.Width() > islands[b].rect.Width();
+    });
+
+    long new_num_pages = (num_pages > 0) ? 1 : 0;
+    long page = -1;
+    int shelf_x = 0, shelf_y = 0, shelf_height = 0;
+    for (long i : order) {
+        Island& island = islands[i];
+        if (page < 0 || shelf_x + island.rect.Width() > 256) {
+            shelf_x = 0;
+            shelf_y += shelf_height;
+            shelf_height = island.rect.Height();
+        }
+        if (page < 0 || shelf_y + island.rect.Height() > 256) {
+            page = new_num_pages++;
+            shelf_x = shelf_y = 0;
+            shelf_height = island.rect.Height();
+        }
+        island.new_page = page;
+        island.new_x = shelf_x;
+        island.new_y = shelf_y;
+        shelf_x += island.rect.Width();
+    }
+
+    // copy the pixels
+    std::vector<tr::texpage> texpages(new_num_pages);
+    std::vector<tr::texpage16> texpages16(have_texpages16 ? new_num_pages : 0);
+    for (const Island& island : islands) {
+        CopyRect(level->texpages[island.page], island.rect, &texpages[island.new_page], island.new_x, island.new_y);
+        if (have_texpages16)
+            CopyRect(level->texpages16[island.page], island.rect, &texpages16[island.new_page], island.new_x, island.new_y);
+    }
+
+    // and point everything at them
+    for (TexUser& user : users) {
+        const Island& island = islands.at(user.island);
+        *user.texpage = island.new_page;
+        for (int i = 0; i < 4; ++i) {
+            user.texcoord[i][0] += (island.new_x - island.rect.x0) / 256.0f;
+            user.texcoord[i][1] += (island.new_y - island.rect.y0) / 256.0f;
+        }
+    }
+
+    size_t page_size = sizeof(tr::texpage) + (have_texpages16 ? sizeof(tr::texpage16) : 0);
+    if (report) {
+        report->pages_before = num_pages;
+        report->pages_after = new_num_pages;
+        report->bytes_before = num_pages * page_size;
+        report->bytes_after = new_num_pages * page_size;
+    }
+
+    level->texpages.swap(texpages);
+    level->texpages16.swap(texpages16);
+    level->texpages_compacted = true;
+}
@@ -0,0 +1,53 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef TR_TEXPAGES_H
+#define TR_TEXPAGES_H
+
+#include "tr_types.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
+namespace tr
+{
+    struct compaction_report
+    {
+        long pages_before, pages_after;
+        size_t bytes_before, bytes_after;
+
+        void print(FILE* fp) const;
+    };
+
+    /*
+     * texpage compaction
+     *
+     * Finds the texel rectangles that texinfos and sprites sample, and
+     * repacks them into as few texpages as possible. Texcoords and texpage
+     * indices are rewritten to match, pages nothing samples are dropped.
+     *
+     * Rectangles that overlap are moved together. Page 0 (the palette page)
+     * is never moved, and neither is a page that something samples outside
+     * of its bounds, since moving it would change what the sampler clamps to.
+     */
+
+    void compact_texpages(tr::level* level, tr::compaction_report* report = nullptr);
+}
+
+#endif
@@ -0,0 +1,152 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tr_thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+static unsigned global_num_threads = 0;
+
+/*
+ * tr::thread_pool
+ */
+
+tr::thread_pool::thread_pool(unsigned num_threads) :
+    stopping(false)
+{
+    for (unsigned i = 1; i < num_threads; ++i)
+        workers.emplace_back(&tr::thread_pool::worker_main, this);
+}
+
+tr::thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    jobs_cv.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+}
+
+void tr::thread_pool::submit(std::function<void()> job)
+{
+    if (workers.empty()) {
+        job();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    jobs_cv.notify_one();
+}
+
+void tr::thread_pool::parallel_for(long count, const std::function<void(long)>& fn)
+{
+    if (count <= 0)
+        return;
+
+    if (workers.empty() || count == 1) {
+        for (long i = 0; i < count; ++i)
+            fn(i);
+        return;
+    }
+
+    // NOTE: helpers can start after the loop is finished,
+    // so everything they touch lives in the shared state
+    struct loop_state
+    {
+        const std::function<void(long)>* fn;
+        long count;
+        std::atomic<long> next;
+        std::atomic<long> done;
+
+        std::mutex mutex;
+        std::condition_variable done_cv;
+        std::exception_ptr error;
+        long error_index;
+    };
+
+    std::shared_ptr<loop_state> state = std::make_shared<loop_state>();
+    state->fn = &fn;
+    state->count = count;
+    state->next = 0;
+    state->done = 0;
+    state->error_index = count;
+
+    auto run = [state]() {
+        long i;
+        while ((i = state->next.fetch_add(1)) < state->count) {
+            try {
+                (*state->fn)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (i < state->error_index) {
+                    state->error = std::current_exception();
+                    state->error_index = i;
+                }
+            }
+            if (state->done.fetch_add(1) + 1 == state->count) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->done_cv.notify_all();
+            }
+        }
+    };
+
+    long num_helpers = std::min<long>(workers.size(), count - 1);
+    for (long i = 0; i < num_helpers; ++i)
+        submit(run);
+    run();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->done_cv.wait(lock, [&state]() { return state->done == state->count; });
+    if (state->error)
+        std::rethrow_exception(state->error);
+}
+
+tr::thread_pool& tr::thread_pool::global()
+{
+    static tr::thread_pool pool(global_num_threads ? global_num_threads : std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+void tr::thread_pool::set_global_num_threads(unsigned num_threads)
+{
+    global_num_threads = num_threads;
+}
+
+void tr::thread_pool::worker_main()
+{
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            jobs_cv.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
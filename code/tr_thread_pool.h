@@ -0,0 +1,71 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TR_THREAD_POOL_H
+#define TR_THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tr
+{
+    /*
+     * tr::thread_pool
+     *
+     * NOTE: the thread that calls parallel_for() works on the loop too,
+     * so it's safe to call it from inside a job
+     */
+
+    class thread_pool
+    {
+    public:
+        // num_threads includes the calling thread
+        explicit thread_pool(unsigned num_threads);
+        ~thread_pool();
+
+        unsigned num_threads() const { return workers.size() + 1; }
+
+        void submit(std::function<void()> job);
+
+        // calls fn(i) for every i in [0, count) and waits for all of them;
+        // if any call throws, the exception with the lowest i is rethrown
+        void parallel_for(long count, const std::function<void(long)>& fn);
+
+        static tr::thread_pool& global();
+        // only has an effect before the first call to global()
+        static void set_global_num_threads(unsigned num_threads);
+
+    private:
+        thread_pool(const thread_pool&) = delete;
+        thread_pool& operator=(const thread_pool&) = delete;
+
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> jobs;
+        std::mutex mutex;
+        std::condition_variable jobs_cv;
+        bool stopping;
+
+        void worker_main();
+    };
+}
+
+#endif
@@ -19,9 +19,15 @@
 #include "tr_types.h"
 
 #include "tr_loader.h"
+#include "tr_memory.h"
+#include "tr_reader.h"
+#include "tr_streamer.h"
+#include "tr_texpages.h"
 
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <stdexcept>
+
 static glm::quat AxisAngleToQuaternion(glm::vec3 axis, float angle)
 {
     float s = glm::sin(angle/2), c = glm::cos(angle/2);
@@ -42,23 +48,25 @@ static glm::quat EulerAnglesToQuaternion(glm::vec3 angles)
     );
 }
 
-tr::model_object::model_object(const tr::level* level, const tr::model* model) :
+tr::model_object::model_object(const tr::level* level, tr::handle<tr::model> model) :
     model(model), level(level)
 {
-    animation = model->animation;
-    anim_tick = animation->first_tick;
+    animation = level->get(model).animation;
+    anim_tick = level->get(animation).first_tick;
     anim_tick_time = 0;
     update_node_transforms();
 }
 
 void tr::model_object::tick(float dt)
 {
+    const tr::animation& animation = level->get(this->animation);
+
     anim_tick_time += dt;
     if (anim_tick_time >= 1.0f / 30.0f) {
         anim_tick_time -= 1.0f / 30.0f;
         ++anim_tick;
-        if (anim_tick > animation->last_tick)
-            anim_tick = animation->first_tick;
+        if (anim_tick > animation.last_tick)
+            anim_tick = animation.first_tick;
     }
 
     update_node_transforms();
@@ -66,17 +74,18 @@ void tr::model_object::tick(float dt)
 
 void tr::model_object::update_node_transforms()
 {
+    const tr::model& model = level->get(this->model);
     tr::anim_frame af = smooth_anim_frame();
 
     node_transforms.clear();
-    for (size_t i = 0; i < model->nodes.size(); ++i) {
+    for (size_t i = 0; i < model.nodes.size(); ++i) {
         glm::mat4 transform;
         if (i == 0)
             transform = glm::translate(glm::mat4(), af.translation);
         else
-            transform = node_transforms.at(model->nodes[i].parent);
+            transform = node_transforms.at(model.nodes[i].parent);
 
-        glm::mat4 translation = glm::translate(glm::mat4(), model->nodes[i].offset);
+        glm::mat4 translation = glm::translate(glm::mat4(), model.nodes[i].offset);
         transform = transform * translation;
 
         glm::mat4 rotation = glm::mat4_cast(af.rotation[i]);
@@ -88,23 +97,26 @@ void tr::model_object::update_node_transforms()
 
 tr::anim_frame tr::model_object::smooth_anim_frame() const
 {
-    int frame = (anim_tick - animation->first_tick) / animation->ticks_per_frame;
-    int num_frames = (animation->last_tick - animation->first_tick) / animation->ticks_per_frame + 1;
+    const tr::model& model = level->get(this->model);
+    const tr::animation& animation = level->get(this->animation);
+
+    int frame = (anim_tick - animation.first_tick) / animation.ticks_per_frame;
+    int num_frames = (animation.last_tick - animation.first_tick) / animation.ticks_per_frame + 1;
 
-    ulong offset = animation->frame_offset;
+    ulong offset = animation.frame_offset;
     for (int i = 0; i < frame; ++i)
         offset += level->anim_frame_data.at(offset) + 1;
     tr::anim_frame af0 = parse_anim_frame(offset);
     offset += level->anim_frame_data.at(offset) + 1;
     if (frame >= num_frames - 1)
-        offset = animation->frame_offset;
+        offset = animation.frame_offset;
     tr::anim_frame af1 = parse_anim_frame(offset);
 
-    ushort cur_frame_tick = (anim_tick - animation->first_tick) % animation->ticks_per_frame;
-    float alpha = (cur_frame_tick + anim_tick_time * 30.0f) / animation->ticks_per_frame;
+    ushort cur_frame_tick = (anim_tick - animation.first_tick) % animation.ticks_per_frame;
+    float alpha = (cur_frame_tick + anim_tick_time * 30.0f) / animation.ticks_per_frame;
     tr::anim_frame af;
     af.translation = glm::mix(af0.translation, af1.translation, alpha);
-    for (size_t i = 0; i < model->nodes.size(); ++i)
+    for (size_t i = 0; i < model.nodes.size(); ++i)
         af.rotation[i] = glm::slerp(af0.rotation[i], af1.rotation[i], alpha);
     return af;
 }
@@ -125,7 +137,8 @@ tr::anim_frame tr::model_object::parse_anim_frame(ulong offset) const
     af.translation.z = (int16_t)level->anim_frame_data.at(offset++);
     frame_size -= 3;
 
-    for (size_t i = 0; i < model->nodes.size(); ++i) {
+    size_t num_nodes = level->get(model).nodes.size();
+    for (size_t i = 0; i < num_nodes; ++i) {
         assert(frame_size > 0);
         uint16_t tmp1 = level->anim_frame_data.at(offset++);
         --frame_size;
@@ -155,7 +168,253 @@ tr::anim_frame tr::model_object::parse_anim_frame(ulong offset) const
     return af;
 }
 
-std::unique_ptr<tr::level> tr::level::load(const char* filename, tr::version version)
+/*
+ * tr::id_index
+ */
+
+long tr::id_index::find(ulong id) const
+{
+    if (id <= MAX_DIRECT_ID)
+        return (id < direct.size()) ? direct[id] : -1;
+
+    auto it = std::lower_bound(large_ids.begin(), large_ids.end(), id, [](const std::pair<ulong, long>& entry, ulong id) {
+        return entry.first < id;
+    });
+    return (it != large_ids.end() && it->first == id) ? it->second : -1;
+}
+
+size_t tr::id_index::bytes() const
+{
+    return direct.capacity() * sizeof(long) + large_ids.capacity() * sizeof(std::pair<ulong, long>);
+}
+
+void tr::id_index::clear()
+{
+    direct.clear();
+    large_ids.clear();
+}
+
+void tr::id_index::insert(ulong id, long idx)
+{
+    if (id > MAX_DIRECT_ID) {
+        large_ids.push_back(std::make_pair(id, idx));
+        return;
+    }
+
+    if (id >= direct.size())
+        direct.resize(id + 1, -1);
+    // the first item with the ID wins
+    if (direct[id] == -1)
+        direct[id] = idx;
+}
+
+/*
+ * tr::level
+ */
+
+tr::level::level() :
+    source_version(tr::version_invalid), source_cached(false), source_texpages16(false), source_hash(0), texpages_compacted(false),
+    is_uploaded_data_released(false)
+{
+}
+
+tr::level::~level()
+{
+}
+
+template <typename T>
+static tr::handle<T> IndexToHandle(long idx)
+{
+    return (idx >= 0) ? tr::handle<T>(idx) : tr::handle<T>();
+}
+
+tr::handle<tr::model> tr::level::find_model(ulong id) const
+{
+    return IndexToHandle<tr::model>(model_ids.find(id));
+}
+
+tr::handle<tr::sprite_sequence> tr::level::find_sprite_sequence(ulong id) const
+{
+    return IndexToHandle<tr::sprite_sequence>(sprite_sequence_ids.find(id));
+}
+
+tr::handle<tr::static_mesh> tr::level::find_static_mesh(ulong id) const
+{
+    return IndexToHandle<tr::static_mesh>(static_mesh_ids.find(id));
+}
+
+void tr::level::build_id_index()
+{
+    model_ids.build(models);
+    sprite_sequence_ids.build(sprite_sequences);
+    static_mesh_ids.build(static_meshes);
+}
+
+template <typename T>
+static size_t VectorBytes(const std::vector<T>& v)
+{
+    return v.capacity() * sizeof(T);
+}
+
+template <typename T>
+static size_t SpanBytes(tr::span<T> s)
+{
+    return s.size() * sizeof(T);
+}
+
+void tr::level::memory_usage(tr::memory_report* report) const
+{
+    report->add("palette", sizeof(palette));
+    report->add("texpages", VectorBytes(texpages));
+    report->add("texpages16", VectorBytes(texpages16));
+    report->add("texinfos", VectorBytes(texinfos) + VectorBytes(file_texinfos));
+
+    size_t meshes_bytes = VectorBytes(meshes) + VectorBytes(file_meshes);
+    for (const tr::mesh& mesh : meshes)
+        meshes_bytes += mesh.bytes();
+    report->add("meshes", meshes_bytes);
+
+    size_t models_bytes = VectorBytes(models);
+    for (const tr::model& model : models)
+        models_bytes += SpanBytes(model.nodes);
+    report->add("models", models_bytes);
+    report->add("static_meshes", VectorBytes(static_meshes));
+
+    size_t sprites_bytes = VectorBytes(sprites) + VectorBytes(sprite_sequences);
+    for (const tr::sprite_sequence& sequence : sprite_sequences)
+        sprites_bytes += SpanBytes(sequence.sprites);
+    report->add("sprites", sprites_bytes);
+
+    report->add("animations", VectorBytes(animations) + VectorBytes(anim_structs) +
+                VectorBytes(anim_ranges) + VectorBytes(anim_command_data));
+    report->add("anim_frame_data", VectorBytes(anim_frame_data));
+
+    // includes the rooms that are streamed in
+    size_t rooms_bytes = VectorBytes(rooms), room_geometry_bytes = 0;
+    for (const tr::room& room : rooms) {
+        rooms_bytes += SpanBytes(room.lights) + SpanBytes(room.static_meshes) + SpanBytes(room.static_sprites);
+        room_geometry_bytes += room.geometry.bytes();
+    }
+    report->add("rooms", rooms_bytes);
+    report->add("room_geometry", room_geometry_bytes);
+
+    size_t objects_bytes = VectorBytes(model_objects) + VectorBytes(sprite_objects);
+    for (const tr::model_object& modelobj : model_objects)
+        objects_bytes += VectorBytes(modelobj.node_transforms);
+    report->add("objects", objects_bytes);
+
+    report->add("id_indices", model_ids.bytes() + sprite_sequence_ids.bytes() + static_mesh_ids.bytes());
+    report->add("arena_unused", arena.reserved() - arena.used() + geometry.reserved() - geometry.used());
+}
+
+void tr::level::release_uploaded_data()
+{
+    std::vector<tr::texpage>().swap(texpages);
+    std::vector<tr::texpage16>().swap(texpages16);
+
+    // rooms that stream in later may bake static meshes into their geometry
+    if (!room_streamer) {
+        for (tr::mesh& mesh : meshes) {
+            mesh.positions = tr::span<glm::vec3>();
+            mesh.lightattribs = tr::span<glm::vec3>();
+            mesh.poly_verts = tr::span<tr::mesh_poly_verts>();
+            mesh.poly_texinfos = tr::span<tr::handle<tr::texinfo>>();
+        }
+        for (tr::room& room : rooms) {
+            room.geometry.positions = tr::span<glm::vec3>();
+            room.geometry.lightattribs = tr::span<glm::vec3>();
+            room.geometry.poly_verts = tr::span<tr::mesh_poly_verts>();
+            room.geometry.poly_texinfos = tr::span<tr::handle<tr::texinfo>>();
+        }
+        geometry.clear();
+    }
+
+    is_uploaded_data_released = true;
+}
+
+void tr::level::reload_uploaded_data()
+{
+    if (!is_uploaded_data_released)
+        return;
+
+    // streamed rooms aren't needed, so they aren't decoded
+    std::unique_ptr<tr::level> source;
+    if (room_streamer)
+        source = tr::loader::load_streaming(source_filename.c_str(), source_version, source_texpages16);
+    else if (source_cached)
+        source = tr::loader::load_cached(source_filename.c_str(), source_version, source_texpages16);
+    else
+        source = tr::loader::load(source_filename.c_str(), source_version, source_texpages16);
+    if (texpages_compacted)
+        tr::compact_texpages(source.get());
+
+    if (source->source_hash != source_hash)
+        throw std::runtime_error("tr::level::reload_uploaded_data: the level file has changed");
+
+    texpages.swap(source->texpages);
+    texpages16.swap(source->texpages16);
+
+    geometry.swap(source->geometry);
+    for (std::unique_ptr<tr::file_view>& file : source->cache_files)
+        cache_files.push_back(std::move(file));
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        const tr::mesh& mesh = source->meshes[i];
+        meshes[i].positions = mesh.positions;
+        meshes[i].lightattribs = mesh.lightattribs;
+        meshes[i].poly_verts = mesh.poly_verts;
+        meshes[i].poly_texinfos = mesh.poly_texinfos;
+    }
+    if (!room_streamer) {
+        for (size_t i = 0; i < rooms.size(); ++i) {
+            const tr::mesh& mesh = source->rooms[i].geometry;
+            rooms[i].geometry.positions = mesh.positions;
+            rooms[i].geometry.lightattribs = mesh.lightattribs;
+            rooms[i].geometry.poly_verts = mesh.poly_verts;
+            rooms[i].geometry.poly_texinfos = mesh.poly_texinfos;
+        }
+    }
+
+    is_uploaded_data_released = false;
+}
+
+// how far the peak resident size rose while loading
+template <typename Load>
+static std::unique_ptr<tr::level> MeasurePeak(tr::load_report* report, Load load)
+{
+    size_t start = tr::reset_peak_resident_size();
+    std::unique_ptr<tr::level> level = load();
+    if (report) {
+        size_t peak = tr::peak_resident_size();
+        report->peak_bytes = (peak > start) ? peak - start : 0;
+    }
+    return level;
+}
+
+static void SetSource(tr::level* level, const char* filename, tr::version version, bool cached, bool texpages16)
+{
+    level->source_filename = filename;
+    level->source_version = version;
+    level->source_cached = cached;
+    level->source_texpages16 = texpages16;
+}
+
+std::unique_ptr<tr::level> tr::level::load(const char* filename, tr::version version, bool texpages16, tr::load_report* report)
+{
+    std::unique_ptr<tr::level> level = MeasurePeak(report, [=]() { return tr::loader::load(filename, version, texpages16, report); });
+    SetSource(level.get(), filename, version, false, texpages16);
+    return level;
+}
+
+std::unique_ptr<tr::level> tr::level::load_cached(const char* filename, tr::version version, bool texpages16, tr::load_report* report)
+{
+    std::unique_ptr<tr::level> level = MeasurePeak(report, [=]() { return tr::loader::load_cached(filename, version, texpages16, report); });
+    SetSource(level.get(), filename, version, true, texpages16);
+    return level;
+}
+
+std::unique_ptr<tr::level> tr::level::load_streaming(const char* filename, tr::version version, bool texpages16, tr::load_report* report)
 {
-    return tr::loader::load(filename, version);
+    std::unique_ptr<tr::level> level = MeasurePeak(report, [=]() { return tr::loader::load_streaming(filename, version, texpages16, report); });
+    SetSource(level.get(), filename, version, false, texpages16);
+    return level;
 }
@@ -23,7 +23,14 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include "tr_arena.h"
+
+#include <stdint.h>
+
+#include <algorithm>
 #include <memory>
+#include <string>
+#include <utility>
 #include <vector>
 
 typedef unsigned char uchar;
@@ -34,17 +41,58 @@ typedef unsigned long ulong;
 namespace tr
 {
     struct level;
+    struct load_report;
+    struct memory_report;
+    class room_streamer;
+    class file_view;
+
+    /*
+     * tr::handle
+     *
+     * A reference to an item of one of the level arrays, stored as its
+     * index. Handles stay valid when the arrays move and mean the same
+     * in the level cache, use tr::level::get() to resolve them.
+     */
+
+    template <typename T>
+    struct handle
+    {
+        static const uint32_t NONE = 0xFFFFFFFF;
+
+        uint32_t index;
+
+        handle() : index(NONE) {}
+        explicit handle(uint32_t index) : index(index) {}
 
+        bool valid() const { return index != NONE; }
+
+        bool operator==(handle other) const { return index == other.index; }
+        bool operator!=(handle other) const { return index != other.index; }
+    };
+
+    // palette indices, index 0 is transparent
     struct texpage
     {
-        uchar pixels[256][256][4];
+        uchar pixels[256][256];
+    };
+
+    // argb1555, the same page as the indexed one
+    struct texpage16
+    {
+        uint16_t pixels[256][256];
+    };
+
+    // rgba, with 0 alpha for index 0
+    struct palette
+    {
+        uchar colors[256][4];
     };
 
     struct texinfo
     {
         float texcoord[4][2];
         ushort texpage, texalphamode;
-        tr::texinfo* texanimchain;
+        tr::handle<tr::texinfo> texanimchain;
     };
 
     enum mesh_lightmode
@@ -59,18 +107,63 @@ namespace tr
         glm::vec3 lightattrib;
     };
 
+    // triangles have verts[3] == (ushort)-1
+    struct mesh_poly_verts
+    {
+        ushort verts[4];
+    };
+
     struct mesh_poly
     {
         ushort verts[4];
-        tr::texinfo* texinfo;
+        tr::handle<tr::texinfo> texinfo;
     };
 
+    /*
+     * tr::mesh
+     *
+     * Vertices and polygons are stored as structures of arrays, so that
+     * passes that only need one attribute don't have to touch the others.
+     * vert() and poly() put one vertex or polygon back together.
+     */
+
     struct mesh
     {
         ulong id;
         tr::mesh_lightmode lightmode;
-        std::vector<tr::mesh_vert> verts;
-        std::vector<tr::mesh_poly> polys;
+
+        // normals for externally lit meshes, intensities otherwise
+        tr::span<glm::vec3> positions;
+        tr::span<glm::vec3> lightattribs;
+
+        tr::span<tr::mesh_poly_verts> poly_verts;
+        tr::span<tr::handle<tr::texinfo>> poly_texinfos;
+
+        size_t num_verts() const { return positions.size(); }
+        size_t num_polys() const { return poly_verts.size(); }
+
+        // bytes of the vertex and polygon arrays
+        size_t bytes() const
+        {
+            return positions.size() * sizeof(glm::vec3) + lightattribs.size() * sizeof(glm::vec3) +
+                poly_verts.size() * sizeof(tr::mesh_poly_verts) + poly_texinfos.size() * sizeof(tr::handle<tr::texinfo>);
+        }
+
+        tr::mesh_vert vert(size_t idx) const
+        {
+            tr::mesh_vert result;
+            result.position = positions[idx];
+            result.lightattrib = lightattribs[idx];
+            return result;
+        }
+
+        tr::mesh_poly poly(size_t idx) const
+        {
+            tr::mesh_poly result;
+            std::copy(poly_verts[idx].verts, poly_verts[idx].verts + 4, result.verts);
+            result.texinfo = poly_texinfos[idx];
+            return result;
+        }
     };
 
     struct anim_frame
@@ -112,14 +205,14 @@ namespace tr
     {
         int parent;
         glm::vec3 offset;
-        const tr::mesh* mesh;
+        tr::handle<tr::mesh> mesh;
     };
 
     struct model
     {
         ulong id;
-        std::vector<tr::model_node> nodes;
-        const tr::animation* animation;
+        tr::span<tr::model_node> nodes;
+        tr::handle<tr::animation> animation;
     };
 
     struct sprite
@@ -133,7 +226,13 @@ namespace tr
     struct sprite_sequence
     {
         ulong id;
-        std::vector<const tr::sprite*> sprites;
+        tr::span<tr::handle<tr::sprite>> sprites;
+    };
+
+    struct static_mesh
+    {
+        ulong id;
+        tr::handle<tr::mesh> mesh;
     };
 
     struct room_light
@@ -144,14 +243,14 @@ namespace tr
 
     struct room_static_mesh
     {
-        const tr::mesh* mesh;
+        tr::handle<tr::mesh> mesh;
         glm::mat4 transform;
         float light_intensity;
     };
 
     struct room_static_sprite
     {
-        const tr::sprite* sprite;
+        tr::handle<tr::sprite> sprite;
         glm::vec3 position;
         float light_intensity;
     };
@@ -160,26 +259,29 @@ namespace tr
     {
         ulong id;
 
+        // world space bounds, known even if the room isn't loaded
+        glm::vec3 aabb[2];
+
         tr::mesh geometry;
         float ambient_light_intensity;
 
-        std::vector<tr::room_light> lights;
-        std::vector<tr::room_static_mesh> static_meshes;
-        std::vector<tr::room_static_sprite> static_sprites;
+        tr::span<tr::room_light> lights;
+        tr::span<tr::room_static_mesh> static_meshes;
+        tr::span<tr::room_static_sprite> static_sprites;
 
         ushort altroom, flags;
     };
 
     struct model_object
     {
-        const tr::model* model;
+        tr::handle<tr::model> model;
         std::vector<glm::mat4> node_transforms;
 
-        const tr::room* room;
+        tr::handle<tr::room> room;
         glm::mat4 transform;
         float light_intensity;
 
-        model_object(const tr::level* level, const tr::model* model);
+        model_object(const tr::level* level, tr::handle<tr::model> model);
         void tick(float dt);
 
     private:
@@ -187,7 +289,7 @@ namespace tr
 
         // TODO: cache current/next frames
         // TODO: use real time instead of engine ticks
-        const tr::animation* animation;
+        tr::handle<tr::animation> animation;
         ushort anim_tick;
         float anim_tick_time;
 
@@ -198,14 +300,51 @@ namespace tr
 
     struct sprite_object
     {
-        const tr::sprite_sequence* sequence;
+        tr::handle<tr::sprite_sequence> sequence;
         ushort frame;
 
-        const tr::room* room;
+        tr::handle<tr::room> room;
         glm::vec3 position;
         float light_intensity;
     };
 
+    /*
+     * tr::id_index
+     *
+     * Maps object IDs to indices into the array they were built from.
+     * IDs are small, so they are looked up in a direct-mapped table,
+     * the rare large ones in a sorted list.
+     */
+
+    class id_index
+    {
+    public:
+        template <typename T>
+        void build(const std::vector<T>& items)
+        {
+            clear();
+            for (size_t i = 0; i < items.size(); ++i)
+                insert(items[i].id, i);
+            std::stable_sort(large_ids.begin(), large_ids.end(), [](const std::pair<ulong, long>& a, const std::pair<ulong, long>& b) {
+                return a.first < b.first;
+            });
+        }
+
+        // returns -1 if there is no such ID
+        long find(ulong id) const;
+
+        size_t bytes() const;
+
+    private:
+        static const ulong MAX_DIRECT_ID = 0xFFFF;
+
+        std::vector<long> direct;
+        std::vector<std::pair<ulong, long>> large_ids;
+
+        void clear();
+        void insert(ulong id, long idx);
+    };
+
     enum version
     {
         version_invalid,
@@ -216,14 +355,48 @@ namespace tr
 
     struct level
     {
+        // backs the spans of meshes, models, sprite sequences and rooms,
+        // except for streamed rooms, see tr::room_streamer
+        tr::arena arena;
+        // the vertex and polygon arrays of meshes and rooms,
+        // so that they can be released on their own
+        tr::arena geometry;
+        // a cached level's spans point into its mapped cache file instead
+        // of the arenas, see tr::read_level_cache(); a reload that reads the
+        // cache again adds its file
+        std::vector<std::unique_ptr<tr::file_view>> cache_files;
+
+        // where the level was loaded from, see reload_uploaded_data()
+        std::string source_filename;
+        tr::version source_version;
+        bool source_cached;
+        bool source_texpages16;
+        // tr::hash64() of the level file, set by the loader
+        uint64_t source_hash;
+        // set by tr::compact_texpages()
+        bool texpages_compacted;
+
         std::vector<tr::room> rooms;
 
+        // texpage 0 is the palette itself, so that untextured
+        // polygons can use it for their colors
+        tr::palette palette;
         std::vector<tr::texpage> texpages;
+        // only for versions that have them and only if the load asked
+        // for them, same indices as texpages
+        std::vector<tr::texpage16> texpages16;
         std::vector<tr::texinfo> texinfos;
 
         std::vector<tr::mesh> meshes;
         std::vector<tr::model> models;
 
+        // the texinfo and mesh indices of the level file; duplicates
+        // share one texinfo or mesh, see tr::loader::load_meshes()
+        std::vector<tr::handle<tr::texinfo>> file_texinfos;
+        std::vector<tr::handle<tr::mesh>> file_meshes;
+
+        std::vector<tr::static_mesh> static_meshes;
+
         std::vector<tr::sprite> sprites;
         std::vector<tr::sprite_sequence> sprite_sequences;
 
@@ -236,7 +409,59 @@ namespace tr
         std::vector<tr::model_object> model_objects;
         std::vector<tr::sprite_object> sprite_objects;
 
-        static std::unique_ptr<tr::level> load(const char* filename, tr::version version);
+        tr::id_index model_ids;
+        tr::id_index sprite_sequence_ids;
+        tr::id_index static_mesh_ids;
+
+        // only set for levels loaded with load_streaming()
+        std::unique_ptr<tr::room_streamer> room_streamer;
+
+        level();
+        ~level();
+
+        // throw std::out_of_range if the handle isn't valid
+        const tr::room& get(tr::handle<tr::room> h) const { return rooms.at(h.index); }
+        const tr::texinfo& get(tr::handle<tr::texinfo> h) const { return texinfos.at(h.index); }
+        const tr::mesh& get(tr::handle<tr::mesh> h) const { return meshes.at(h.index); }
+        const tr::model& get(tr::handle<tr::model> h) const { return models.at(h.index); }
+        const tr::static_mesh& get(tr::handle<tr::static_mesh> h) const { return static_meshes.at(h.index); }
+        const tr::sprite& get(tr::handle<tr::sprite> h) const { return sprites.at(h.index); }
+        const tr::sprite_sequence& get(tr::handle<tr::sprite_sequence> h) const { return sprite_sequences.at(h.index); }
+        const tr::animation& get(tr::handle<tr::animation> h) const { return animations.at(h.index); }
+
+        // return an invalid handle if there is no such ID
+        tr::handle<tr::model> find_model(ulong id) const;
+        tr::handle<tr::sprite_sequence> find_sprite_sequence(ulong id) const;
+        tr::handle<tr::static_mesh> find_static_mesh(ulong id) const;
+        void build_id_index();
+
+        // CPU bytes per level member, the spans are counted
+        // with their arrays and the unused arena space separately
+        void memory_usage(tr::memory_report* report) const;
+
+        // frees the texpages and the mesh and room geometry, which only the
+        // renderer needs and only until it has uploaded them; texinfos,
+        // bounds and everything else stay. With a room streamer only the
+        // texpages are released: the geometry of streamed rooms belongs to
+        // the streamer, and the meshes are needed when they stream in. The
+        // geometry of a cached level stays in the mapped cache file, whose
+        // clean pages the system reclaims on its own.
+        void release_uploaded_data();
+        bool uploaded_data_released() const { return is_uploaded_data_released; }
+        // reads the released data back from the level file, or its cache,
+        // for consumers that need it again; does nothing if nothing was
+        // released. Throws std::runtime_error if the file has changed.
+        void reload_uploaded_data();
+
+        // texpages16 reads the 16-bit texpages of the versions that have
+        // them, which only the RGB5_A1 renderer format uses
+        static std::unique_ptr<tr::level> load(const char* filename, tr::version version, bool texpages16, tr::load_report* report = nullptr);
+        static std::unique_ptr<tr::level> load_cached(const char* filename, tr::version version, bool texpages16, tr::load_report* report = nullptr);
+        // rooms are only indexed, see tr::room_streamer
+        static std::unique_ptr<tr::level> load_streaming(const char* filename, tr::version version, bool texpages16, tr::load_report* report = nullptr);
+
+    private:
+        bool is_uploaded_data_released;
     };
 }
 
@@ -0,0 +1,71 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TR_VERSION_H
+#define TR_VERSION_H
+
+#include "tr_types.h"
+
+namespace tr
+{
+    /*
+     * tr::version_traits
+     *
+     * Record layouts that differ between game versions. The loader is
+     * instantiated once per version, so none of these are checked at runtime.
+     */
+
+    template <tr::version V>
+    struct version_traits;
+
+    template <>
+    struct version_traits<tr::version_tr1>
+    {
+        // x, y, z, lighting
+        static constexpr long room_vertex_size = 8;
+
+        // rooms, room lights, room static meshes and objects
+        // have a second light intensity
+        static constexpr bool dual_lighting = false;
+        // rooms have a light mode
+        static constexpr bool room_light_mode = false;
+
+        // animations store the size of their frames,
+        // otherwise frames have a variable number of angle sets
+        static constexpr bool sized_anim_frames = false;
+
+        // texpages are also stored as argb1555
+        static constexpr bool texpages16 = false;
+    };
+
+    template <>
+    struct version_traits<tr::version_tr2>
+    {
+        // x, y, z, lighting, attributes, lighting 2
+        static constexpr long room_vertex_size = 12;
+
+        static constexpr bool dual_lighting = true;
+        static constexpr bool room_light_mode = true;
+
+        static constexpr bool sized_anim_frames = true;
+
+        static constexpr bool texpages16 = true;
+    };
+}
+
+#endif
@@ -11,7 +11,8 @@ uniform float LightIntensity;
 
 in vec4 VertPosition;
 in vec2 VertTexCoord;
-in ivec2 VertTexAttrib;
+// texpage, alpha mode in the top two bits
+in int VertTexAttrib;
 
 out VertexData
 {
@@ -24,6 +25,7 @@ void main()
 {
     gl_Position = ProjectionMatrix * ViewMatrix * ModelMatrix * VertPosition;
     Color = vec3(LightIntensity);
-    TexCoord = VertTexCoord;
-    TexAttrib = VertTexAttrib;
+    // texcoords are in 1/65536ths
+    TexCoord = VertTexCoord / 65536.0;
+    TexAttrib = ivec2(VertTexAttrib & 0x3FFF, VertTexAttrib >> 14);
 }
@@ -26,7 +26,8 @@ uniform float LightIntensity;
 in vec4 VertPosition;
 in vec2 VertTexCoord;
 in vec3 VertNormal;
-in ivec2 VertTexAttrib;
+// texpage, alpha mode in the top two bits
+in int VertTexAttrib;
 
 out VertexData
 {
@@ -59,8 +60,9 @@ void main()
 
     Color = AmbientLightIntensity + vec3(DiffuseIntensity);
 
-    TexCoord = VertTexCoord;
-    TexAttrib = VertTexAttrib;
+    // texcoords are in 1/65536ths
+    TexCoord = VertTexCoord / 65536.0;
+    TexAttrib = ivec2(VertTexAttrib & 0x3FFF, VertTexAttrib >> 14);
 
     gl_Position = ProjectionMatrix * ViewMatrix * WorldSpacePosition;
 }
@@ -0,0 +1,86 @@
+#version 430 core
+
+layout (std140) uniform TransformBlock
+{
+    mat4 ProjectionMatrix;
+    mat4 ViewMatrix;
+};
+
+struct DrawData
+{
+    mat4 ModelMatrix;
+    float LightIntensity;
+    int LightingBlock;
+};
+
+layout (std430) readonly buffer DrawDataBlock
+{
+    DrawData Draws[];
+};
+
+struct Light
+{
+    vec3 Position;
+    vec2 Attribs; // [0] - intensity, [1] - falloff
+};
+
+// the same layout as the RoomLightingBlock of the other shaders
+struct RoomLighting
+{
+    float AmbientLightIntensity;
+
+    int NumLights;
+    Light Lights[8];
+};
+
+layout (std430) readonly buffer RoomLightingBuffer
+{
+    RoomLighting Rooms[];
+};
+
+in vec4 VertPosition;
+in vec2 VertTexCoord;
+in vec3 VertNormal;
+// texpage, alpha mode in the top two bits
+in int VertTexAttrib;
+// the base instance of the draw command plus the instance
+in int VertDrawIndex;
+
+out VertexData
+{
+    vec3 Color;
+    vec2 TexCoord;
+    flat ivec2 TexAttrib;
+};
+
+void main()
+{
+    mat4 ModelMatrix = Draws[VertDrawIndex].ModelMatrix;
+    int Room = Draws[VertDrawIndex].LightingBlock;
+
+    vec4 WorldSpacePosition = ModelMatrix * VertPosition;
+    vec3 WorldSpaceNormal = mat3(ModelMatrix) * VertNormal;
+
+    // see mesh_external.vert
+    float DiffuseIntensity = 0.0;
+    for (int i = 0; i < Rooms[Room].NumLights; ++i) {
+        Light RoomLight = Rooms[Room].Lights[i];
+        float LightDistance = length(RoomLight.Position - WorldSpacePosition.xyz);
+        float LightAttenuation = 1.0 / (1.0 + LightDistance / RoomLight.Attribs[1]);
+        if (dot(VertNormal, VertNormal) < 0.01) {
+            DiffuseIntensity += 0.5 * RoomLight.Attribs[0] * LightAttenuation;
+        } else {
+            vec3 LightVec = normalize(RoomLight.Position - WorldSpacePosition.xyz);
+            vec3 NormalVec = normalize(WorldSpaceNormal);
+            DiffuseIntensity += RoomLight.Attribs[0] * LightAttenuation * (0.5 + max(dot(LightVec, NormalVec), 0.0));
+        }
+    }
+
+    Color = Rooms[Room].AmbientLightIntensity + vec3(DiffuseIntensity);
+
+    // texcoords are in 1/65536ths
+    TexCoord = VertTexCoord / 65536.0;
+    TexAttrib = ivec2(VertTexAttrib & 0x3FFF, VertTexAttrib >> 14);
+
+    gl_Position = ProjectionMatrix * ViewMatrix * WorldSpacePosition;
+}
@@ -0,0 +1,41 @@
+#version 150 core
+
+layout (std140) uniform TransformBlock
+{
+    mat4 ProjectionMatrix;
+    mat4 ViewMatrix;
+};
+
+// 4 texels per instance: the top three rows of
+// the model matrix, then the light intensity
+uniform samplerBuffer Instances;
+uniform int FirstInstance;
+
+in vec4 VertPosition;
+in vec2 VertTexCoord;
+in float VertIntensity;
+// texpage, alpha mode in the top two bits
+in int VertTexAttrib;
+
+out VertexData
+{
+    vec3 Color;
+    vec2 TexCoord;
+    flat ivec2 TexAttrib;
+};
+
+void main()
+{
+    int Instance = (FirstInstance + gl_InstanceID) * 4;
+    mat4 ModelMatrix = transpose(mat4(texelFetch(Instances, Instance),
+                                      texelFetch(Instances, Instance + 1),
+                                      texelFetch(Instances, Instance + 2),
+                                      vec4(0.0, 0.0, 0.0, 1.0)));
+    float LightIntensity = texelFetch(Instances, Instance + 3).x;
+
+    gl_Position = ProjectionMatrix * ViewMatrix * ModelMatrix * VertPosition;
+    Color = vec3(VertIntensity * LightIntensity * 2);
+    // texcoords are in 1/65536ths
+    TexCoord = VertTexCoord / 65536.0;
+    TexAttrib = ivec2(VertTexAttrib & 0x3FFF, VertTexAttrib >> 14);
+}
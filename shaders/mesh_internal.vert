@@ -11,8 +11,9 @@ uniform float LightIntensity;
 
 in vec4 VertPosition;
 in vec2 VertTexCoord;
-in vec3 VertColor;
-in ivec2 VertTexAttrib;
+in float VertIntensity;
+// texpage, alpha mode in the top two bits
+in int VertTexAttrib;
 
 out VertexData
 {
@@ -24,7 +25,8 @@ out VertexData
 void main()
 {
     gl_Position = ProjectionMatrix * ViewMatrix * ModelMatrix * VertPosition;
-    Color = VertColor * LightIntensity * 2;
-    TexCoord = VertTexCoord;
-    TexAttrib = VertTexAttrib;
+    Color = vec3(VertIntensity * LightIntensity * 2);
+    // texcoords are in 1/65536ths
+    TexCoord = VertTexCoord / 65536.0;
+    TexAttrib = ivec2(VertTexAttrib & 0x3FFF, VertTexAttrib >> 14);
 }
@@ -0,0 +1,43 @@
+#version 430 core
+
+layout (std140) uniform TransformBlock
+{
+    mat4 ProjectionMatrix;
+    mat4 ViewMatrix;
+};
+
+struct DrawData
+{
+    mat4 ModelMatrix;
+    float LightIntensity;
+    int LightingBlock;
+};
+
+layout (std430) readonly buffer DrawDataBlock
+{
+    DrawData Draws[];
+};
+
+in vec4 VertPosition;
+in vec2 VertTexCoord;
+in float VertIntensity;
+// texpage, alpha mode in the top two bits
+in int VertTexAttrib;
+// the base instance of the draw command plus the instance
+in int VertDrawIndex;
+
+out VertexData
+{
+    vec3 Color;
+    vec2 TexCoord;
+    flat ivec2 TexAttrib;
+};
+
+void main()
+{
+    gl_Position = ProjectionMatrix * ViewMatrix * Draws[VertDrawIndex].ModelMatrix * VertPosition;
+    Color = vec3(VertIntensity * Draws[VertDrawIndex].LightIntensity * 2);
+    // texcoords are in 1/65536ths
+    TexCoord = VertTexCoord / 65536.0;
+    TexAttrib = ivec2(VertTexAttrib & 0x3FFF, VertTexAttrib >> 14);
+}
@@ -6,10 +6,15 @@ layout (std140) uniform TransformBlock
     mat4 ViewMatrix;
 };
 
+// room geometry is relative to the room origin
+uniform samplerBuffer RoomOrigins;
+
 in vec4 VertPosition;
 in vec2 VertTexCoord;
-in vec3 VertColor;
-in ivec2 VertTexAttrib;
+in float VertIntensity;
+in int VertRoom;
+// texpage, alpha mode in the top two bits
+in int VertTexAttrib;
 
 out VertexData
 {
@@ -20,8 +25,11 @@ out VertexData
 
 void main()
 {
-    gl_Position = ProjectionMatrix * ViewMatrix * VertPosition;
-    Color = VertColor;
-    TexCoord = VertTexCoord;
-    TexAttrib = VertTexAttrib;
+    vec3 WorldSpacePosition = VertPosition.xyz + texelFetch(RoomOrigins, VertRoom).xyz;
+    gl_Position = ProjectionMatrix * ViewMatrix * vec4(WorldSpacePosition, 1.0);
+    // intensities are halved, so that baked static meshes fit
+    Color = vec3(VertIntensity * 2);
+    // texcoords are in 1/65536ths
+    TexCoord = VertTexCoord / 65536.0;
+    TexAttrib = ivec2(VertTexAttrib & 0x3FFF, VertTexAttrib >> 14);
 }
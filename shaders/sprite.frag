@@ -1,6 +1,9 @@
 #version 150 core
 
 uniform sampler2DArray TexPages;
+// texpages hold palette indices, unless they were expanded to rgba
+uniform bool IndexedTexPages;
+uniform sampler2D Palette;
 
 in VertexData
 {
@@ -14,6 +17,8 @@ out vec4 FragColor;
 void main()
 {
     vec4 TexColor = texture(TexPages, vec3(TexCoord, TexLayer));
+    if (IndexedTexPages)
+        TexColor = texelFetch(Palette, ivec2(int(TexColor.r * 255.0 + 0.5), 0), 0);
     if (TexColor.a < 0.5)
         discard;
     FragColor = vec4(LightIntensity * TexColor.rgb, 1.0);
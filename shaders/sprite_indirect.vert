@@ -0,0 +1,47 @@
+#version 430 core
+
+layout (std140) uniform TransformBlock
+{
+    mat4 ProjectionMatrix;
+    mat4 ViewMatrix;
+};
+
+// the model matrix only translates to the sprite position
+struct DrawData
+{
+    mat4 ModelMatrix;
+    float LightIntensity;
+    int LightingBlock;
+};
+
+layout (std430) readonly buffer DrawDataBlock
+{
+    DrawData Draws[];
+};
+
+in vec2 VertPosition;
+in vec2 VertTexCoord;
+in int VertTexLayer;
+// the base instance of the draw command plus the instance
+in int VertDrawIndex;
+
+out VertexData
+{
+    float LightIntensity;
+    vec2 TexCoord;
+    flat int TexLayer;
+};
+
+void main()
+{
+    vec4 SpritePosition = Draws[VertDrawIndex].ModelMatrix[3];
+
+    vec4 RightVec = vec4(ViewMatrix[0][0], ViewMatrix[1][0], ViewMatrix[2][0], 0.0);
+    vec4 UpVec = vec4(ViewMatrix[0][1], ViewMatrix[1][1], ViewMatrix[2][1], 0.0);
+    vec4 VertOffset = VertPosition.x * RightVec + VertPosition.y * UpVec;
+
+    gl_Position = ProjectionMatrix * ViewMatrix * (SpritePosition + VertOffset);
+    LightIntensity = Draws[VertDrawIndex].LightIntensity;
+    TexCoord = VertTexCoord;
+    TexLayer = VertTexLayer;
+}
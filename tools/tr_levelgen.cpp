@@ -0,0 +1,761 @@
+/*
+ * TR Level Viewer
+ * Copyright (C) 2015  Milan Izai <milan.izai@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * tr_levelgen - writes synthetic TR1/TR2 level files
+ *
+ * The output is not meant to look like anything, it only has to be
+ * accepted by tr::loader and be reproducible for a given set of options.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+static struct {
+    std::string output;
+    int version = 0;
+    long num_rooms = 16;
+    long num_room_verts = 256;
+    long num_meshes = 64;
+    long num_mesh_verts = 32;
+    long num_models = 8;
+    long num_objects = 64;
+    long num_anim_frames = 16;
+    long num_texpages = 8;
+    long num_static_meshes = 4;
+    long num_sprites = 8;
+    uint32_t seed = 1;
+} cmdopts;
+
+/*
+ * Random
+ */
+
+static uint32_t rng_state = 1;
+
+static uint32_t Random()
+{
+    // xorshift32
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static long RandomRange(long lo, long hi)
+{
+    return lo + (long)(Random() % (uint32_t)(hi - lo + 1));
+}
+
+/*
+ * Writer
+ */
+
+class Writer
+{
+public:
+    void w8(uint8_t value) { data.push_back(value); }
+    void w16(uint16_t value) { w8(value & 0xFF); w8(value >> 8); }
+    void w32(uint32_t value) { w16(value & 0xFFFF); w16(value >> 16); }
+    void zeros(size_t n) { data.insert(data.end(), n, 0); }
+    void append(const Writer& other) { data.insert(data.end(), other.data.begin(), other.data.end()); }
+
+    size_t size() const { return data.size(); }
+    void patch32(size_t offset, uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+            data[offset + i] = (value >> (i * 8)) & 0xFF;
+    }
+
+    bool save(const char* filename) const
+    {
+        FILE* fp = fopen(filename, "wb");
+        if (!fp)
+            return false;
+        bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+        return (fclose(fp) == 0) && ok;
+    }
+
+private:
+    std::vector<uint8_t> data;
+};
+
+/*
+ * Level
+ */
+
+static bool IsTR2()
+{
+    return cmdopts.version == 2;
+}
+
+static long NumTexInfos()
+{
+    return cmdopts.num_texpages * 16;
+}
+
+static long RoomGridSide()
+{
+    long side = 2;
+    while (side * side < cmdopts.num_room_verts)
+        ++side;
+    return side;
+}
+
+static long RoomsPerRow()
+{
+    long n = 1;
+    while (n * n < cmdopts.num_rooms)
+        ++n;
+    return n;
+}
+
+static void WritePalette(Writer* w)
+{
+    for (int i = 0; i < 256; ++i) {
+        w->w8((i * 7) & 0x3F);
+        w->w8((i * 13) & 0x3F);
+        w->w8((i * 29) & 0x3F);
+    }
+}
+
+static void WritePalette16(Writer* w)
+{
+    for (int i = 0; i < 256; ++i) {
+        w->w8((i * 7) & 0xFF);
+        w->w8((i * 13) & 0xFF);
+        w->w8((i * 29) & 0xFF);
+        w->w8(0);
+    }
+}
+
+static void WriteTexPages(Writer* w)
+{
+    w->w32(cmdopts.num_texpages);
+    for (long p = 0; p < cmdopts.num_texpages; ++p)
+        for (int i = 0; i < 256 * 256; ++i)
+            w->w8(Random() & 0xFF);
+    if (IsTR2()) {
+        for (long p = 0; p < cmdopts.num_texpages; ++p)
+            for (int i = 0; i < 256 * 256; ++i)
+                w->w16(0x8000 | (Random() & 0x7FFF));
+    }
+}
+
+static void WriteRoom(Writer* w, long room_idx)
+{
+    long side = RoomGridSide();
+    long row = RoomsPerRow();
+    int32_t x = (room_idx % row) * (side + 1) * 1024;
+    int32_t z = (room_idx / row) * (side + 1) * 1024;
+
+    // room info
+    w->w32(x);
+    w->w32(z);
+    w->w32(0);
+    w->w32(-4096);
+
+    // room data
+    size_t num_data_words_offset = w->size();
+    w->w32(0);
+    size_t data_begin = w->size();
+
+    long num_verts = side * side;
+    w->w16(num_verts);
+    for (long i = 0; i < num_verts; ++i) {
+        w->w16((i % side) * 1024);
+        w->w16(-(int16_t)RandomRange(0, 512));
+        w->w16((i / side) * 1024);
+        w->w16(RandomRange(0, 8191));
+        if (IsTR2()) {
+            w->w16(0);
+            w->w16(RandomRange(0, 8191));
+        }
+    }
+
+    long num_quads = (side - 1) * (side - 1);
+    w->w16(num_quads);
+    for (long i = 0; i < num_quads; ++i) {
+        long cx = i % (side - 1), cz = i / (side - 1);
+        w->w16(cz * side + cx);
+        w->w16(cz * side + cx + 1);
+        w->w16((cz + 1) * side + cx + 1);
+        w->w16((cz + 1) * side + cx);
+        w->w16(RandomRange(0, NumTexInfos() - 1) | ((Random() & 1) << 15));
+    }
+
+    long num_tris = side - 1;
+    w->w16(num_tris);
+    for (long i = 0; i < num_tris; ++i) {
+        w->w16(i);
+        w->w16(i + 1);
+        w->w16(i + side);
+        w->w16(RandomRange(0, NumTexInfos() - 1));
+    }
+
+    long num_static_sprites = (cmdopts.num_sprites > 0) ? 2 : 0;
+    w->w16(num_static_sprites);
+    for (long i = 0; i < num_static_sprites; ++i) {
+        w->w16(RandomRange(0, num_verts - 1));
+        w->w16(RandomRange(0, cmdopts.num_sprites - 1));
+    }
+
+    w->patch32(num_data_words_offset, (w->size() - data_begin) / 2);
+
+    // portals
+    long num_portals = (cmdopts.num_rooms > 1) ? 1 : 0;
+    w->w16(num_portals);
+    for (long i = 0; i < num_portals; ++i) {
+        w->w16((room_idx + 1) % cmdopts.num_rooms);
+        w->zeros(30);
+    }
+
+    // sectors
+    w->w16(side + 1);
+    w->w16(side + 1);
+    for (long i = 0; i < (side + 1) * (side + 1); ++i) {
+        w->w16(0);
+        w->w16(0xFFFF);
+        w->w8(0xFF);
+        w->w8(0);
+        w->w8(0xFF);
+        w->w8(0);
+    }
+
+    // ambient lighting
+    w->w16(RandomRange(0, 8191));
+    if (IsTR2()) {
+        w->w16(0);
+        w->w16(0);
+    }
+
+    // lights
+    long num_lights = RandomRange(0, 4);
+    w->w16(num_lights);
+    for (long i = 0; i < num_lights; ++i) {
+        w->w32(x + RandomRange(0, side * 1024));
+        w->w32(-RandomRange(0, 2048));
+        w->w32(z + RandomRange(0, side * 1024));
+        w->w16(RandomRange(0, 8191));
+        if (IsTR2())
+            w->w16(0);
+        w->w32(RandomRange(1024, 8192));
+        if (IsTR2())
+            w->w32(0);
+    }
+
+    // static meshes
+    long num_static_meshes = (cmdopts.num_static_meshes > 0) ? RandomRange(0, 6) : 0;
+    w->w16(num_static_meshes);
+    for (long i = 0; i < num_static_meshes; ++i) {
+        w->w32(x + RandomRange(0, side * 1024));
+        w->w32(0);
+        w->w32(z + RandomRange(0, side * 1024));
+        w->w16(RandomRange(0, 3) << 14);
+        w->w16(RandomRange(0, 8191));
+        if (IsTR2())
+            w->w16(0);
+        w->w16(RandomRange(0, cmdopts.num_static_meshes - 1) + 1000);
+    }
+
+    // alternate room
+    w->w16(0xFFFF);
+
+    // flags
+    w->w16(0);
+}
+
+static void WriteMesh(Writer* w, long mesh_idx)
+{
+    // NOTE: static meshes are always internally lit, see WriteStaticMeshes()
+    bool external = (mesh_idx >= cmdopts.num_static_meshes) && (mesh_idx % 2 == 1);
+    long num_verts = cmdopts.num_mesh_verts;
+
+    // bounding sphere
+    w->zeros(6);
+    w->w32(512);
+
+    // positions
+    w->w16(num_verts);
+    for (long i = 0; i < num_verts; ++i) {
+        w->w16(RandomRange(-256, 256));
+        w->w16(RandomRange(-256, 256));
+        w->w16(RandomRange(-256, 256));
+    }
+
+    // light attribs
+    if (external) {
+        w->w16(num_verts);
+        for (long i = 0; i < num_verts; ++i) {
+            w->w16(RandomRange(-16384, 16384));
+            w->w16(RandomRange(-16384, 16384));
+            w->w16(RandomRange(-16384, 16384));
+        }
+    } else {
+        w->w16(-num_verts);
+        for (long i = 0; i < num_verts; ++i)
+            w->w16(RandomRange(0, 8191));
+    }
+
+    // textured quads, textured tris, colored quads, colored tris
+    long num_polys[4] = {num_verts / 4, num_verts / 4, num_verts / 8, num_verts / 8};
+    for (int kind = 0; kind < 4; ++kind) {
+        int poly_verts = (kind % 2 == 0) ? 4 : 3;
+        w->w16(num_polys[kind]);
+        for (long i = 0; i < num_polys[kind]; ++i) {
+            for (int j = 0; j < poly_verts; ++j)
+                w->w16(RandomRange(0, num_verts - 1));
+            if (kind < 2)
+                w->w16(RandomRange(0, NumTexInfos() - 1));
+            else
+                w->w16(RandomRange(1, 255));
+        }
+    }
+}
+
+static void WriteMeshes(Writer* w)
+{
+    Writer mesh_data;
+    std::vector<uint32_t> mesh_pointers;
+    for (long i = 0; i < cmdopts.num_meshes; ++i) {
+        mesh_pointers.push_back(mesh_data.size());
+        WriteMesh(&mesh_data, i);
+    }
+
+    // mesh data
+    w->w32(mesh_data.size() / 2);
+    w->append(mesh_data);
+
+    // mesh pointers
+    w->w32(mesh_pointers.size());
+    for (uint32_t mesh_pointer : mesh_pointers)
+        w->w32(mesh_pointer);
+}
+
+static long NumModelMeshes(long model_idx)
+{
+    return 1 + model_idx % 8;
+}
+
+static void WriteAnimFrame(Writer* w, long num_nodes)
+{
+    // bounding box
+    for (int i = 0; i < 6; ++i)
+        w->w16(RandomRange(-512, 512));
+
+    // offset
+    for (int i = 0; i < 3; ++i)
+        w->w16(RandomRange(-64, 64));
+
+    if (!IsTR2())
+        w->w16(num_nodes);
+
+    // rotations, always three-axis
+    for (long i = 0; i < num_nodes; ++i) {
+        uint16_t hi = Random() & 0x3FFF;
+        uint16_t lo = Random() & 0xFFFF;
+        if (IsTR2()) {
+            w->w16(hi);
+            w->w16(lo);
+        } else {
+            // TR1 stores the two words of an angle set swapped
+            w->w16(lo);
+            w->w16(hi);
+        }
+    }
+}
+
+static void WriteAnimations(Writer* w)
+{
+    // one animation per model, the frames are sized for that model
+    long num_animations = cmdopts.num_models;
+    Writer frame_data;
+    std::vector<uint32_t> frame_offsets;
+    for (long i = 0; i < num_animations; ++i) {
+        frame_offsets.push_back(frame_data.size());
+        for (long j = 0; j < cmdopts.num_anim_frames; ++j)
+            WriteAnimFrame(&frame_data, NumModelMeshes(i));
+    }
+
+    // animations
+    w->w32(num_animations);
+    for (long i = 0; i < num_animations; ++i) {
+        long frame_size = IsTR2() ? 9 + NumModelMeshes(i) * 2 : 0;
+        w->w32(frame_offsets[i]);
+        w->w8(2);
+        w->w8(frame_size);
+        w->w16(0);
+        w->zeros(8);
+        w->w16(0);
+        w->w16((cmdopts.num_anim_frames - 1) * 2);
+        w->w16(i);
+        w->w16(0);
+        w->w16(1);
+        w->w16(i);
+        w->w16(1);
+        w->w16(i * 2);
+    }
+
+    // anim structs
+    w->w32(num_animations);
+    for (long i = 0; i < num_animations; ++i) {
+        w->w16(0);
+        w->w16(1);
+        w->w16(i);
+    }
+
+    // anim ranges
+    w->w32(num_animations);
+    for (long i = 0; i < num_animations; ++i) {
+        w->w16(0);
+        w->w16(1);
+        w->w16(i);
+        w->w16(0);
+    }
+
+    // anim command data
+    w->w32(num_animations * 2);
+    for (long i = 0; i < num_animations; ++i) {
+        w->w16(5);
+        w->w16(0);
+    }
+
+    // bone data
+    long num_bone_data_dwords = 0;
+    for (long i = 0; i < cmdopts.num_models; ++i)
+        num_bone_data_dwords += (NumModelMeshes(i) - 1) * 4;
+    w->w32(num_bone_data_dwords);
+    for (long i = 0; i < cmdopts.num_models; ++i) {
+        for (long j = 1; j < NumModelMeshes(i); ++j) {
+            // push at the first child, pop at the last one
+            uint32_t op = 0;
+            if (j == 1 && NumModelMeshes(i) > 2)
+                op = 0x02;
+            else if (j == NumModelMeshes(i) - 1 && NumModelMeshes(i) > 2)
+                op = 0x01;
+            w->w32(op);
+            w->w32(RandomRange(-256, 256));
+            w->w32(RandomRange(-256, 256));
+            w->w32(RandomRange(-256, 256));
+        }
+    }
+
+    // anim frame data
+    w->w32(frame_data.size() / 2);
+    w->append(frame_data);
+}
+
+static void WriteModels(Writer* w)
+{
+    w->w32(cmdopts.num_models);
+    long first_mesh = 0, bone_data_offset = 0;
+    for (long i = 0; i < cmdopts.num_models; ++i) {
+        long num_meshes = NumModelMeshes(i);
+        if (first_mesh + num_meshes > cmdopts.num_meshes)
+            first_mesh = 0;
+        w->w32(i);
+        w->w16(num_meshes);
+        w->w16(first_mesh);
+        w->w32(bone_data_offset);
+        w->w32(0);
+        w->w16(i);
+        first_mesh += num_meshes;
+        bone_data_offset += (num_meshes - 1) * 4;
+    }
+}
+
+static void WriteStaticMeshes(Writer* w)
+{
+    w->w32(cmdopts.num_static_meshes);
+    for (long i = 0; i < cmdopts.num_static_meshes; ++i) {
+        w->w32(i + 1000);
+        w->w16(i);
+        for (int j = 0; j < 12; ++j)
+            w->w16((j % 2) ? 256 : -256);
+        w->w16(2);
+    }
+}
+
+static void WriteTexInfos(Writer* w)
+{
+    w->w32(NumTexInfos());
+    for (long i = 0; i < NumTexInfos(); ++i) {
+        w->w16(i % 3 == 0 ? 1 : 0);
+        w->w16(i / 16);
+        uint8_t x = (i % 4) * 64, y = ((i / 4) % 4) * 64;
+        uint8_t coords[4][2] = {{x, y}, {(uint8_t)(x + 63), y}, {(uint8_t)(x + 63), (uint8_t)(y + 63)}, {x, (uint8_t)(y + 63)}};
+        for (int j = 0; j < 4; ++j) {
+            w->w8(1);
+            w->w8(coords[j][0]);
+            w->w8(1);
+            w->w8(coords[j][1]);
+        }
+    }
+}
+
+static void WriteSprites(Writer* w)
+{
+    w->w32(cmdopts.num_sprites);
+    for (long i = 0; i < cmdopts.num_sprites; ++i) {
+        w->w16(i % cmdopts.num_texpages);
+        w->w8((i % 4) * 64);
+        w->w8((i / 4 % 4) * 64);
+        w->w16(63 * 256 + 255);
+        w->w16(63 * 256 + 255);
+        w->w16(-128);
+        w->w16(-256);
+        w->w16(128);
+        w->w16(0);
+    }
+
+    // sprite sequences, one per pair of sprites
+    long num_sprite_sequences = cmdopts.num_sprites / 2;
+    w->w32(num_sprite_sequences);
+    for (long i = 0; i < num_sprite_sequences; ++i) {
+        w->w32(i + 500);
+        w->w16(-2);
+        w->w16(i * 2);
+    }
+}
+
+static void WriteTexAnimChains(Writer* w)
+{
+    long num_chains = (NumTexInfos() >= 8) ? 2 : 0;
+    w->w32(1 + num_chains * 5);
+    w->w16(num_chains);
+    for (long i = 0; i < num_chains; ++i) {
+        w->w16(3);
+        for (int j = 0; j < 4; ++j)
+            w->w16(i * 4 + j);
+    }
+}
+
+static void WriteObjects(Writer* w)
+{
+    long row = RoomsPerRow(), side = RoomGridSide();
+    long num_sprite_sequences = cmdopts.num_sprites / 2;
+
+    w->w32(cmdopts.num_objects);
+    for (long i = 0; i < cmdopts.num_objects; ++i) {
+        long room_idx = RandomRange(0, cmdopts.num_rooms - 1);
+        bool sprite = (num_sprite_sequences > 0) && (i % 4 == 3);
+        if (sprite || cmdopts.num_models == 0)
+            w->w16(500 + RandomRange(0, num_sprite_sequences - 1));
+        else
+            w->w16(RandomRange(0, cmdopts.num_models - 1));
+        w->w16(room_idx);
+        w->w32((room_idx % row) * (side + 1) * 1024 + RandomRange(0, side * 1024));
+        w->w32(0);
+        w->w32((room_idx / row) * (side + 1) * 1024 + RandomRange(0, side * 1024));
+        w->w16(RandomRange(0, 3) << 14);
+        w->w16((i % 5 == 0) ? 0xFFFF : RandomRange(0, 8191));
+        if (IsTR2())
+            w->w16(0);
+        w->w16(0);
+    }
+}
+
+static void WriteLevel(Writer* w)
+{
+    // version
+    w->w32(IsTR2() ? 0x2D : 0x20);
+
+    if (IsTR2()) {
+        WritePalette(w);
+        WritePalette16(w);
+    }
+
+    WriteTexPages(w);
+
+    // unused
+    w->w32(0);
+
+    // rooms
+    w->w16(cmdopts.num_rooms);
+    for (long i = 0; i < cmdopts.num_rooms; ++i)
+        WriteRoom(w, i);
+
+    // floor data
+    w->w32(1);
+    w->w16(0);
+
+    WriteMeshes(w);
+    WriteAnimations(w);
+    WriteModels(w);
+    WriteStaticMeshes(w);
+    WriteTexInfos(w);
+    WriteSprites(w);
+
+    // cameras
+    w->w32(0);
+
+    // sound sources
+    w->w32(0);
+
+    // boxes, overlap data, zones
+    w->w32(1);
+    w->zeros(IsTR2() ? 8 : 20);
+    w->w32(1);
+    w->w16(0x8000);
+    w->zeros(IsTR2() ? 20 : 12);
+
+    WriteTexAnimChains(w);
+    WriteObjects(w);
+
+    // light map
+    w->zeros(32 * 256);
+
+    if (!IsTR2())
+        WritePalette(w);
+
+    // cinematic frames
+    w->w16(0);
+
+    // demo data
+    w->w16(0);
+
+    // sound map
+    w->zeros((IsTR2() ? 370 : 256) * 2);
+
+    // sound details
+    w->w32(0);
+
+    if (!IsTR2()) {
+        // samples
+        w->w32(0);
+    }
+
+    // sample indices
+    w->w32(0);
+}
+
+/*
+ * main
+ */
+
+static bool SYS_ParseOptions(int argc, char* argv[]);
+static void SYS_PrintUsageInfo();
+
+int main(int argc, char* argv[])
+{
+    if (!SYS_ParseOptions(argc, argv)) {
+        SYS_PrintUsageInfo();
+        return 1;
+    }
+
+    rng_state = cmdopts.seed ? cmdopts.seed : 1;
+
+    Writer w;
+    WriteLevel(&w);
+    if (!w.save(cmdopts.output.c_str())) {
+        fprintf(stderr, "tr_levelgen: can't write %s\n", cmdopts.output.c_str());
+        return 1;
+    }
+
+    return 0;
+}
+
+static bool ParseCount(const char* arg, long min, long max, long* value)
+{
+    char* end = nullptr;
+    long result = strtol(arg, &end, 10);
+    if (!*arg || *end || result < min || result > max)
+        return false;
+    *value = result;
+    return true;
+}
+
+bool SYS_ParseOptions(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        long* count = nullptr;
+        long min = 0, max = 0;
+        if (arg.empty()) {
+            continue;
+        } else if (arg == "-tr1" || arg == "-tr2") {
+            if (cmdopts.version != 0)
+                return false;
+            cmdopts.version = (arg == "-tr1") ? 1 : 2;
+        } else if (arg == "-rooms") {
+            count = &cmdopts.num_rooms; min = 1; max = 0x7FFF;
+        } else if (arg == "-room_verts") {
+            count = &cmdopts.num_room_verts; min = 4; max = 0x7FFF;
+        } else if (arg == "-meshes") {
+            count = &cmdopts.num_meshes; min = 8; max = 0xFFFF;
+        } else if (arg == "-mesh_verts") {
+            count = &cmdopts.num_mesh_verts; min = 8; max = 0x7FFF;
+        } else if (arg == "-models") {
+            count = &cmdopts.num_models; min = 0; max = 0xFFFF;
+        } else if (arg == "-objects") {
+            count = &cmdopts.num_objects; min = 0; max = 0xFFFF;
+        } else if (arg == "-anim_frames") {
+            count = &cmdopts.num_anim_frames; min = 1; max = 0x7FFF;
+        } else if (arg == "-texpages") {
+            count = &cmdopts.num_texpages; min = 1; max = 0x7FF;
+        } else if (arg == "-static_meshes") {
+            count = &cmdopts.num_static_meshes; min = 0; max = 8;
+        } else if (arg == "-sprites") {
+            count = &cmdopts.num_sprites; min = 0; max = 0x7FFF;
+        } else if (arg == "-seed") {
+            long seed = 0;
+            if (i + 1 >= argc || !ParseCount(argv[++i], 0, 0x7FFFFFFF, &seed))
+                return false;
+            cmdopts.seed = seed;
+        } else if (arg[0] != '-') {
+            if (!cmdopts.output.empty())
+                return false;
+            cmdopts.output = arg;
+        } else {
+            return false;
+        }
+
+        if (count && (i + 1 >= argc || !ParseCount(argv[++i], min, max, count)))
+            return false;
+    }
+
+    if (cmdopts.output.empty() || cmdopts.version == 0)
+        return false;
+    if (cmdopts.num_objects > 0 && cmdopts.num_models == 0 && cmdopts.num_sprites < 2)
+        return false;
+
+    return true;
+}
+
+void SYS_PrintUsageInfo()
+{
+    fprintf(stderr, "usage: ./tr_levelgen {-tr1|-tr2} [OPTION]... OUTPUT\n\n");
+    fprintf(stderr, "OPTIONS\n");
+    fprintf(stderr, "  -rooms N          number of rooms (default 16)\n");
+    fprintf(stderr, "  -room_verts N     vertices per room (default 256)\n");
+    fprintf(stderr, "  -meshes N         number of meshes (default 64)\n");
+    fprintf(stderr, "  -mesh_verts N     vertices per mesh (default 32)\n");
+    fprintf(stderr, "  -models N         number of models (default 8)\n");
+    fprintf(stderr, "  -objects N        number of objects (default 64)\n");
+    fprintf(stderr, "  -anim_frames N    frames per animation (default 16)\n");
+    fprintf(stderr, "  -texpages N       number of texpages (default 8)\n");
+    fprintf(stderr, "  -static_meshes N  number of static mesh types (default 4)\n");
+    fprintf(stderr, "  -sprites N        number of sprites (default 8)\n");
+    fprintf(stderr, "  -seed N           random seed (default 1)\n");
+    fprintf(stderr, "\n");
+}